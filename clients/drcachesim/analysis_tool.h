@@ -38,6 +38,7 @@
 
 // To support installation of headers for analysis tools into a single
 // separate directory we omit common/ here and rely on -I.
+#include <stddef.h>
 #include "memref.h"
 
 class analysis_tool_t
@@ -49,6 +50,17 @@ class analysis_tool_t
     virtual ~analysis_tool_t() {};
     virtual bool operator!() { return !success; }
     virtual bool process_memref(const memref_t &memref) = 0;
+    // The analyzer hands references to tools in batches through this routine.
+    // The default simply calls process_memref() on each; tools with a hot
+    // per-reference path should override it to avoid the per-reference
+    // virtual dispatch.
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count)
+    {
+        bool res = true;
+        for (size_t i = 0; i < count; ++i)
+            res = process_memref(memrefs[i]) && res;
+        return res;
+    }
     virtual bool print_results() = 0;
  protected:
     bool success;
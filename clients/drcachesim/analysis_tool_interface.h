@@ -38,6 +38,7 @@
 #ifndef _ANALYSIS_TOOL_INTERFACE_H_
 #define _ANALYSIS_TOOL_INTERFACE_H_ 1
 
+#include <string>
 #include "analysis_tool.h"
 
 /* The return value from this routine is passed to the other routines in
@@ -47,4 +48,9 @@
  */
 analysis_tool_t *drmemtrace_analysis_tool_create();
 
+/* Creates the tool named by simulator_type, for running several tools over the
+ * same trace.  The same failure conventions apply.
+ */
+analysis_tool_t *drmemtrace_analysis_tool_create(const std::string &simulator_type);
+
 #endif /* _ANALYSIS_TOOL_INTERFACE_H_ */
@@ -30,25 +30,34 @@
  * DAMAGE.
  */
 
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "analysis_tool.h"
 #include "analyzer.h"
 #include "reader/file_reader.h"
+#ifdef UNIX
+# include "reader/mmap_file_reader.h"
+#endif
 #ifdef HAS_ZLIB
+# include "reader/chunked_file_reader.h"
 # include "reader/compressed_file_reader.h"
 #endif
+#include "common/bounded_queue.h"
 #include "common/utils.h"
 
 analyzer_t::analyzer_t() :
-    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL)
+    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL),
+    pipeline(false)
 {
     /* Nothing else: child class needs to initialize. */
 }
 
 analyzer_t::analyzer_t(const std::string &trace_file, analysis_tool_t **tools_in,
-                       int num_tools_in) :
+                       int num_tools_in, bool pipeline_in) :
     success(true), trace_iter(NULL), trace_end(NULL), num_tools(num_tools_in),
-    tools(tools_in)
+    tools(tools_in), pipeline(pipeline_in)
 {
     for (int i = 0; i < num_tools; ++i) {
         if (tools[i] == NULL || !*tools[i]) {
@@ -62,10 +71,45 @@ analyzer_t::analyzer_t(const std::string &trace_file, analysis_tool_t **tools_in
         ERRMSG("Trace file name is empty\n");
         return;
     }
+    open_trace_file(trace_file);
+}
+
+#ifdef UNIX
+static bool
+is_gzip_file(const std::string &trace_file)
+{
+    FILE *file = fopen(trace_file.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    unsigned char magic[2];
+    bool res = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        magic[0] == 0x1f && magic[1] == 0x8b;
+    fclose(file);
+    return res;
+}
+#endif
+
+void
+analyzer_t::open_trace_file(const std::string &trace_file)
+{
+#ifdef HAS_ZLIB
+    if (chunked_file_reader_t::is_chunked_file(trace_file.c_str())) {
+        trace_iter = new chunked_file_reader_t(trace_file.c_str());
+        trace_end = new chunked_file_reader_t();
+        return;
+    }
+#endif
+#ifdef UNIX
+    // Walking a mapping in place is the fastest way to read an uncompressed file.
+    if (!is_gzip_file(trace_file)) {
+        trace_iter = new mmap_file_reader_t(trace_file.c_str());
+        trace_end = new mmap_file_reader_t();
+        return;
+    }
+#endif
 #ifdef HAS_ZLIB
     // Even if the file is uncompressed, zlib's gzip interface is faster than
-    // file_reader_t's fstream in our measurements, so we always use it when
-    // available.
+    // file_reader_t's fstream in our measurements, so we use it when available.
     trace_iter = new compressed_file_reader_t(trace_file.c_str());
     trace_end = new compressed_file_reader_t();
 #else
@@ -99,16 +143,83 @@ analyzer_t::start_reading()
 bool
 analyzer_t::run()
 {
-    bool res = true;
     if (!start_reading())
         return false;
+    if (pipeline)
+        return run_pipeline();
+    return run_serial();
+}
 
-    for (; *trace_iter != *trace_end; ++(*trace_iter)) {
-        for (int i = 0; i < num_tools; ++i) {
-            memref_t memref = **trace_iter;
-            res = tools[i]->process_memref(memref) && res;
+bool
+analyzer_t::run_serial()
+{
+    bool res = true;
+    memref_t *batch = new memref_t[batch_size];
+    int count;
+    while ((count = trace_iter->read_batch(batch, batch_size)) > 0) {
+        for (int i = 0; i < num_tools; ++i)
+            res = tools[i]->process_memrefs(batch, count) && res;
+    }
+    delete [] batch;
+    return res;
+}
+
+// A batch is shared read-only by all tool threads and freed by whichever
+// finishes with it last.
+struct memref_batch_t {
+    explicit memref_batch_t(int users_in) : users(users_in) {}
+    std::vector<memref_t> refs;
+    std::atomic<int> users;
+};
+
+typedef bounded_queue_t<memref_batch_t *> batch_queue_t;
+
+static void
+tool_thread_func(analysis_tool_t *tool, batch_queue_t *queue, bool *res)
+{
+    // A NULL batch marks the end of the trace.
+    for (memref_batch_t *batch = queue->pop(); batch != NULL; batch = queue->pop()) {
+        *res = tool->process_memrefs(&batch->refs[0], batch->refs.size()) && *res;
+        if (batch->users.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete batch;
+    }
+}
+
+bool
+analyzer_t::run_pipeline()
+{
+    std::vector<batch_queue_t *> queues(num_tools);
+    std::vector<std::thread> threads;
+    // We avoid std::vector<bool> as each thread writes its own element.
+    bool *results = new bool[num_tools];
+    for (int i = 0; i < num_tools; ++i) {
+        queues[i] = new batch_queue_t(pipeline_queue_depth);
+        results[i] = true;
+        threads.push_back(std::thread(tool_thread_func, tools[i], queues[i],
+                                      &results[i]));
+    }
+
+    while (true) {
+        memref_batch_t *batch = new memref_batch_t(num_tools);
+        batch->refs.resize(batch_size);
+        int count = trace_iter->read_batch(&batch->refs[0], batch_size);
+        if (count == 0) {
+            delete batch;
+            break;
         }
+        batch->refs.resize(count);
+        for (int i = 0; i < num_tools; ++i)
+            queues[i]->push(batch);
+    }
+
+    bool res = true;
+    for (int i = 0; i < num_tools; ++i) {
+        queues[i]->push(NULL);
+        threads[i].join();
+        res = results[i] && res;
+        delete queues[i];
     }
+    delete [] results;
     return res;
 }
 
@@ -54,23 +54,42 @@ class analyzer_t
     // The analyzer will reference the tools array passed in during its lifetime:
     // it does not make a copy.
     // The user must free them afterward.
+    // If pipeline is true, run() decodes the trace on its own thread and
+    // runs each tool on a separate worker thread: see run_pipeline().
     analyzer_t(const std::string &trace_file, analysis_tool_t **tools,
-               int num_tools);
+               int num_tools, bool pipeline = false);
     virtual ~analyzer_t();
     virtual bool operator!();
     virtual bool run();
     virtual bool print_stats();
 
  protected:
+    // Sets trace_iter and trace_end to the best reader for the trace file's
+    // format.
+    void open_trace_file(const std::string &trace_file);
+
     // This finalizes the trace_iter setup.  It can block and is meant to be
     // called at the top of run().
     bool start_reading();
 
+    bool run_serial();
+    // The reader thread (our caller) decodes the trace into batches and fans
+    // each batch out to every tool's worker thread through a bounded queue,
+    // so the tools run concurrently and the total time approaches that of
+    // the slowest tool rather than the sum of all of them.
+    bool run_pipeline();
+
+    // Entries per batch read from the trace and handed to the tools.
+    static const int batch_size = 4096;
+    // Batches each tool thread may fall behind the reader.
+    static const int pipeline_queue_depth = 64;
+
     bool success;
     reader_t *trace_iter;
     reader_t *trace_end;
     int num_tools;
     analysis_tool_t **tools;
+    bool pipeline;
 };
 
 #endif /* _ANALYZER_H_ */
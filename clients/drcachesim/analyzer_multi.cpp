@@ -36,14 +36,18 @@
 #include "common/options.h"
 #include "common/utils.h"
 #include "reader/file_reader.h"
+#ifdef UNIX
+# include "reader/mmap_file_reader.h"
+#endif
 #ifdef HAS_ZLIB
-# include "reader/compressed_file_reader.h"
+# include "reader/chunked_file_reader.h"
 #endif
 #include "reader/ipc_reader.h"
 #include "tracer/raw2trace.h"
 
 analyzer_multi_t::analyzer_multi_t()
 {
+    pipeline = op_pipeline.get_value();
     if (!create_analysis_tools()) {
         success = false;
         ERRMSG("Failed to create analysis tool\n");
@@ -60,31 +64,24 @@ analyzer_multi_t::analyzer_multi_t()
         // XXX: better to put in app name + pid, or rely on staying inside subdir?
         std::string tracefile = op_indir.get_value() + std::string(DIRSEP) +
             TRACE_FILENAME;
-        file_reader_t *existing = new file_reader_t(tracefile.c_str());
-        if (existing->is_complete())
-            trace_iter = existing;
-        else {
-            delete existing;
-            raw2trace_t raw2trace(op_indir.get_value(), tracefile);
-            raw2trace.do_conversion();
-            trace_iter = new file_reader_t(tracefile.c_str());
+        if (!open_complete_trace(tracefile)) {
+            {
+                // The output is only complete once raw2trace_t closes it.
+                raw2trace_t raw2trace(op_indir.get_value(), tracefile,
+                                      op_jobs.get_value(), op_chunked.get_value());
+                raw2trace.do_conversion();
+            }
+            if (!open_complete_trace(tracefile)) {
+                ERRMSG("Failed to convert %s\n", op_indir.get_value().c_str());
+                success = false;
+                return;
+            }
         }
-        // We don't support a compressed file here (is_complete() is too hard
-        // to implement).
-        trace_end = new file_reader_t();
     } else if (op_infile.get_value().empty()) {
         trace_iter = new ipc_reader_t(op_ipc_name.get_value().c_str());
         trace_end = new ipc_reader_t();
-    } else {
-#ifdef HAS_ZLIB
-        // Even for uncompressed files, zlib's gzip interface is faster than fstream.
-        trace_iter = new compressed_file_reader_t(op_infile.get_value().c_str());
-        trace_end = new compressed_file_reader_t();
-#else
-        trace_iter = new file_reader_t(op_infile.get_value().c_str());
-        trace_end = new file_reader_t();
-#endif
-    }
+    } else
+        open_trace_file(op_infile.get_value());
     // We can't call trace_iter->init() here as it blocks for ipc_reader_t.
 }
 
@@ -93,32 +90,86 @@ analyzer_multi_t::~analyzer_multi_t()
     destroy_analysis_tools();
 }
 
+// Sets trace_iter and trace_end to a reader, and a matching end-of-trace
+// reader, for the trace file if it exists and is complete.  Otherwise leaves
+// them NULL and returns false.
+// A gzipped file is not supported here as is_complete() is too hard to
+// implement for it, but a chunked file is.
+bool
+analyzer_multi_t::open_complete_trace(const std::string &tracefile)
+{
+#ifdef HAS_ZLIB
+    if (chunked_file_reader_t::is_chunked_file(tracefile.c_str())) {
+        chunked_file_reader_t *chunked = new chunked_file_reader_t(tracefile.c_str());
+        if (!chunked->is_complete()) {
+            delete chunked;
+            return false;
+        }
+        trace_iter = chunked;
+        trace_end = new chunked_file_reader_t();
+        return true;
+    }
+#endif
+#ifdef UNIX
+    mmap_file_reader_t *existing = new mmap_file_reader_t(tracefile.c_str());
+#else
+    file_reader_t *existing = new file_reader_t(tracefile.c_str());
+#endif
+    if (!existing->is_complete()) {
+        delete existing;
+        return false;
+    }
+    trace_iter = existing;
+#ifdef UNIX
+    trace_end = new mmap_file_reader_t();
+#else
+    trace_end = new file_reader_t();
+#endif
+    return true;
+}
+
 
 bool
 analyzer_multi_t::create_analysis_tools()
 {
-    /* FIXME i#2006: add multiple tool support. */
     /* FIXME i#2006: create a single top-level tool for multi-component
      * tools.
      */
     tools = new analysis_tool_t*[max_num_tools];
-    tools[0] = drmemtrace_analysis_tool_create();
-    if (tools[0] != NULL && !*tools[0]) {
-        delete tools[0];
-        tools[0] = NULL;
+    num_tools = 0;
+    const std::string &types = op_simulator_type.get_value();
+    size_t start = 0;
+    while (start <= types.size()) {
+        size_t end = types.find(SIMULATOR_TYPE_SEPARATOR, start);
+        if (end == std::string::npos)
+            end = types.size();
+        if (num_tools == max_num_tools) {
+            ERRMSG("Usage error: at most %d simulator types are supported\n",
+                   max_num_tools);
+            return false;
+        }
+        analysis_tool_t *tool =
+            drmemtrace_analysis_tool_create(types.substr(start, end - start));
+        if (tool != NULL && !*tool) {
+            delete tool;
+            tool = NULL;
+        }
+        if (tool == NULL)
+            return false;
+        tools[num_tools++] = tool;
+        start = end + 1;
     }
-    if (tools[0] == NULL)
-        return false;
-    num_tools = 1;
     return true;
 }
 
 void
 analyzer_multi_t::destroy_analysis_tools()
 {
-    if (!success)
-        return;
+    // This also cleans up after a failed create_analysis_tools(): num_tools
+    // only counts the tools that were successfully created.
     for (int i = 0; i < num_tools; i++)
         delete tools[i];
     delete [] tools;
+    tools = NULL;
+    num_tools = 0;
 }
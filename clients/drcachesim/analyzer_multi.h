@@ -50,6 +50,7 @@ class analyzer_multi_t : public analyzer_t
  protected:
     bool create_analysis_tools();
     void destroy_analysis_tools();
+    bool open_complete_trace(const std::string &tracefile);
 
     static const int max_num_tools = 8;
  };
@@ -0,0 +1,91 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* bounded_queue: a fixed-capacity single-producer single-consumer queue
+ * for handing work between analyzer threads.
+ */
+
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_ 1
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Only one thread may push and only one thread may pop.  Neither side takes
+// a lock: each side owns one index and only reads the other's.  A push to a
+// full queue or a pop from an empty queue yields until the other side catches
+// up, which bounds how far a producer can run ahead of its consumer.
+template <typename T>
+class bounded_queue_t
+{
+ public:
+    // The capacity is rounded up to a power of 2.
+    explicit bounded_queue_t(size_t capacity) : head(0), tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    void push(const T &item)
+    {
+        size_t cur_tail = tail.load(std::memory_order_relaxed);
+        while (cur_tail - head.load(std::memory_order_acquire) > mask)
+            std::this_thread::yield();
+        slots[cur_tail & mask] = item;
+        tail.store(cur_tail + 1, std::memory_order_release);
+    }
+
+    T pop()
+    {
+        size_t cur_head = head.load(std::memory_order_relaxed);
+        while (tail.load(std::memory_order_acquire) == cur_head)
+            std::this_thread::yield();
+        T item = slots[cur_head & mask];
+        head.store(cur_head + 1, std::memory_order_release);
+        return item;
+    }
+
+ private:
+    std::vector<T> slots;
+    size_t mask;
+    // The consumer owns head and the producer owns tail.  We keep them on
+    // separate cache lines so the two sides do not false-share.
+    std::atomic<size_t> head;
+    char pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+};
+
+#endif /* _BOUNDED_QUEUE_H_ */
@@ -60,6 +60,22 @@ droption_t<std::string> op_indir
  "After a trace file is produced via -offline into -outdir, it can be passed to the "
  "simulator via this flag pointing at the subdirectory created in -outdir.");
 
+droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 1, "Number of threads converting an offline trace",
+ "When -indir is converted into a trace file, specifies how many threads convert the "
+ "per-thread raw files in parallel before they are merged in timestamp order.  "
+ "The default of 1 converts serially.  0 uses one thread per hardware thread.  "
+ "Any value other than 1 writes each thread's converted trace to an intermediate "
+ "<outname>.N.tmp file that is only removed after the merge, so the conversion "
+ "temporarily needs about twice the disk space of the final trace.");
+
+droption_t<bool> op_chunked
+(DROPTION_SCOPE_FRONTEND, "chunked", false, "Compress the trace converted from -indir",
+ "When -indir is converted into a trace file, stores it as separately compressed "
+ "chunks with a trailing index rather than as raw trace entries.  Such a file is "
+ "much smaller and is recognized automatically by -indir and -infile.  This requires "
+ "zlib support.");
+
 droption_t<std::string> op_infile
 (DROPTION_SCOPE_ALL, "infile", "", "Offline trace file for input to the simulator",
  "Directs the simulator to use a trace file (not a raw data file from -offline: "
@@ -70,9 +86,9 @@ droption_t<unsigned int> op_num_cores
  "Specifies the number of cores to simulate.");
 
 droption_t<unsigned int> op_line_size
-(DROPTION_SCOPE_FRONTEND, "line_size", 64, "Cache line size",
+(DROPTION_SCOPE_ALL, "line_size", 64, "Cache line size",
  "Specifies the cache line size, which is assumed to be identical for L1 and L2 "
- "caches.");
+ "caches.  It is also the line size of the tracer's -L0_filter caches.");
 
 droption_t<bytesize_t> op_L1I_size
 (DROPTION_SCOPE_FRONTEND, "L1I_size", 32*1024U, "Instruction cache total size",
@@ -119,6 +135,48 @@ droption_t<bytesize_t> op_max_trace_size
  "of one internal buffer.  Once reached, instrumentation continues for that thread, "
  "but no further data is recorded.");
 
+droption_t<bool> op_L0_filter
+(DROPTION_SCOPE_ALL, "L0_filter", false,
+ "Filter out first-level instruction and data cache hits during tracing",
+ "Filters out instruction and data references that hit in a direct-mapped \"L0\" "
+ "cache simulated inline by the tracer, sized by -L0I_size and -L0D_size, so that "
+ "only the misses are recorded.  This greatly reduces both the trace volume and the "
+ "tracing overhead when studying outer cache levels.  The simulator's L1 caches then "
+ "see only the L0 misses, and should be configured to model the next level.  "
+ "A reference that spans two lines is only filtered out if both of them hit.  "
+ "This is currently only supported for online traces on x86.");
+
+droption_t<bytesize_t> op_L0I_size
+(DROPTION_SCOPE_CLIENT, "L0I_size", 32*1024U,
+ "Size of the -L0_filter instruction cache",
+ "Specifies the size of the direct-mapped instruction cache used by -L0_filter.  "
+ "It must be a power of two multiple of -line_size.  A value of 0 disables "
+ "filtering of instruction fetches.");
+
+droption_t<bytesize_t> op_L0D_size
+(DROPTION_SCOPE_CLIENT, "L0D_size", 32*1024U,
+ "Size of the -L0_filter data cache",
+ "Specifies the size of the direct-mapped data cache used by -L0_filter.  "
+ "It must be a power of two multiple of -line_size.  A value of 0 disables "
+ "filtering of data references.");
+
+droption_t<bool> op_async_writer
+(DROPTION_SCOPE_CLIENT, "async_writer", false,
+ "Write offline trace buffers from a separate thread",
+ "By default, with -offline each application thread writes its own full trace "
+ "buffer to disk.  This option instead hands full buffers to a dedicated writer "
+ "thread and continues immediately with a free buffer from a small per-thread pool "
+ "(see -writer_buffers).  If the writer falls behind, a thread that runs out of "
+ "buffers writes out queued buffers itself.  This is "
+ "currently only supported on Linux, and is ignored if a buffer handoff callback is "
+ "registered via drmemtrace_buffer_handoff().");
+
+droption_t<unsigned int> op_writer_buffers
+(DROPTION_SCOPE_CLIENT, "writer_buffers", 4, "Trace buffers per thread for -async_writer",
+ "Specifies the maximum number of trace buffers each thread may have, including "
+ "the one it is filling, when -async_writer is enabled.  Buffers are allocated on "
+ "demand.  This must be at least 2.");
+
 droption_t<bool> op_online_instr_types
 (DROPTION_SCOPE_CLIENT, "online_instr_types", false,
  "Whether online traces should distinguish instr types",
@@ -130,7 +188,40 @@ droption_t<std::string> op_replace_policy
 (DROPTION_SCOPE_FRONTEND, "replace_policy", REPLACE_POLICY_LRU,
  "Cache replacement policy", "Specifies the replacement policy for caches. "
  "Supported policies: LRU (Least Recently Used), LFU (Least Frequently Used), "
- "FIFO (First-In-First-Out).");
+ "FIFO (First-In-First-Out), PLRU (tree pseudo-LRU), SRRIP (Static Re-Reference "
+ "Interval Prediction), BRRIP (Bimodal RRIP).  PLRU, SRRIP, and BRRIP support "
+ "an associativity of at most 64.");
+
+droption_t<unsigned int> op_cache_shards
+(DROPTION_SCOPE_FRONTEND, "cache_shards", 1, "Number of cache simulation threads",
+ "Specifies the number of threads the cache simulator partitions the cache sets "
+ "across.  Each reference is routed to the thread owning its set, and the "
+ "statistics of all threads are combined at the end, producing the same results "
+ "as the default single-threaded simulation.  Must be a power of 2 no larger than "
+ "the number of sets in any simulated cache.");
+
+droption_t<std::string> op_sweep_cache
+(DROPTION_SCOPE_FRONTEND, "sweep_cache", "LL", "Cache level swept by " CACHE_SWEEP,
+ "Specifies which cache the " CACHE_SWEEP " simulator type evaluates at every size "
+ "and associativity in -sweep_sizes and -sweep_assocs: either LL or L1D.  "
+ "For LL, the L1 caches are simulated as specified by -L1I_size, -L1I_assoc, "
+ "-L1D_size, and -L1D_assoc.  For L1D, the results are summed over all cores.  "
+ "Every swept cache uses LRU replacement, regardless of -replace_policy.");
+
+droption_t<std::string> op_sweep_sizes
+(DROPTION_SCOPE_FRONTEND, "sweep_sizes", "1M,2M,4M,8M,16M",
+ "Comma-separated cache sizes for " CACHE_SWEEP,
+ "Specifies the total sizes of the cache swept by the " CACHE_SWEEP " simulator "
+ "type.  Each size may have a K, M, or G suffix.");
+
+droption_t<std::string> op_sweep_assocs
+(DROPTION_SCOPE_FRONTEND, "sweep_assocs", "4,8,16",
+ "Comma-separated associativities for " CACHE_SWEEP,
+ "Specifies the associativities of the cache swept by the " CACHE_SWEEP " simulator "
+ "type.  Every size in -sweep_sizes is evaluated at every associativity.  The "
+ "whole family is simulated in one pass over the trace using LRU stack distances.  "
+ "Results match separate " CPU_CACHE " simulations with LRU replacement, except "
+ "that lines invalidated by a flush are approximated.");
 
 droption_t<bytesize_t> op_page_size
 (DROPTION_SCOPE_FRONTEND, "page_size", bytesize_t(4*1024), "Virtual/physical page size",
@@ -167,9 +258,22 @@ droption_t<std::string> op_TLB_replace_policy
 
 droption_t<std::string> op_simulator_type
 (DROPTION_SCOPE_FRONTEND, "simulator_type", CPU_CACHE,
- "Simulator type (" CPU_CACHE", " TLB", " REUSE_DIST", or " HISTOGRAM").",
+ "Simulator type (" CPU_CACHE", " TLB", " REUSE_DIST", " CACHE_SWEEP", or "
+ HISTOGRAM").",
  "Specifies the type of the simulator. "
- "Supported types: " CPU_CACHE", " TLB", " REUSE_DIST", or " HISTOGRAM".");
+ "Supported types: " CPU_CACHE", " TLB", " REUSE_DIST", " CACHE_SWEEP", or "
+ HISTOGRAM".  "
+ "Multiple types separated by ':' run each of those tools over the same trace, "
+ "e.g., " CPU_CACHE":" REUSE_DIST".");
+
+droption_t<bool> op_pipeline
+(DROPTION_SCOPE_FRONTEND, "pipeline", false,
+ "Run the trace reader and each tool on separate threads.",
+ "By default the trace is read and every tool is run on a single thread.  "
+ "This option reads the trace on one thread and runs each tool on its own thread, "
+ "handing batches of references from the reader to the tools.  With multiple "
+ "tools (see -simulator_type) the analysis then takes about as long as the slowest "
+ "tool rather than the sum of all of them.");
 
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_ALL, "verbose", 0, 0, 64, "Verbosity level",
@@ -246,3 +350,29 @@ droption_t<bool> op_reuse_verify_skip
  "Verifies every skip list-calculated reuse distance with a full list walk. "
  "This incurs significant additional overhead.  This option is only available "
  "in debug builds.");
+droption_t<bool> op_reuse_fenwick
+(DROPTION_SCOPE_FRONTEND, "reuse_fenwick", false,
+ "Use a hash table and a Fenwick tree to compute reuse distances.",
+ "Computes the same results as the default skip list, but each reference takes "
+ "time logarithmic in the number of unique cache lines instead of proportional "
+ "to its reuse distance, and with less memory per line.  This is much faster "
+ "for traces touching many lines, and -reuse_skip_dist then does not apply.");
+droption_t<unsigned int> op_reuse_sample_period
+(DROPTION_SCOPE_FRONTEND, "reuse_sample_period", 1,
+ "Only track one in this many cache lines for reuse distances.",
+ "Computes reuse distances for a hashed subset of roughly one in this many cache "
+ "lines, and scales the distances and counts to estimate the results for all of "
+ "them.  This bounds memory by the sampled lines and cuts the work accordingly, "
+ "at the cost of some error, which grows as fewer lines are sampled.  The top "
+ "cache lines are chosen among the sampled ones only.  Implies -reuse_fenwick.");
+droption_t<unsigned int> op_reuse_sample_max_lines
+(DROPTION_SCOPE_FRONTEND, "reuse_sample_max_lines", 0,
+ "Track at most this many cache lines for reuse distances.",
+ "If non-zero, samples cache lines as -reuse_sample_period does, halving the "
+ "sampling rate whenever more than this many lines are tracked.  This bounds the "
+ "memory used regardless of the trace.  Implies -reuse_fenwick.");
+droption_t<bool> op_reuse_miss_ratio_curve
+(DROPTION_SCOPE_FRONTEND, "reuse_miss_ratio_curve", false,
+ "Print the miss ratio curve derived from the reuse distances.",
+ "Prints the miss rate of a fully associative LRU cache of each power-of-two "
+ "number of cache lines up to the number of unique lines.");
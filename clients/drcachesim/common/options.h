@@ -39,10 +39,15 @@
 #define REPLACE_POLICY_LRU                      "LRU"
 #define REPLACE_POLICY_LFU                      "LFU"
 #define REPLACE_POLICY_FIFO                     "FIFO"
+#define REPLACE_POLICY_PLRU                     "PLRU"
+#define REPLACE_POLICY_SRRIP                    "SRRIP"
+#define REPLACE_POLICY_BRRIP                    "BRRIP"
 #define CPU_CACHE                               "cache"
 #define TLB                                     "TLB"
 #define HISTOGRAM                               "histogram"
 #define REUSE_DIST                              "reuse_distance"
+#define CACHE_SWEEP                             "cache_sweep"
+#define SIMULATOR_TYPE_SEPARATOR                ':'
 
 #include <string>
 #include "droption.h"
@@ -52,6 +57,8 @@ extern droption_t<std::string> op_ipc_name;
 extern droption_t<std::string> op_outdir;
 extern droption_t<std::string> op_infile;
 extern droption_t<std::string> op_indir;
+extern droption_t<unsigned int> op_jobs;
+extern droption_t<bool> op_chunked;
 extern droption_t<unsigned int> op_num_cores;
 extern droption_t<unsigned int> op_line_size;
 extern droption_t<bytesize_t> op_L1I_size;
@@ -63,8 +70,17 @@ extern droption_t<unsigned int> op_LL_assoc;
 extern droption_t<bool> op_use_physical;
 extern droption_t<unsigned int> op_virt2phys_freq;
 extern droption_t<bytesize_t> op_max_trace_size;
+extern droption_t<bool> op_L0_filter;
+extern droption_t<bytesize_t> op_L0I_size;
+extern droption_t<bytesize_t> op_L0D_size;
+extern droption_t<bool> op_async_writer;
+extern droption_t<unsigned int> op_writer_buffers;
 extern droption_t<bool> op_online_instr_types;
 extern droption_t<std::string> op_replace_policy;
+extern droption_t<unsigned int> op_cache_shards;
+extern droption_t<std::string> op_sweep_cache;
+extern droption_t<std::string> op_sweep_sizes;
+extern droption_t<std::string> op_sweep_assocs;
 extern droption_t<bytesize_t> op_page_size;
 extern droption_t<unsigned int> op_TLB_L1I_entries;
 extern droption_t<unsigned int> op_TLB_L1D_entries;
@@ -74,6 +90,7 @@ extern droption_t<unsigned int> op_TLB_L2_entries;
 extern droption_t<unsigned int> op_TLB_L2_assoc;
 extern droption_t<std::string> op_TLB_replace_policy;
 extern droption_t<std::string> op_simulator_type;
+extern droption_t<bool> op_pipeline;
 extern droption_t<unsigned int> op_verbose;
 extern droption_t<std::string> op_dr_root;
 extern droption_t<bool> op_dr_debug;
@@ -88,4 +105,8 @@ extern droption_t<unsigned int> op_reuse_distance_threshold;
 extern droption_t<bool> op_reuse_distance_histogram;
 extern droption_t<unsigned int> op_reuse_skip_dist;
 extern droption_t<bool> op_reuse_verify_skip;
+extern droption_t<bool> op_reuse_fenwick;
+extern droption_t<unsigned int> op_reuse_sample_period;
+extern droption_t<unsigned int> op_reuse_sample_max_lines;
+extern droption_t<bool> op_reuse_miss_ratio_curve;
 #endif /* _OPTIONS_H_ */
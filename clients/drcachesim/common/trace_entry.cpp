@@ -58,4 +58,7 @@ const char * const trace_type_names[] = {
     "thread",
     "thread_exit",
     "pid",
+    "header",
+    "footer",
+    "instr_no_fetch",
 };
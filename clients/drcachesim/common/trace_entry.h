@@ -131,6 +131,14 @@ typedef enum {
 
     // The final entry in an offline file or a pipe.
     TRACE_TYPE_FOOTER,
+
+    // The PC of the instruction whose data reference follows, used when the
+    // trace does not otherwise guarantee the instr fetch precedes it (with the
+    // tracer's -L0_filter, the fetch may have been filtered out, and the pipe
+    // writes of other threads may fall between the fetch and its data).  The
+    // size field holds the instruction length.
+    // These entries are hidden by reader_t and turned into memref_t.data.pc.
+    TRACE_TYPE_INSTR_NO_FETCH,
 } trace_type_t;
 
 extern const char * const trace_type_names[];
@@ -248,4 +256,69 @@ struct _offline_entry_t {
 } END_PACKED_STRUCTURE;
 typedef struct _offline_entry_t offline_entry_t;
 
+///////////////////////////////////////////////////////////////////////////
+//
+// Chunked trace container format
+
+// A chunked trace file holds the same trace_entry_t stream as a plain trace
+// file, starting with the TRACE_TYPE_HEADER entry and ending with the
+// TRACE_TYPE_FOOTER entry, but split into chunks that are each compressed on
+// their own with zlib.  The layout is:
+//   chunked_trace_header_t
+//   the compressed chunks, back to back
+//   chunked_trace_chunk_t for each chunk
+//   chunked_trace_thread_t for each thread
+//   chunked_trace_trailer_t
+// The trailer sits at a fixed offset from the end, so checking whether the file
+// is complete and finding the index are both constant-time.  A chunk never
+// starts with a data reference, a TRACE_TYPE_INSTR_BUNDLE or a *_FLUSH_END
+// entry, so given the thread and process in its index entry a chunk can be
+// read on its own.
+
+#define CHUNKED_TRACE_MAGIC 0x4b4e484345525444ULL /* "DTRECHNK" */
+#define CHUNKED_TRACE_VERSION 1
+
+START_PACKED_STRUCTURE
+struct _chunked_trace_header_t {
+    uint64_t magic;
+    uint64_t version;
+    // The maximum number of trace_entry_t in a chunk.
+    uint64_t chunk_entries;
+} END_PACKED_STRUCTURE;
+typedef struct _chunked_trace_header_t chunked_trace_header_t;
+
+START_PACKED_STRUCTURE
+struct _chunked_trace_chunk_t {
+    uint64_t offset; // Of the compressed data from the start of the file.
+    uint64_t compressed_size;
+    uint64_t num_entries;
+    // The number of instruction fetches and data references in the chunk.
+    uint64_t num_refs;
+    // The thread and process in effect at the start of the chunk.
+    uint64_t tid;
+    uint64_t pid;
+} END_PACKED_STRUCTURE;
+typedef struct _chunked_trace_chunk_t chunked_trace_chunk_t;
+
+START_PACKED_STRUCTURE
+struct _chunked_trace_thread_t {
+    uint64_t tid;
+    uint64_t pid;
+    // The timestamp of the thread's first entry, or 0 if unknown.
+    uint64_t first_timestamp;
+    // The chunk holding the thread's first entry.
+    uint64_t first_chunk;
+} END_PACKED_STRUCTURE;
+typedef struct _chunked_trace_thread_t chunked_trace_thread_t;
+
+START_PACKED_STRUCTURE
+struct _chunked_trace_trailer_t {
+    uint64_t index_offset; // Of the first chunked_trace_chunk_t.
+    uint64_t num_chunks;
+    uint64_t num_threads;
+    uint64_t num_entries;
+    uint64_t magic;
+} END_PACKED_STRUCTURE;
+typedef struct _chunked_trace_trailer_t chunked_trace_trailer_t;
+
 #endif /* _TRACE_ENTRY_H_ */
@@ -0,0 +1,286 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <thread>
+#include <zlib.h>
+#include "chunked_file_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+// The end of a range that has not been set yet.
+#define RANGE_UNSET (~(uint64_t)0)
+
+chunked_file_reader_t::chunked_file_reader_t() :
+    readahead(1), have_index(false), range_begin(0), range_end(RANGE_UNSET),
+    next_to_queue(0), footer_pending(false), cur_pos(0)
+{
+    /* Empty. */
+}
+
+chunked_file_reader_t::chunked_file_reader_t(const char *file_name,
+                                             unsigned int readahead_in) :
+    fstream(file_name, std::ifstream::binary), readahead(readahead_in),
+    have_index(false), range_begin(0), range_end(RANGE_UNSET), next_to_queue(0),
+    footer_pending(false), cur_pos(0)
+{
+    if (readahead == 0)
+        readahead = std::thread::hardware_concurrency();
+    if (readahead == 0)
+        readahead = 1;
+}
+
+chunked_file_reader_t::~chunked_file_reader_t()
+{
+    // Wait for any decompression still in flight before the stream goes away.
+    pending.clear();
+    fstream.close();
+}
+
+bool
+chunked_file_reader_t::is_chunked_file(const char *file_name)
+{
+    std::ifstream in(file_name, std::ifstream::binary);
+    chunked_trace_header_t hdr;
+    return in.read((char*)&hdr, sizeof(hdr)) && hdr.magic == CHUNKED_TRACE_MAGIC;
+}
+
+bool
+chunked_file_reader_t::read_index()
+{
+    if (have_index)
+        return true;
+    if (!fstream)
+        return false;
+    if (!fstream.seekg(0, fstream.beg) ||
+        !fstream.read((char*)&header, sizeof(header)) ||
+        header.magic != CHUNKED_TRACE_MAGIC ||
+        header.version != CHUNKED_TRACE_VERSION)
+        return false;
+    // A file whose writer did not finish has no trailer.
+    if (!fstream.seekg(-(std::streamoff)sizeof(trailer), fstream.end) ||
+        !fstream.read((char*)&trailer, sizeof(trailer)) ||
+        trailer.magic != CHUNKED_TRACE_MAGIC) {
+        fstream.clear();
+        return false;
+    }
+    chunks.resize((size_t)trailer.num_chunks);
+    threads.resize((size_t)trailer.num_threads);
+    if (!fstream.seekg((std::streamoff)trailer.index_offset, fstream.beg) ||
+        (!chunks.empty() &&
+         !fstream.read((char*)&chunks[0], chunks.size() * sizeof(chunks[0]))) ||
+        (!threads.empty() &&
+         !fstream.read((char*)&threads[0], threads.size() * sizeof(threads[0])))) {
+        fstream.clear();
+        return false;
+    }
+    have_index = true;
+    return true;
+}
+
+bool
+chunked_file_reader_t::is_complete()
+{
+    return read_index();
+}
+
+bool
+chunked_file_reader_t::set_chunk_range(uint64_t begin, uint64_t end)
+{
+    if (!read_index() || begin > end || end > trailer.num_chunks)
+        return false;
+    range_begin = begin;
+    range_end = end;
+    return true;
+}
+
+uint64_t
+chunked_file_reader_t::get_num_chunks()
+{
+    if (!read_index())
+        return 0;
+    return trailer.num_chunks;
+}
+
+const chunked_trace_chunk_t &
+chunked_file_reader_t::get_chunk(uint64_t index)
+{
+    assert(have_index && index < chunks.size());
+    return chunks[(size_t)index];
+}
+
+const std::vector<chunked_trace_thread_t> &
+chunked_file_reader_t::get_threads()
+{
+    read_index();
+    return threads;
+}
+
+bool
+chunked_file_reader_t::init()
+{
+    at_eof = false;
+    if (!read_index()) {
+        ERRMSG("chunked trace is incomplete or corrupted\n");
+        return false;
+    }
+    if (range_end == RANGE_UNSET)
+        range_end = trailer.num_chunks;
+    next_to_queue = range_begin;
+    // A range that stops short of the last chunk gets its own footer.
+    footer_pending = range_end < trailer.num_chunks;
+    cur.clear();
+    cur_pos = 0;
+    if (range_begin > 0) {
+        // Only the first chunk has the header.  We instead restore the process
+        // of each thread seen so far and then the thread that the chunk's
+        // entries belong to.  A process entry only applies at the next thread
+        // entry, so we end with another thread entry.
+        trace_entry_t entry;
+        entry.size = sizeof(entry.addr);
+        for (size_t i = 0; i < threads.size(); ++i) {
+            if (threads[i].first_chunk >= range_begin)
+                continue;
+            entry.type = TRACE_TYPE_THREAD;
+            entry.addr = (addr_t)threads[i].tid;
+            cur.push_back(entry);
+            entry.type = TRACE_TYPE_PID;
+            entry.addr = (addr_t)threads[i].pid;
+            cur.push_back(entry);
+        }
+        entry.type = TRACE_TYPE_THREAD;
+        entry.addr = (addr_t)chunks[(size_t)range_begin].tid;
+        cur.push_back(entry);
+        entry.type = TRACE_TYPE_PID;
+        entry.addr = (addr_t)chunks[(size_t)range_begin].pid;
+        cur.push_back(entry);
+        entry.type = TRACE_TYPE_THREAD;
+        entry.addr = (addr_t)chunks[(size_t)range_begin].tid;
+        cur.push_back(entry);
+    } else {
+        trace_entry_t *first_entry = read_next_entry();
+        if (first_entry == NULL)
+            return false;
+        if (first_entry->type != TRACE_TYPE_HEADER ||
+            first_entry->addr != TRACE_ENTRY_VERSION) {
+            ERRMSG("missing header or version mismatch\n");
+            return false;
+        }
+    }
+    ++*this;
+    return true;
+}
+
+static std::vector<trace_entry_t>
+decompress_chunk(std::vector<char> data, uint64_t num_entries)
+{
+    std::vector<trace_entry_t> entries((size_t)num_entries);
+    uLongf size = (uLongf)(entries.size() * sizeof(trace_entry_t));
+    if (entries.empty() ||
+        uncompress((Bytef*)&entries[0], &size, (Bytef*)&data[0],
+                   (uLong)data.size()) != Z_OK ||
+        size != entries.size() * sizeof(trace_entry_t)) {
+        ERRMSG("failed to decompress trace chunk\n");
+        entries.clear();
+    }
+    return entries;
+}
+
+// Reads in the compressed data of the next chunks and starts decompressing them.
+void
+chunked_file_reader_t::queue_chunks()
+{
+    while (pending.size() < readahead && next_to_queue < range_end) {
+        const chunked_trace_chunk_t &chunk = chunks[(size_t)next_to_queue];
+        std::vector<char> data((size_t)chunk.compressed_size);
+        if (data.empty() ||
+            !fstream.seekg((std::streamoff)chunk.offset, fstream.beg) ||
+            !fstream.read(&data[0], data.size())) {
+            ERRMSG("failed to read trace chunk %llu\n", (unsigned long long)next_to_queue);
+            next_to_queue = range_end;
+            break;
+        }
+        pending.push_back(std::async(std::launch::async, decompress_chunk,
+                                     std::move(data), chunk.num_entries));
+        ++next_to_queue;
+    }
+}
+
+bool
+chunked_file_reader_t::next_chunk()
+{
+    queue_chunks();
+    cur_pos = 0;
+    if (pending.empty()) {
+        cur.clear();
+        if (!footer_pending)
+            return false;
+        trace_entry_t footer;
+        footer.type = TRACE_TYPE_FOOTER;
+        footer.size = 0;
+        footer.addr = 0;
+        cur.push_back(footer);
+        footer_pending = false;
+        return true;
+    }
+    cur = pending.front().get();
+    pending.pop_front();
+    // Keep the decompressors busy while this chunk is consumed.
+    queue_chunks();
+    return !cur.empty();
+}
+
+trace_entry_t *
+chunked_file_reader_t::read_next_entry()
+{
+    if (cur_pos == cur.size() && !next_chunk())
+        return NULL;
+    return &cur[cur_pos++];
+}
+
+int
+chunked_file_reader_t::read_next_entries(trace_entry_t *buf, int max)
+{
+    int count = 0;
+    while (count < max) {
+        if (cur_pos == cur.size() && !next_chunk())
+            break;
+        size_t num = cur.size() - cur_pos;
+        if (num > (size_t)(max - count))
+            num = (size_t)(max - count);
+        memcpy(buf + count, &cur[cur_pos], num * sizeof(*buf));
+        cur_pos += num;
+        count += (int)num;
+    }
+    return count;
+}
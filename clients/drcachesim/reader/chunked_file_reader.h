@@ -0,0 +1,95 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* chunked_file_reader: reads chunked trace files, whose chunks are compressed
+ * separately and listed in a trailing index (see chunked_trace_header_t).
+ */
+
+#ifndef _CHUNKED_FILE_READER_H_
+#define _CHUNKED_FILE_READER_H_ 1
+
+#include <deque>
+#include <fstream>
+#include <future>
+#include <vector>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+class chunked_file_reader_t : public reader_t
+{
+ public:
+    chunked_file_reader_t();
+    // Up to readahead chunks are decompressed in parallel ahead of the reader.
+    // 0 means one per hardware thread.
+    explicit chunked_file_reader_t(const char *file_name, unsigned int readahead = 0);
+    virtual ~chunked_file_reader_t();
+    virtual bool init();
+    // This only checks the trailer so it does not depend on the file size.
+    bool is_complete();
+
+    // Restricts reading to the chunks in [begin, end), to split up a trace.
+    // This must be called before init().
+    bool set_chunk_range(uint64_t begin, uint64_t end);
+    uint64_t get_num_chunks();
+    const chunked_trace_chunk_t &get_chunk(uint64_t index);
+    const std::vector<chunked_trace_thread_t> &get_threads();
+
+    static bool is_chunked_file(const char *file_name);
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual int read_next_entries(trace_entry_t *buf, int max);
+
+ private:
+    bool read_index();
+    void queue_chunks();
+    bool next_chunk();
+
+    std::ifstream fstream;
+    unsigned int readahead;
+    bool have_index;
+    chunked_trace_header_t header;
+    chunked_trace_trailer_t trailer;
+    std::vector<chunked_trace_chunk_t> chunks;
+    std::vector<chunked_trace_thread_t> threads;
+    uint64_t range_begin;
+    uint64_t range_end;
+    uint64_t next_to_queue;
+    bool footer_pending;
+    // Chunks being decompressed, in order.
+    std::deque< std::future< std::vector<trace_entry_t> > > pending;
+    std::vector<trace_entry_t> cur;
+    size_t cur_pos;
+};
+
+#endif /* _CHUNKED_FILE_READER_H_ */
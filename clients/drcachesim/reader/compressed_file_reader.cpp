@@ -94,3 +94,13 @@ compressed_file_reader_t::is_complete()
     // do for now: the user must pass in -infile for a gzipped file.
     return false;
 }
+
+int
+compressed_file_reader_t::read_next_entries(trace_entry_t *buf, int max)
+{
+    int len = gzread(file, (char*)buf, max * sizeof(*buf));
+    // A trailing partial entry is dropped, as in read_next_entry().
+    if (len < 0)
+        return 0;
+    return len / sizeof(*buf);
+}
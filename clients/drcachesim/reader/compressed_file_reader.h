@@ -51,6 +51,7 @@ class compressed_file_reader_t : public reader_t
 
  protected:
     virtual trace_entry_t * read_next_entry();
+    virtual int read_next_entries(trace_entry_t *buf, int max);
 
  private:
     gzFile file;
@@ -97,3 +97,12 @@ file_reader_t::is_complete()
     fstream.seekg(pos);
     return res;
 }
+
+int
+file_reader_t::read_next_entries(trace_entry_t *buf, int max)
+{
+    // A partial read at the end of the file leaves failbit set, which makes
+    // the following call return 0.
+    fstream.read((char*)buf, max * sizeof(*buf));
+    return (int)(fstream.gcount() / sizeof(*buf));
+}
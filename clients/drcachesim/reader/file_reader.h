@@ -54,6 +54,7 @@ class file_reader_t : public reader_t
 
  protected:
     virtual trace_entry_t * read_next_entry();
+    virtual int read_next_entries(trace_entry_t *buf, int max);
 
  private:
     std::ifstream fstream;
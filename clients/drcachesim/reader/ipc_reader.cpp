@@ -32,6 +32,7 @@
 
 #include <assert.h>
 #include <map>
+#include <string.h>
 #include "ipc_reader.h"
 #include "../common/memref.h"
 #include "../common/utils.h"
@@ -92,3 +93,20 @@ ipc_reader_t::read_next_entry()
     }
     return cur_buf;
 }
+
+int
+ipc_reader_t::read_next_entries(trace_entry_t *out, int max)
+{
+    // We only block for the first entry and then hand over whatever else
+    // the last pipe read brought in, to avoid waiting on a slow application.
+    trace_entry_t *entry = read_next_entry();
+    out[0] = *entry;
+    if (entry->type == TRACE_TYPE_FOOTER)
+        return 1;
+    int count = (int)(end_buf - (cur_buf + 1));
+    if (count > max - 1)
+        count = max - 1;
+    memcpy(&out[1], cur_buf + 1, count * sizeof(*out));
+    cur_buf += count;
+    return count + 1;
+}
@@ -0,0 +1,144 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mmap_file_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+// The most entries handed to reader_t at once, to keep the count in an int.
+#define MAX_WINDOW_ENTRIES (1 << 24)
+
+mmap_file_reader_t::mmap_file_reader_t() :
+    map_base(NULL), map_size(0), map_pos(NULL), map_end(NULL)
+{
+    /* Empty. */
+}
+
+mmap_file_reader_t::mmap_file_reader_t(const char *file_name) :
+    map_base(NULL), map_size(0), map_pos(NULL), map_end(NULL)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            map_base = map;
+            map_size = (size_t)st.st_size;
+            // We read front to back once, so ask for aggressive readahead and
+            // early reclaim behind us.
+            madvise(map_base, map_size, MADV_SEQUENTIAL);
+            map_pos = (const trace_entry_t *)map_base;
+            // A trailing partial entry is ignored.
+            map_end = map_pos + map_size / sizeof(trace_entry_t);
+        }
+    }
+    // The mapping keeps the file alive.
+    close(fd);
+}
+
+mmap_file_reader_t::~mmap_file_reader_t()
+{
+    if (map_base != NULL)
+        munmap(map_base, map_size);
+}
+
+bool
+mmap_file_reader_t::init()
+{
+    at_eof = false;
+    if (map_base == NULL)
+        return false;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+bool
+mmap_file_reader_t::is_complete()
+{
+    return map_end > (const trace_entry_t *)map_base &&
+        (map_end - 1)->type == TRACE_TYPE_FOOTER;
+}
+
+trace_entry_t *
+mmap_file_reader_t::read_next_entry()
+{
+    if (map_pos == map_end)
+        return NULL;
+    // The mapping is read-only: callers only read the entry.
+    return const_cast<trace_entry_t *>(map_pos++);
+}
+
+int
+mmap_file_reader_t::read_next_entries(trace_entry_t *buf, int max)
+{
+    const trace_entry_t *entries;
+    int count = 0;
+    while (count < max) {
+        int num = next_entries(&entries);
+        if (num == 0)
+            break;
+        if (num > max - count) {
+            map_pos -= num - (max - count);
+            num = max - count;
+        }
+        memcpy(buf + count, entries, num * sizeof(*buf));
+        count += num;
+    }
+    return count;
+}
+
+int
+mmap_file_reader_t::next_entries(const trace_entry_t **entries)
+{
+    size_t num = map_end - map_pos;
+    if (num > MAX_WINDOW_ENTRIES)
+        num = MAX_WINDOW_ENTRIES;
+    *entries = map_pos;
+    map_pos += num;
+    return (int)num;
+}
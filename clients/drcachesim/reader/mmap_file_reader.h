@@ -0,0 +1,66 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* mmap_file_reader: reads uncompressed trace files by mapping them into memory
+ * and walking the entries in place.
+ */
+
+#ifndef _MMAP_FILE_READER_H_
+#define _MMAP_FILE_READER_H_ 1
+
+#include <stddef.h>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+class mmap_file_reader_t : public reader_t
+{
+ public:
+    mmap_file_reader_t();
+    explicit mmap_file_reader_t(const char *file_name);
+    virtual ~mmap_file_reader_t();
+    virtual bool init();
+    bool is_complete();
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual int read_next_entries(trace_entry_t *buf, int max);
+    virtual int next_entries(const trace_entry_t **entries);
+
+ private:
+    void *map_base;
+    size_t map_size;
+    const trace_entry_t *map_pos;
+    const trace_entry_t *map_end;
+};
+
+#endif /* _MMAP_FILE_READER_H_ */
@@ -42,8 +42,9 @@
 
 // Following typical stream iterator convention, the default constructor
 // produces an EOF object.
-reader_t::reader_t() : at_eof(true), input_entry(NULL), cur_tid(0), cur_pid(0),
-                       cur_pc(0), bundle_idx(0)
+reader_t::reader_t() : at_eof(true), entries(NULL), entry_pos(0), entry_count(0),
+                       input_entry(NULL),
+                       cur_tid(0), cur_pid(0), cur_pc(0), bundle_idx(0)
 {
     /* Empty. */
 }
@@ -56,11 +57,86 @@ reader_t::operator*()
 
 reader_t&
 reader_t::operator++()
+{
+    advance();
+    return *this;
+}
+
+int
+reader_t::read_batch(memref_t *batch, int max)
+{
+    int count = 0;
+    while (count < max && !at_eof) {
+        batch[count++] = cur_ref;
+        // Expand the rest of an instr bundle in one go.
+        while (bundle_idx != 0 && count < max) {
+            next_bundle_instr();
+            batch[count++] = cur_ref;
+        }
+        advance();
+    }
+    return count;
+}
+
+int
+reader_t::read_next_entries(trace_entry_t *buf, int max)
+{
+    int count = 0;
+    while (count < max) {
+        trace_entry_t *entry = read_next_entry();
+        if (entry == NULL)
+            break;
+        buf[count++] = *entry;
+        if (entry->type == TRACE_TYPE_FOOTER)
+            break;
+    }
+    return count;
+}
+
+int
+reader_t::next_entries(const trace_entry_t **entries_out)
+{
+    *entries_out = entry_buf;
+    return read_next_entries(entry_buf, ENTRY_BUF_SIZE);
+}
+
+const trace_entry_t *
+reader_t::next_entry()
+{
+    if (entry_pos == entry_count) {
+        entry_pos = 0;
+        entry_count = next_entries(&entries);
+        if (entry_count <= 0) {
+            entry_count = 0;
+            return NULL;
+        }
+    }
+    return &entries[entry_pos++];
+}
+
+// Moves cur_ref to the next instr of the bundle in input_entry.
+void
+reader_t::next_bundle_instr()
+{
+    // The trace stream always has the instr fetch first, which we
+    // use to compute the starting PC for the subsequent instructions.
+    cur_ref.instr.size = input_entry->length[bundle_idx++];
+    cur_pc = next_pc;
+    cur_ref.instr.addr = cur_pc;
+    next_pc = cur_pc + cur_ref.instr.size;
+    // input_entry->size stores the number of instrs in this bundle
+    assert(input_entry->size <= sizeof(input_entry->length));
+    if (bundle_idx == input_entry->size)
+        bundle_idx = 0;
+}
+
+void
+reader_t::advance()
 {
     // We bail if we get a partial read, or EOF, or any error.
     while (true) {
         if (bundle_idx == 0/*not in instr bundle*/)
-            input_entry = read_next_entry();
+            input_entry = next_entry();
         if (input_entry == NULL) {
             ERRMSG("Trace is truncated\n");
             assert(false);
@@ -118,16 +194,11 @@ reader_t::operator++()
             break;
         case TRACE_TYPE_INSTR_BUNDLE:
             have_memref = true;
-            // The trace stream always has the instr fetch first, which we
-            // use to compute the starting PC for the subsequent instructions.
-            cur_ref.instr.size = input_entry->length[bundle_idx++];
-            cur_pc = next_pc;
-            cur_ref.instr.addr = cur_pc;
-            next_pc = cur_pc + cur_ref.instr.size;
-            // input_entry->size stores the number of instrs in this bundle
-            assert(input_entry->size <= sizeof(input_entry->length));
-            if (bundle_idx == input_entry->size)
-                bundle_idx = 0;
+            next_bundle_instr();
+            break;
+        case TRACE_TYPE_INSTR_NO_FETCH:
+            // This only supplies the PC for the data reference that follows.
+            cur_pc = input_entry->addr;
             break;
         case TRACE_TYPE_INSTR_FLUSH:
         case TRACE_TYPE_DATA_FLUSH:
@@ -170,6 +241,4 @@ reader_t::operator++()
         if (have_memref)
             break;
     }
-
-    return *this;
 }
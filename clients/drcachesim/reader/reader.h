@@ -41,6 +41,7 @@
 #include <iterator>
 #include <map>
 #include "../common/memref.h"
+#include "../common/trace_entry.h"
 #include "../common/utils.h"
 
 class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
@@ -68,6 +69,11 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
 
     virtual reader_t& operator++();
 
+    // Copies up to max entries starting at the current one into batch and
+    // advances past them, returning the number copied (0 at the end of the
+    // trace).  This costs one virtual call per batch rather than two per entry.
+    virtual int read_batch(memref_t *batch, int max);
+
     // We do not support the post-increment operator for two reasons:
     // 1) It prevents pure virtual functions here, as it cannot
     //    return an abstract type;
@@ -77,10 +83,33 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
  protected:
     virtual trace_entry_t * read_next_entry() = 0;
 
+    // Reads up to max entries into buf, returning the number read, or 0 at the
+    // end of the input.  The default implementation calls read_next_entry()
+    // until the footer; subclasses should override it to read in bulk.
+    virtual int read_next_entries(trace_entry_t *buf, int max);
+
+    // Points *entries at the next entries, returning how many there are, or 0
+    // at the end of the input.  They must stay valid until the next call.
+    // The default implementation copies them into a buffer with
+    // read_next_entries(); subclasses that hold the entries in memory
+    // already can override it to avoid the copy.
+    virtual int next_entries(const trace_entry_t **entries);
+
     bool at_eof;
 
  private:
-    trace_entry_t *input_entry;
+    // Decodes the next memref into cur_ref.
+    void advance();
+    void next_bundle_instr();
+    const trace_entry_t * next_entry();
+
+    static const int ENTRY_BUF_SIZE = 4096;
+    trace_entry_t entry_buf[ENTRY_BUF_SIZE];
+    const trace_entry_t *entries;
+    int entry_pos;
+    int entry_count;
+
+    const trace_entry_t *input_entry;
     memref_t cur_ref;
     memref_tid_t cur_tid;
     memref_pid_t cur_pid;
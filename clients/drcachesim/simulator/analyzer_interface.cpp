@@ -35,6 +35,7 @@
 #include "../common/options.h"
 #include "../common/utils.h"
 #include "cache_simulator_create.h"
+#include "cache_sweep_create.h"
 #include "tlb_simulator_create.h"
 /* XXX i#2006: we include these here for now but it's undecided whether they
  * should be separated and this should only include
@@ -46,7 +47,13 @@
 analysis_tool_t *
 drmemtrace_analysis_tool_create()
 {
-    if (op_simulator_type.get_value() == CPU_CACHE) {
+    return drmemtrace_analysis_tool_create(op_simulator_type.get_value());
+}
+
+analysis_tool_t *
+drmemtrace_analysis_tool_create(const std::string &simulator_type)
+{
+    if (simulator_type == CPU_CACHE) {
         return cache_simulator_create(op_num_cores.get_value(),
                                       op_line_size.get_value(),
                                       op_L1I_size.get_value(),
@@ -55,8 +62,13 @@ drmemtrace_analysis_tool_create()
                                       op_L1D_assoc.get_value(),
                                       op_LL_size.get_value(),
                                       op_LL_assoc.get_value(),
-                                      op_replace_policy.get_value());
-    } else if (op_simulator_type.get_value() == TLB) {
+                                      op_replace_policy.get_value(),
+                                      op_skip_refs.get_value(),
+                                      op_warmup_refs.get_value(),
+                                      op_sim_refs.get_value(),
+                                      op_verbose.get_value(),
+                                      op_cache_shards.get_value());
+    } else if (simulator_type == TLB) {
         return tlb_simulator_create(op_num_cores.get_value(),
                                     op_page_size.get_value(),
                                     op_TLB_L1I_entries.get_value(),
@@ -70,21 +82,39 @@ drmemtrace_analysis_tool_create()
                                     op_warmup_refs.get_value(),
                                     op_sim_refs.get_value(),
                                     op_verbose.get_value());
-    } else if (op_simulator_type.get_value() == HISTOGRAM) {
+    } else if (simulator_type == CACHE_SWEEP) {
+        return cache_sweep_create(op_num_cores.get_value(),
+                                  op_line_size.get_value(),
+                                  op_L1I_size.get_value(),
+                                  op_L1D_size.get_value(),
+                                  op_L1I_assoc.get_value(),
+                                  op_L1D_assoc.get_value(),
+                                  op_sweep_cache.get_value(),
+                                  op_sweep_sizes.get_value(),
+                                  op_sweep_assocs.get_value(),
+                                  op_skip_refs.get_value(),
+                                  op_warmup_refs.get_value(),
+                                  op_sim_refs.get_value(),
+                                  op_verbose.get_value());
+    } else if (simulator_type == HISTOGRAM) {
         return histogram_tool_create(op_line_size.get_value(),
                                      op_report_top.get_value(),
                                      op_verbose.get_value());
-    } else if (op_simulator_type.get_value() == REUSE_DIST) {
+    } else if (simulator_type == REUSE_DIST) {
         return reuse_distance_tool_create(op_line_size.get_value(),
                                           op_reuse_distance_histogram.get_value(),
                                           op_reuse_distance_threshold.get_value(),
                                           op_report_top.get_value(),
                                           op_reuse_skip_dist.get_value(),
                                           op_reuse_verify_skip.get_value(),
-                                          op_verbose.get_value());
+                                          op_verbose.get_value(),
+                                          op_reuse_fenwick.get_value(),
+                                          op_reuse_sample_period.get_value(),
+                                          op_reuse_sample_max_lines.get_value(),
+                                          op_reuse_miss_ratio_curve.get_value());
     } else {
         ERRMSG("Usage error: unsupported analyzer type. "
-               "Please choose " CPU_CACHE ", " TLB ", "
+               "Please choose " CPU_CACHE ", " TLB ", " CACHE_SWEEP ", "
                HISTOGRAM ", or " REUSE_DIST ".\n");
         return NULL;
     }
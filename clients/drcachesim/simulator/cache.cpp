@@ -71,10 +71,10 @@ cache_t::flush(const memref_t &memref)
     for (; tag <= final_tag; ++tag) {
         int block_idx = compute_block_idx(tag);
         for (int way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                get_caching_device_block(block_idx, way).tag = TAG_INVALID;
-                // Xref cache_block_t constructor about why we set counter to 0.
-                get_caching_device_block(block_idx, way).counter = 0;
+            if (get_tag(block_idx, way) == tag) {
+                get_tag(block_idx, way) = TAG_INVALID;
+                // Xref caching_device_t::counters about why we set counter to 0.
+                get_counter(block_idx, way) = 0;
             }
         }
     }
@@ -33,18 +33,15 @@
 #include "cache_fifo.h"
 
 // For the FIFO/Round-Robin implementation, all the cache blocks in a set are organized
-// as a FIFO. The counters of a set of blocks simulate the replacement pointer.
-// The counter of the victim block is 1, and others are 0.
-// While replacing happens, the victim block will be replaced and its counter will
-// be cleared. The counter of the next block will be set to 1.
+// as a FIFO.  Each set has a replacement pointer to its victim block, which advances
+// to the next block whenever a replacement happens.
+// The pointer is kept apart from the blocks' counters so that a flush, which clears
+// the counter of each flushed block, cannot lose it.
 
 bool
 cache_fifo_t::init(int associativity_, int block_size_, int total_size,
                    caching_device_t *parent_, caching_device_stats_t *stats_)
 {
-    // Works in the same way as the base class,
-    // except that the counters are initialized in a different way.
-
     bool ret_val = cache_t::init(associativity_, block_size_, total_size,
                                  parent_, stats_);
     if (ret_val == false)
@@ -52,9 +49,7 @@ cache_fifo_t::init(int associativity_, int block_size_, int total_size,
 
     // Create a replacement pointer for each set, and
     // initialize it to point to the first block.
-    for (int i = 0; i < blocks_per_set; i++) {
-        get_caching_device_block(i << assoc_bits, 0).counter = 1;
-    }
+    victim.assign(blocks_per_set, 0);
     return true;
 }
 
@@ -69,15 +64,9 @@ cache_fifo_t::access_update(int block_idx, int way)
 int
 cache_fifo_t::replace_which_way(int block_idx)
 {
-    // We replace the block whose counter is 1.
-    for (int i = 0; i < associativity; i++) {
-        if (get_caching_device_block(block_idx, i).counter == 1) {
-            // clear the counter of the victim block
-            get_caching_device_block(block_idx, i).counter = 0;
-            // set the next block as victim
-            get_caching_device_block(block_idx, (i + 1) & (associativity - 1)).counter = 1;
-            return i;
-        }
-    }
-    return -1;
+    // We replace the block the pointer is at, and set the next block as victim.
+    int set = block_idx >> assoc_bits;
+    int way = victim[set];
+    victim[set] = (way + 1) & (associativity - 1);
+    return way;
 }
@@ -37,6 +37,7 @@
 #define _CACHE_FIFO_H_ 1
 
 #include "cache.h"
+#include <vector>
 
 class cache_fifo_t : public cache_t
 {
@@ -47,6 +48,9 @@ class cache_fifo_t : public cache_t
  protected:
     virtual void access_update(int line_idx, int way);
     virtual int replace_which_way(int line_idx);
+
+    // The replacement pointer of each set: the way to replace next.
+    std::vector<int> victim;
 };
 
 #endif /* _CACHE_FIFO_H_ */
@@ -32,44 +32,59 @@
 
 #include "cache_lru.h"
 
-// For LRU implementation, we use the cache line counter to represent
-// how recently a cache line is accessed.
-// The count value 0 means the most recent access, and the cache line with the
-// highest counter value will be picked for replacement in replace_which_way.
+// For LRU implementation, each set's ways form a recency list: the head
+// (mru) is the most recent access and the tail (lru) is picked for
+// replacement in replace_which_way.  An access moves its way to the head.
+
+bool
+cache_lru_t::init(int associativity_, int line_size_, int total_size,
+                  caching_device_t *parent_, caching_device_stats_t *stats_)
+{
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_))
+        return false;
+    prev.resize(num_blocks);
+    next.resize(num_blocks);
+    mru.assign(blocks_per_set, 0);
+    lru.assign(blocks_per_set, associativity - 1);
+    // Any initial order will do: invalid ways are replaced first, so every
+    // way has been accessed by the time the list order matters.
+    for (int i = 0; i < num_blocks; i++) {
+        int way = i & (associativity - 1);
+        prev[i] = way - 1;
+        next[i] = way + 1;
+    }
+    return true;
+}
 
 void
 cache_lru_t::access_update(int line_idx, int way)
 {
-    int cnt = get_caching_device_block(line_idx, way).counter;
+    int set = line_idx >> assoc_bits;
+    int head = mru[set];
     // Optimization: return early if it is a repeated access.
-    if (cnt == 0)
+    if (head == way)
         return;
-    // We inc all the counters that are not larger than cnt for LRU.
-    for (int i = 0; i < associativity; ++i) {
-        if (i != way && get_caching_device_block(line_idx, i).counter <= cnt)
-            get_caching_device_block(line_idx, i).counter++;
-    }
-    // Clear the counter for LRU.
-    get_caching_device_block(line_idx, way).counter = 0;
+    // Unlink way: it is not the head so it has a predecessor.
+    int before = prev[line_idx + way];
+    int after = next[line_idx + way];
+    next[line_idx + before] = after;
+    if (way == lru[set])
+        lru[set] = before;
+    else
+        prev[line_idx + after] = before;
+    // Make it the head.
+    next[line_idx + way] = head;
+    prev[line_idx + head] = way;
+    mru[set] = way;
 }
 
 int
 cache_lru_t::replace_which_way(int line_idx)
 {
-    // We implement LRU by picking the slot with the largest counter value.
-    int max_counter = 0;
-    int max_way = 0;
-    for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(line_idx, way).tag == TAG_INVALID) {
-            max_way = way;
-            break;
-        }
-        if (get_caching_device_block(line_idx, way).counter > max_counter) {
-            max_counter = get_caching_device_block(line_idx, way).counter;
-            max_way = way;
-        }
-    }
-    // Set to non-zero for later access_update optimization on repeated access
-    get_caching_device_block(line_idx, max_way).counter = 1;
-    return max_way;
+    // We implement LRU by picking the tail of the list, unless there is an
+    // invalid slot.  The access_update() that follows moves it to the head.
+    int way = find_way(line_idx, TAG_INVALID);
+    if (way == associativity)
+        way = lru[line_idx >> assoc_bits];
+    return way;
 }
@@ -37,12 +37,25 @@
 #define _CACHE_LRU_H_ 1
 
 #include "cache.h"
+#include <vector>
 
 class cache_lru_t : public cache_t
 {
+ public:
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats);
+
  protected:
     virtual void access_update(int line_idx, int way);
     virtual int replace_which_way(int line_idx);
+
+    // Each set keeps its ways in a doubly-linked list in recency order, so
+    // both an update and picking a victim take constant time.  prev and next
+    // are indexed by line_idx + way and hold ways; mru and lru are per set.
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<int> mru;
+    std::vector<int> lru;
 };
 
 #endif /* _CACHE_LRU_H_ */
@@ -0,0 +1,81 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include "cache_plru.h"
+#include "../common/utils.h"
+
+// For the tree pseudo-LRU implementation, the ways of a set are the leaves of
+// a binary tree whose associativity - 1 internal nodes each hold one bit.
+// Node n has children 2n and 2n + 1, with the root at 1, so the leaf of way w
+// is node associativity + w and bit n of the set's word is node n's bit.
+// A bit of 0 points to the left subtree and 1 to the right one: an access
+// points every node on its path away from itself, and replace_which_way
+// follows the bits from the root to the victim.  Both take log2(associativity)
+// steps.
+
+bool
+cache_plru_t::init(int associativity_, int line_size_, int total_size,
+                   caching_device_t *parent_, caching_device_stats_t *stats_)
+{
+    if (associativity_ > 64) {
+        ERRMSG("Usage error: PLRU supports an associativity of at most 64.\n");
+        return false;
+    }
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_))
+        return false;
+    trees.assign(blocks_per_set, 0);
+    return true;
+}
+
+void
+cache_plru_t::access_update(int line_idx, int way)
+{
+    uint64_t &tree = trees[line_idx >> assoc_bits];
+    int node = 1;
+    for (int level = assoc_bits - 1; level >= 0; --level) {
+        uint64_t dir = (way >> level) & 1;
+        tree = (tree & ~((uint64_t)1 << node)) | ((dir ^ 1) << node);
+        node = 2 * node + (int)dir;
+    }
+}
+
+int
+cache_plru_t::replace_which_way(int line_idx)
+{
+    int way = find_way(line_idx, TAG_INVALID);
+    if (way < associativity)
+        return way;
+    uint64_t tree = trees[line_idx >> assoc_bits];
+    int node = 1;
+    for (int level = 0; level < assoc_bits; ++level)
+        node = 2 * node + (int)((tree >> node) & 1);
+    return node - associativity;
+}
@@ -0,0 +1,143 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include "cache_rrip.h"
+#include "../common/utils.h"
+
+// This implements static and bimodal RRIP as described in "High Performance
+// Cache Replacement Using Re-Reference Interval Prediction (RRIP)" by Jaleel
+// et al., ISCA 2010, with 2-bit prediction values.  A hit predicts a
+// near-immediate re-reference (RRPV 0); the victim is the first way predicted
+// to be re-referenced in the distant future (RRPV 3), aging the whole set
+// until there is one.  SRRIP inserts with a long interval (RRPV 2); BRRIP
+// inserts with a distant one except for one fill in BRRIP_THROTTLE, which
+// keeps thrashing working sets from flushing the cache.
+// The bit-plane representation lets aging and the victim search handle every
+// way of a set at once.
+
+static const int RRPV_LONG = 2;
+static const int RRPV_DISTANT = 3;
+// The BRRIP probability of a long-interval insertion is 1/BRRIP_THROTTLE.
+// We use every BRRIP_THROTTLE-th fill of each set rather than a random one so
+// runs are reproducible, including across -cache_shards values.
+static const unsigned int BRRIP_THROTTLE = 32;
+
+// Returns the index of the lowest set bit of the non-zero x.
+static inline int
+lowest_set_bit(uint64_t x)
+{
+    // A de Bruijn sequence multiply, which is portable and branch-free.
+    static const int index[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+    };
+    return index[((x & (~x + 1)) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+cache_rrip_t::cache_rrip_t(bool bimodal_) :
+    bimodal(bimodal_), ways_mask(0), filled_block(-1)
+{
+}
+
+bool
+cache_rrip_t::init(int associativity_, int line_size_, int total_size,
+                   caching_device_t *parent_, caching_device_stats_t *stats_)
+{
+    if (associativity_ > 64) {
+        ERRMSG("Usage error: RRIP supports an associativity of at most 64.\n");
+        return false;
+    }
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_))
+        return false;
+    ways_mask = (associativity == 64) ? ~(uint64_t)0 :
+        (((uint64_t)1 << associativity) - 1);
+    // Every way starts out distant: these are only read once the set is full.
+    rrpv_lo.assign(blocks_per_set, ways_mask);
+    rrpv_hi.assign(blocks_per_set, ways_mask);
+    fill_count.assign(blocks_per_set, 0);
+    return true;
+}
+
+void
+cache_rrip_t::set_rrpv(int set, int way, int rrpv)
+{
+    uint64_t bit = (uint64_t)1 << way;
+    rrpv_lo[set] = (rrpv_lo[set] & ~bit) | ((rrpv & 1) != 0 ? bit : 0);
+    rrpv_hi[set] = (rrpv_hi[set] & ~bit) | ((rrpv & 2) != 0 ? bit : 0);
+}
+
+void
+cache_rrip_t::access_update(int line_idx, int way)
+{
+    if (line_idx + way == filled_block) {
+        filled_block = -1;
+        return;
+    }
+    set_rrpv(line_idx >> assoc_bits, way, 0);
+}
+
+int
+cache_rrip_t::replace_which_way(int line_idx)
+{
+    int set = line_idx >> assoc_bits;
+    int way = find_way(line_idx, TAG_INVALID);
+    if (way == associativity) {
+        uint64_t lo = rrpv_lo[set];
+        uint64_t hi = rrpv_hi[set];
+        if ((lo & hi) == 0) {
+            // No way is distant: age them all by the distance of the oldest,
+            // which keeps their order and makes the oldest ones distant.
+            if (hi != 0) {
+                // The oldest is 2: add 1.
+                hi ^= lo;
+                lo = ~lo & ways_mask;
+            } else if (lo != 0) {
+                // The oldest is 1: add 2.
+                hi = ways_mask;
+            } else {
+                // All are 0: add 3.
+                lo = ways_mask;
+                hi = ways_mask;
+            }
+            rrpv_lo[set] = lo;
+            rrpv_hi[set] = hi;
+        }
+        way = lowest_set_bit(lo & hi);
+    }
+    if (bimodal && (++fill_count[set] % BRRIP_THROTTLE) != 0)
+        set_rrpv(set, way, RRPV_DISTANT);
+    else
+        set_rrpv(set, way, RRPV_LONG);
+    filled_block = line_idx + way;
+    return way;
+}
@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* cache_rrip: represents a single hardware cache with re-reference interval
+ * prediction (RRIP) algo.
+ */
+
+#ifndef _CACHE_RRIP_H_
+#define _CACHE_RRIP_H_ 1
+
+#include "cache.h"
+#include <stdint.h>
+#include <vector>
+
+class cache_rrip_t : public cache_t
+{
+ public:
+    // With bimodal set, this is BRRIP, which inserts most lines with a distant
+    // re-reference prediction; otherwise it is SRRIP.
+    explicit cache_rrip_t(bool bimodal = false);
+    // The state of a set is packed into 64 bits per bit of the prediction
+    // value, which limits the associativity to 64.
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats);
+
+ protected:
+    virtual void access_update(int line_idx, int way);
+    virtual int replace_which_way(int line_idx);
+
+    void set_rrpv(int set, int way, int rrpv);
+
+    bool bimodal;
+    // The 2-bit re-reference prediction value (RRPV) of each way, as two bit
+    // planes per set: bit w of rrpv_lo and of rrpv_hi is way w's low and high bit.
+    std::vector<uint64_t> rrpv_lo;
+    std::vector<uint64_t> rrpv_hi;
+    // Has a bit set for every way.
+    uint64_t ways_mask;
+    // The block filled by the last replace_which_way(), whose following
+    // access_update() must keep the insertion RRPV.
+    int filled_block;
+    // Counts the BRRIP insertions into each set to pick the infrequent
+    // long-interval one.  Keeping this per set makes a set's behavior depend
+    // only on its own accesses, which a sharded simulation relies on.
+    std::vector<unsigned int> fill_count;
+};
+
+#endif /* _CACHE_RRIP_H_ */
@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "cache_shard.h"
+#include "cache_stats.h"
+
+cache_shard_t::cache_shard_t(int num_cores_, cache_t **icaches_, cache_t **dcaches_,
+                             cache_t *llcache_) :
+    num_cores(num_cores_), icaches(icaches_), dcaches(dcaches_), llcache(llcache_),
+    queue(queue_depth)
+{
+}
+
+cache_shard_t::~cache_shard_t()
+{
+    delete llcache->get_stats();
+    delete llcache;
+    for (int i = 0; i < num_cores; i++) {
+        delete icaches[i]->get_stats();
+        delete icaches[i];
+        delete dcaches[i]->get_stats();
+        delete dcaches[i];
+    }
+    delete [] icaches;
+    delete [] dcaches;
+}
+
+void
+cache_shard_t::start()
+{
+    thread = std::thread(&cache_shard_t::process_batches, this);
+}
+
+void
+cache_shard_t::finish()
+{
+    // A NULL batch tells the thread to exit.
+    queue.push(NULL);
+    thread.join();
+}
+
+void
+cache_shard_t::process_batches()
+{
+    for (cache_shard_batch_t *batch = queue.pop(); batch != NULL; batch = queue.pop()) {
+        for (size_t i = 0; i < batch->size(); ++i) {
+            const cache_shard_request_t &req = (*batch)[i];
+            switch (req.op) {
+            case CACHE_SHARD_ICACHE:
+                icaches[req.core]->request(req.memref);
+                break;
+            case CACHE_SHARD_DCACHE:
+                dcaches[req.core]->request(req.memref);
+                break;
+            case CACHE_SHARD_IFLUSH:
+                icaches[req.core]->flush(req.memref);
+                break;
+            case CACHE_SHARD_DFLUSH:
+                dcaches[req.core]->flush(req.memref);
+                break;
+            case CACHE_SHARD_RESET:
+                for (int j = 0; j < num_cores; j++) {
+                    icaches[j]->get_stats()->reset();
+                    dcaches[j]->get_stats()->reset();
+                }
+                llcache->get_stats()->reset();
+                break;
+            }
+        }
+        delete batch;
+    }
+}
@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_shard: one set-index partition of a sharded cache simulation.
+ */
+
+#ifndef _CACHE_SHARD_H_
+#define _CACHE_SHARD_H_ 1
+
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "../common/bounded_queue.h"
+#include "../common/memref.h"
+
+// What a shard should do with a request.
+enum cache_shard_op_t {
+    CACHE_SHARD_ICACHE,
+    CACHE_SHARD_DCACHE,
+    CACHE_SHARD_IFLUSH,
+    CACHE_SHARD_DFLUSH,
+    // Resets all stats, at the end of the warmup references.
+    CACHE_SHARD_RESET,
+};
+
+struct cache_shard_request_t {
+    memref_t memref;
+    int core;
+    cache_shard_op_t op;
+};
+
+typedef std::vector<cache_shard_request_t> cache_shard_batch_t;
+
+// A shard owns a complete cache hierarchy (an L1I and L1D per core plus the
+// LL) restricted to the sets whose low set index bits equal the shard index.
+// As set-associative caches never move a line between sets, the shards share
+// no state and each one runs on its own thread.
+// The cache_simulator_t feeds requests in trace order, each touching a single
+// line, so each shard sees exactly the sequence of accesses the serial
+// simulator performs on its sets.
+class cache_shard_t
+{
+ public:
+    // The shard takes ownership of the caches and their stats.
+    cache_shard_t(int num_cores, cache_t **icaches, cache_t **dcaches,
+                  cache_t *llcache);
+    ~cache_shard_t();
+
+    void start();
+    // The shard thread takes ownership of the batch.
+    void push(cache_shard_batch_t *batch) { queue.push(batch); }
+    // Waits for all pushed batches to be processed.
+    void finish();
+
+    cache_t *get_icache(int core) const { return icaches[core]; }
+    cache_t *get_dcache(int core) const { return dcaches[core]; }
+    cache_t *get_llcache() const { return llcache; }
+
+ private:
+    void process_batches();
+
+    int num_cores;
+    cache_t **icaches;
+    cache_t **dcaches;
+    cache_t *llcache;
+
+    static const int queue_depth = 64;
+    bounded_queue_t<cache_shard_batch_t *> queue;
+    std::thread thread;
+};
+
+#endif /* _CACHE_SHARD_H_ */
@@ -45,6 +45,8 @@
 #include "cache.h"
 #include "cache_lru.h"
 #include "cache_fifo.h"
+#include "cache_plru.h"
+#include "cache_rrip.h"
 #include "cache_simulator.h"
 #include "droption.h"
 
@@ -68,12 +70,13 @@ cache_simulator_create(unsigned int num_cores,
                        uint64_t skip_refs,
                        uint64_t warmup_refs,
                        uint64_t sim_refs,
-                       unsigned int verbose)
+                       unsigned int verbose,
+                       unsigned int num_shards)
 {
     return new cache_simulator_t(num_cores, line_size, L1I_size, L1D_size,
                                  L1I_assoc, L1D_assoc, LL_size, LL_assoc,
                                  replace_policy, skip_refs,warmup_refs,
-                                 sim_refs, verbose);
+                                 sim_refs, verbose, num_shards);
 }
 
 cache_simulator_t::cache_simulator_t(unsigned int num_cores,
@@ -88,7 +91,8 @@ cache_simulator_t::cache_simulator_t(unsigned int num_cores,
                                      uint64_t skip_refs,
                                      uint64_t warmup_refs,
                                      uint64_t sim_refs,
-                                     unsigned int verbose) :
+                                     unsigned int verbose,
+                                     unsigned int num_shards) :
     simulator_t(num_cores, skip_refs,warmup_refs, sim_refs, verbose),
     knob_line_size(line_size),
     knob_L1I_size(L1I_size),
@@ -97,7 +101,10 @@ cache_simulator_t::cache_simulator_t(unsigned int num_cores,
     knob_L1D_assoc(L1D_assoc),
     knob_LL_size(LL_size),
     knob_LL_assoc(LL_assoc),
-    knob_replace_policy(replace_policy)
+    knob_replace_policy(replace_policy),
+    knob_num_shards(num_shards),
+    shards(NULL),
+    shard_batches(NULL)
 {
     // XXX i#1703: get defaults from hardware being run on.
 
@@ -146,10 +153,127 @@ cache_simulator_t::cache_simulator_t(unsigned int num_cores,
     memset(thread_counts, 0, sizeof(thread_counts[0])*knob_num_cores);
     thread_ever_counts = new unsigned int[knob_num_cores];
     memset(thread_ever_counts, 0, sizeof(thread_ever_counts[0])*knob_num_cores);
+
+    if (knob_num_shards > 1 && !create_shards()) {
+        success = false;
+        return;
+    }
+}
+
+bool
+cache_simulator_t::create_shards()
+{
+    uint64_t min_sets = knob_LL_size / knob_line_size / knob_LL_assoc;
+    if (knob_L1I_size / knob_line_size / knob_L1I_assoc < min_sets)
+        min_sets = knob_L1I_size / knob_line_size / knob_L1I_assoc;
+    if (knob_L1D_size / knob_line_size / knob_L1D_assoc < min_sets)
+        min_sets = knob_L1D_size / knob_line_size / knob_L1D_assoc;
+    if (!IS_POWER_OF_2(knob_num_shards) || knob_num_shards > min_sets) {
+        ERRMSG("Usage error: the number of cache shards must be a power of 2 "
+               "no larger than the number of sets in any cache.\n");
+        return false;
+    }
+    int shard_bits = compute_log2((int)knob_num_shards);
+    line_size_bits = compute_log2((int)knob_line_size);
+
+    shards = new cache_shard_t* [knob_num_shards];
+    shard_batches = new cache_shard_batch_t* [knob_num_shards];
+    for (unsigned int s = 0; s < knob_num_shards; s++) {
+        cache_t *shard_ll = create_cache(knob_replace_policy);
+        cache_t **shard_i = new cache_t* [knob_num_cores];
+        cache_t **shard_d = new cache_t* [knob_num_cores];
+        // The sizes were validated above for the serial caches.
+        shard_ll->init(knob_LL_assoc, (int)knob_line_size,
+                       (int)(knob_LL_size / knob_num_shards), NULL, new cache_stats_t);
+        shard_ll->set_shard_bits(shard_bits);
+        for (int i = 0; i < knob_num_cores; i++) {
+            shard_i[i] = create_cache(knob_replace_policy);
+            shard_i[i]->init(knob_L1I_assoc, (int)knob_line_size,
+                             (int)(knob_L1I_size / knob_num_shards), shard_ll,
+                             new cache_stats_t);
+            shard_i[i]->set_shard_bits(shard_bits);
+            shard_d[i] = create_cache(knob_replace_policy);
+            shard_d[i]->init(knob_L1D_assoc, (int)knob_line_size,
+                             (int)(knob_L1D_size / knob_num_shards), shard_ll,
+                             new cache_stats_t);
+            shard_d[i]->set_shard_bits(shard_bits);
+        }
+        shards[s] = new cache_shard_t(knob_num_cores, shard_i, shard_d, shard_ll);
+        shards[s]->start();
+        shard_batches[s] = new cache_shard_batch_t;
+        shard_batches[s]->reserve(shard_batch_size);
+    }
+    return true;
+}
+
+void
+cache_simulator_t::shard_push(int shard, cache_shard_op_t op, int core,
+                              const memref_t &memref)
+{
+    cache_shard_request_t req;
+    req.memref = memref;
+    req.core = core;
+    req.op = op;
+    shard_batches[shard]->push_back(req);
+    if (shard_batches[shard]->size() == shard_batch_size) {
+        shards[shard]->push(shard_batches[shard]);
+        shard_batches[shard] = new cache_shard_batch_t;
+        shard_batches[shard]->reserve(shard_batch_size);
+    }
+}
+
+void
+cache_simulator_t::shard_request(cache_shard_op_t op, int core, const memref_t &memref)
+{
+    // We split a multi-line reference just like caching_device_t::request()
+    // does, as its lines may belong to different shards.
+    addr_t final_addr = memref.data.addr + memref.data.size - 1/*avoid overflow*/;
+    addr_t final_tag = final_addr >> line_size_bits;
+    addr_t tag = memref.data.addr >> line_size_bits;
+    memref_t piece = memref;
+    for (; tag <= final_tag; ++tag) {
+        if (tag + 1 <= final_tag)
+            piece.data.size = ((tag + 1) << line_size_bits) - piece.data.addr;
+        shard_push((int)(tag & (knob_num_shards - 1)), op, core, piece);
+        if (tag + 1 <= final_tag) {
+            addr_t next_addr = (tag + 1) << line_size_bits;
+            piece.data.addr = next_addr;
+            piece.data.size = final_addr - next_addr + 1/*undo the -1*/;
+        }
+    }
+}
+
+void
+cache_simulator_t::shard_broadcast(cache_shard_op_t op, int core,
+                                   const memref_t &memref)
+{
+    for (unsigned int s = 0; s < knob_num_shards; s++)
+        shard_push(s, op, core, memref);
+}
+
+void
+cache_simulator_t::finish_shards()
+{
+    if (shards == NULL)
+        return;
+    for (unsigned int s = 0; s < knob_num_shards; s++) {
+        shards[s]->push(shard_batches[s]);
+        shards[s]->finish();
+        for (int i = 0; i < knob_num_cores; i++) {
+            icaches[i]->get_stats()->merge(*shards[s]->get_icache(i)->get_stats());
+            dcaches[i]->get_stats()->merge(*shards[s]->get_dcache(i)->get_stats());
+        }
+        llcache->get_stats()->merge(*shards[s]->get_llcache()->get_stats());
+        delete shards[s];
+    }
+    delete [] shards;
+    delete [] shard_batches;
+    shards = NULL;
 }
 
 cache_simulator_t::~cache_simulator_t()
 {
+    finish_shards();
     if (llcache == NULL)
         return;
     delete llcache->get_stats();
@@ -198,19 +322,31 @@ cache_simulator_t::process_memref(const memref_t &memref)
     }
 
     if (type_is_instr(memref.instr.type) ||
-        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR)
-        icaches[core]->request(memref);
-    else if (memref.data.type == TRACE_TYPE_READ ||
-             memref.data.type == TRACE_TYPE_WRITE ||
-             // We may potentially handle prefetches differently.
-             // TRACE_TYPE_PREFETCH_INSTR is handled above.
-             type_is_prefetch(memref.data.type))
-        dcaches[core]->request(memref);
-    else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH)
-        icaches[core]->flush(memref);
-    else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH)
-        dcaches[core]->flush(memref);
-    else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
+        if (shards != NULL)
+            shard_request(CACHE_SHARD_ICACHE, core, memref);
+        else
+            icaches[core]->request(memref);
+    } else if (memref.data.type == TRACE_TYPE_READ ||
+               memref.data.type == TRACE_TYPE_WRITE ||
+               // We may potentially handle prefetches differently.
+               // TRACE_TYPE_PREFETCH_INSTR is handled above.
+               type_is_prefetch(memref.data.type)) {
+        if (shards != NULL)
+            shard_request(CACHE_SHARD_DCACHE, core, memref);
+        else
+            dcaches[core]->request(memref);
+    } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH) {
+        if (shards != NULL)
+            shard_broadcast(CACHE_SHARD_IFLUSH, core, memref);
+        else
+            icaches[core]->flush(memref);
+    } else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
+        if (shards != NULL)
+            shard_broadcast(CACHE_SHARD_DFLUSH, core, memref);
+        else
+            dcaches[core]->flush(memref);
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
         handle_thread_exit(memref.exit.tid);
         last_thread = 0;
     } else {
@@ -229,7 +365,9 @@ cache_simulator_t::process_memref(const memref_t &memref)
     if (knob_warmup_refs > 0) { // warm caches up
         knob_warmup_refs--;
         // reset cache stats when warming up is completed
-        if (knob_warmup_refs == 0) {
+        if (knob_warmup_refs == 0 && shards != NULL)
+            shard_broadcast(CACHE_SHARD_RESET, 0, memref);
+        else if (knob_warmup_refs == 0) {
             for (int i = 0; i < knob_num_cores; i++) {
                 icaches[i]->get_stats()->reset();
                 dcaches[i]->get_stats()->reset();
@@ -243,9 +381,20 @@ cache_simulator_t::process_memref(const memref_t &memref)
     return true;
 }
 
+bool
+cache_simulator_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // The qualified call is not virtual and can be inlined into this loop.
+    bool res = true;
+    for (size_t i = 0; i < count; ++i)
+        res = cache_simulator_t::process_memref(memrefs[i]) && res;
+    return res;
+}
+
 bool
 cache_simulator_t::print_results()
 {
+    finish_shards();
     std::cerr << "Cache simulation results:\n";
     for (int i = 0; i < knob_num_cores; i++) {
         unsigned int threads = thread_ever_counts[i];
@@ -272,9 +421,17 @@ cache_simulator_t::create_cache(std::string policy)
         return new cache_t;
     if (policy == REPLACE_POLICY_FIFO) // set to FIFO
         return new cache_fifo_t;
+    if (policy == REPLACE_POLICY_PLRU) // set to tree pseudo-LRU
+        return new cache_plru_t;
+    if (policy == REPLACE_POLICY_SRRIP) // set to static RRIP
+        return new cache_rrip_t;
+    if (policy == REPLACE_POLICY_BRRIP) // set to bimodal RRIP
+        return new cache_rrip_t(true/*bimodal*/);
 
     // undefined replacement policy
     ERRMSG("Usage error: undefined replacement policy. "
-           "Please choose " REPLACE_POLICY_LRU" or " REPLACE_POLICY_LFU".\n");
+           "Please choose " REPLACE_POLICY_LRU", " REPLACE_POLICY_LFU", "
+           REPLACE_POLICY_FIFO", " REPLACE_POLICY_PLRU", " REPLACE_POLICY_SRRIP
+           ", or " REPLACE_POLICY_BRRIP".\n");
     return NULL;
 }
@@ -40,6 +40,7 @@
 #include "simulator.h"
 #include "cache_stats.h"
 #include "cache.h"
+#include "cache_shard.h"
 
 class cache_simulator_t : public simulator_t
 {
@@ -56,9 +57,11 @@ class cache_simulator_t : public simulator_t
                       uint64_t skip_refs,
                       uint64_t warmup_refs,
                       uint64_t sim_refs,
-                      unsigned int verbose);
+                      unsigned int verbose,
+                      unsigned int num_shards = 1);
     virtual ~cache_simulator_t();
     virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
     virtual bool print_results();
 
  protected:
@@ -84,6 +87,23 @@ class cache_simulator_t : public simulator_t
 
     cache_t *llcache;
 
+    // Sharded simulation: with more than one shard, the caches above only
+    // accumulate the merged stats, while the references are routed to
+    // cache_shard_t threads by the low bits of their line address.
+    // Every level shares the line size, and there are no more shards than
+    // sets in any cache, so each set lives in exactly one shard and the
+    // results are identical to the serial simulation.
+    bool create_shards();
+    void shard_request(cache_shard_op_t op, int core, const memref_t &memref);
+    void shard_broadcast(cache_shard_op_t op, int core, const memref_t &memref);
+    void shard_push(int shard, cache_shard_op_t op, int core, const memref_t &memref);
+    void finish_shards();
+
+    unsigned int knob_num_shards;
+    int line_size_bits;
+    cache_shard_t **shards;
+    cache_shard_batch_t **shard_batches;
+    static const size_t shard_batch_size = 4096;
 };
 
 #endif /* _CACHE_SIMULATOR_H_ */
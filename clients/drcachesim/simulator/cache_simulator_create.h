@@ -52,6 +52,7 @@ cache_simulator_create(unsigned int num_cores = 4,
                        uint64_t skip_refs = 0,
                        uint64_t warmup_refs = 0,
                        uint64_t sim_refs = 1ULL << 63,
-                       unsigned int verbose = 0);
+                       unsigned int verbose = 0,
+                       unsigned int num_shards = 1);
 
 #endif /* _CACHE_SIMULATOR_CREATE_H_ */
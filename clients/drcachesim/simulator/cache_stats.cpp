@@ -83,3 +83,15 @@ cache_stats_t::reset()
     num_prefetch_hits = 0;
     num_prefetch_misses = 0;
 }
+
+void
+cache_stats_t::merge(const caching_device_stats_t &other)
+{
+    caching_device_stats_t::merge(other);
+    const cache_stats_t &other_cache = (const cache_stats_t &)other;
+    // Every shard sees every flush, so flushes are not summed.
+    if (other_cache.num_flushes > num_flushes)
+        num_flushes = other_cache.num_flushes;
+    num_prefetch_hits += other_cache.num_prefetch_hits;
+    num_prefetch_misses += other_cache.num_prefetch_misses;
+}
@@ -52,6 +52,8 @@ class cache_stats_t : public caching_device_stats_t
 
     virtual void reset();
 
+    virtual void merge(const caching_device_stats_t &other);
+
  protected:
     // In addition to caching_device_stats_t::print_counts,
     // cache_stats_t::print_counts prints stats for flushes and
@@ -0,0 +1,343 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/memref.h"
+#include "../common/options.h"
+#include "../common/utils.h"
+#include "cache_stats.h"
+#include "cache_lru.h"
+#include "cache_sweep.h"
+
+analysis_tool_t *
+cache_sweep_create(unsigned int num_cores,
+                   unsigned int line_size,
+                   uint64_t L1I_size,
+                   uint64_t L1D_size,
+                   unsigned int L1I_assoc,
+                   unsigned int L1D_assoc,
+                   std::string sweep_cache,
+                   std::string sweep_sizes,
+                   std::string sweep_assocs,
+                   uint64_t skip_refs,
+                   uint64_t warmup_refs,
+                   uint64_t sim_refs,
+                   unsigned int verbose)
+{
+    return new cache_sweep_t(num_cores, line_size, L1I_size, L1D_size,
+                             L1I_assoc, L1D_assoc, sweep_cache, sweep_sizes,
+                             sweep_assocs, skip_refs, warmup_refs, sim_refs, verbose);
+}
+
+// The stats of an L1 cache whose misses go to the swept LL.  This sees exactly
+// the per-line pieces that cache_t::request() would pass to its parent.
+class sweep_feed_stats_t : public cache_stats_t
+{
+ public:
+    explicit sweep_feed_stats_t(lru_sweep_t *sweep_) : sweep(sweep_) {}
+    virtual void access(const memref_t &memref, bool hit)
+    {
+        cache_stats_t::access(memref, hit);
+        if (!hit)
+            sweep->request(memref);
+    }
+    virtual void flush(const memref_t &memref)
+    {
+        cache_stats_t::flush(memref);
+        sweep->flush(memref);
+    }
+ private:
+    lru_sweep_t *sweep;
+};
+
+cache_sweep_t::cache_sweep_t(unsigned int num_cores,
+                             unsigned int line_size,
+                             uint64_t L1I_size,
+                             uint64_t L1D_size,
+                             unsigned int L1I_assoc,
+                             unsigned int L1D_assoc,
+                             std::string sweep_cache,
+                             std::string sweep_sizes,
+                             std::string sweep_assocs,
+                             uint64_t skip_refs,
+                             uint64_t warmup_refs,
+                             uint64_t sim_refs,
+                             unsigned int verbose) :
+    simulator_t(num_cores, skip_refs, warmup_refs, sim_refs, verbose),
+    knob_line_size(line_size),
+    knob_L1I_size(L1I_size),
+    knob_L1D_size(L1D_size),
+    knob_L1I_assoc(L1I_assoc),
+    knob_L1D_assoc(L1D_assoc),
+    knob_sweep_cache(sweep_cache),
+    icaches(NULL),
+    dcaches(NULL),
+    sweeps(NULL),
+    num_sweeps(0)
+{
+    thread_counts = new unsigned int[knob_num_cores];
+    memset(thread_counts, 0, sizeof(thread_counts[0])*knob_num_cores);
+    thread_ever_counts = new unsigned int[knob_num_cores];
+    memset(thread_ever_counts, 0, sizeof(thread_ever_counts[0])*knob_num_cores);
+
+    if (knob_sweep_cache == "LL")
+        sweep_ll = true;
+    else if (knob_sweep_cache == "L1D")
+        sweep_ll = false;
+    else {
+        ERRMSG("Usage error: the swept cache must be LL or L1D.\n");
+        success = false;
+        return;
+    }
+
+    std::vector<lru_sweep_config_t> configs;
+    if (!parse_configs(sweep_sizes, sweep_assocs, &configs)) {
+        success = false;
+        return;
+    }
+    num_sweeps = sweep_ll ? 1 : knob_num_cores;
+    sweeps = new lru_sweep_t* [num_sweeps];
+    for (int i = 0; i < num_sweeps; i++) {
+        sweeps[i] = new lru_sweep_t;
+        if (!sweeps[i]->init((int)knob_line_size, configs)) {
+            ERRMSG("Usage error: failed to initialize the swept caches.  Ensure "
+                   "sizes and associativities are powers of 2 "
+                   "and that the total sizes are multiples of the line size.\n");
+            success = false;
+            return;
+        }
+    }
+    if (!sweep_ll)
+        return;
+
+    icaches = new cache_t* [knob_num_cores];
+    dcaches = new cache_t* [knob_num_cores];
+    memset(icaches, 0, sizeof(icaches[0])*knob_num_cores);
+    memset(dcaches, 0, sizeof(dcaches[0])*knob_num_cores);
+    for (int i = 0; i < knob_num_cores; i++) {
+        icaches[i] = new cache_lru_t;
+        dcaches[i] = new cache_lru_t;
+        if (!icaches[i]->init(knob_L1I_assoc, (int)knob_line_size,
+                              (int)knob_L1I_size, NULL,
+                              new sweep_feed_stats_t(sweeps[0])) ||
+            !dcaches[i]->init(knob_L1D_assoc, (int)knob_line_size,
+                              (int)knob_L1D_size, NULL,
+                              new sweep_feed_stats_t(sweeps[0]))) {
+            ERRMSG("Usage error: failed to initialize L1 caches.  Ensure sizes and "
+                   "associativity are powers of 2 "
+                   "and that the total sizes are multiples of the line size.\n");
+            success = false;
+            return;
+        }
+    }
+}
+
+cache_sweep_t::~cache_sweep_t()
+{
+    if (icaches != NULL) {
+        for (int i = 0; i < knob_num_cores; i++) {
+            delete icaches[i]->get_stats();
+            delete icaches[i];
+            delete dcaches[i]->get_stats();
+            delete dcaches[i];
+        }
+        delete [] icaches;
+        delete [] dcaches;
+    }
+    if (sweeps != NULL) {
+        for (int i = 0; i < num_sweeps; i++)
+            delete sweeps[i];
+        delete [] sweeps;
+    }
+    delete [] thread_counts;
+    delete [] thread_ever_counts;
+}
+
+static bool
+parse_size(const std::string &str, uint64_t *size)
+{
+    // Accepts the same suffixes as the bytesize_t options.
+    char *end;
+    uint64_t val = strtoull(str.c_str(), &end, 10);
+    if (end == str.c_str())
+        return false;
+    if (*end == 'K' || *end == 'k') {
+        val *= 1024;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        val *= 1024*1024;
+        ++end;
+    } else if (*end == 'G' || *end == 'g') {
+        val *= 1024*1024*1024;
+        ++end;
+    }
+    if (*end != '\0')
+        return false;
+    *size = val;
+    return true;
+}
+
+bool
+cache_sweep_t::parse_configs(const std::string &sizes, const std::string &assocs,
+                             std::vector<lru_sweep_config_t> *configs)
+{
+    // Every size is swept at every associativity.
+    std::vector<uint64_t> size_list;
+    std::vector<int> assoc_list;
+    std::stringstream size_stream(sizes);
+    std::string item;
+    while (std::getline(size_stream, item, ',')) {
+        uint64_t size;
+        if (!parse_size(item, &size)) {
+            ERRMSG("Usage error: invalid cache size %s in -sweep_sizes.\n",
+                   item.c_str());
+            return false;
+        }
+        size_list.push_back(size);
+    }
+    std::stringstream assoc_stream(assocs);
+    while (std::getline(assoc_stream, item, ',')) {
+        int assoc = atoi(item.c_str());
+        if (assoc <= 0) {
+            ERRMSG("Usage error: invalid associativity %s in -sweep_assocs.\n",
+                   item.c_str());
+            return false;
+        }
+        assoc_list.push_back(assoc);
+    }
+    for (size_t s = 0; s < size_list.size(); s++) {
+        for (size_t a = 0; a < assoc_list.size(); a++) {
+            lru_sweep_config_t config;
+            config.size = size_list[s];
+            config.assoc = assoc_list[a];
+            configs->push_back(config);
+        }
+    }
+    if (configs->empty()) {
+        ERRMSG("Usage error: no cache configurations to sweep.\n");
+        return false;
+    }
+    return true;
+}
+
+bool
+cache_sweep_t::process_memref(const memref_t &memref)
+{
+    if (knob_skip_refs > 0) {
+        knob_skip_refs--;
+        return true;
+    }
+
+    // The references after warmup and simulated ones are dropped.
+    if (knob_warmup_refs == 0 && knob_sim_refs == 0)
+        return true;
+
+    int core;
+    if (memref.data.tid == last_thread)
+        core = last_core;
+    else {
+        core = core_for_thread(memref.data.tid);
+        last_thread = memref.data.tid;
+        last_core = core;
+    }
+
+    // This follows cache_simulator_t::process_memref().
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
+        if (sweep_ll)
+            icaches[core]->request(memref);
+    } else if (memref.data.type == TRACE_TYPE_READ ||
+               memref.data.type == TRACE_TYPE_WRITE ||
+               type_is_prefetch(memref.data.type)) {
+        if (sweep_ll)
+            dcaches[core]->request(memref);
+        else
+            sweeps[core]->request(memref);
+    } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH) {
+        if (sweep_ll)
+            icaches[core]->flush(memref);
+    } else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
+        if (sweep_ll)
+            dcaches[core]->flush(memref);
+        else
+            sweeps[core]->flush(memref);
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        handle_thread_exit(memref.exit.tid);
+        last_thread = 0;
+    } else {
+        ERRMSG("unhandled memref type");
+        return false;
+    }
+
+    if (knob_warmup_refs > 0) {
+        knob_warmup_refs--;
+        if (knob_warmup_refs == 0) {
+            for (int i = 0; i < num_sweeps; i++)
+                sweeps[i]->reset();
+        }
+    }
+    else {
+        knob_sim_refs--;
+    }
+    return true;
+}
+
+bool
+cache_sweep_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // The qualified call is not virtual and can be inlined into this loop.
+    bool res = true;
+    for (size_t i = 0; i < count; ++i)
+        res = cache_sweep_t::process_memref(memrefs[i]) && res;
+    return res;
+}
+
+bool
+cache_sweep_t::print_results()
+{
+    // The per-core L1D sweeps are reported together.
+    for (int i = 1; i < num_sweeps; i++)
+        sweeps[0]->merge(*sweeps[i]);
+    std::cerr << "Cache sweep results:\n";
+    if (sweep_ll) {
+        std::cerr << "LL stats with " << knob_L1I_size << "-byte " << knob_L1I_assoc <<
+            "-way L1I and " << knob_L1D_size << "-byte " << knob_L1D_assoc <<
+            "-way L1D caches:" << std::endl;
+    } else
+        std::cerr << "L1D stats summed over all cores:" << std::endl;
+    sweeps[0]->print_results("    ");
+    return true;
+}
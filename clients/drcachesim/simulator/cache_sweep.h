@@ -0,0 +1,90 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_sweep: simulates a family of LRU caches of different sizes and
+ * associativities at one level of the hierarchy in a single pass.
+ */
+
+#ifndef _CACHE_SWEEP_H_
+#define _CACHE_SWEEP_H_ 1
+
+#include <string>
+#include <vector>
+#include "cache.h"
+#include "lru_sweep.h"
+#include "simulator.h"
+#include "cache_sweep_create.h"
+
+class cache_sweep_t : public simulator_t
+{
+ public:
+    cache_sweep_t(unsigned int num_cores,
+                  unsigned int line_size,
+                  uint64_t L1I_size,
+                  uint64_t L1D_size,
+                  unsigned int L1I_assoc,
+                  unsigned int L1D_assoc,
+                  std::string sweep_cache,
+                  std::string sweep_sizes,
+                  std::string sweep_assocs,
+                  uint64_t skip_refs,
+                  uint64_t warmup_refs,
+                  uint64_t sim_refs,
+                  unsigned int verbose);
+    virtual ~cache_sweep_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
+    virtual bool print_results();
+
+ protected:
+    bool parse_configs(const std::string &sizes, const std::string &assocs,
+                       std::vector<lru_sweep_config_t> *configs);
+
+    // Options for the cache simulator:
+    unsigned int knob_line_size;
+    uint64_t knob_L1I_size;
+    uint64_t knob_L1D_size;
+    unsigned int knob_L1I_assoc;
+    unsigned int knob_L1D_assoc;
+    std::string knob_sweep_cache;
+
+    // When sweeping the LL, the L1 caches are simulated as usual and their
+    // misses are fed to a single sweep shared by all cores.  When sweeping
+    // the L1D, each core has its own sweep and there are no L1 caches.
+    bool sweep_ll;
+    cache_t **icaches;
+    cache_t **dcaches;
+    lru_sweep_t **sweeps;
+    int num_sweeps;
+};
+
+#endif /* _CACHE_SWEEP_H_ */
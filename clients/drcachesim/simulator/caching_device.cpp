@@ -37,7 +37,8 @@
 #include <assert.h>
 
 caching_device_t::caching_device_t() :
-    blocks(NULL), stats(NULL)
+    blocks(NULL), tags(NULL), counters(NULL), set_index_shift(0), stats(NULL),
+    tags_alloc(NULL)
 {
     /* Empty. */
 }
@@ -47,6 +48,8 @@ caching_device_t::~caching_device_t()
     for (int i = 0; i < num_blocks; i++)
         delete blocks[i];
     delete [] blocks;
+    delete [] tags_alloc;
+    delete [] counters;
 }
 
 bool
@@ -76,6 +79,19 @@ caching_device_t::init(int associativity_, int block_size_, int num_blocks_,
     blocks = new caching_device_block_t* [num_blocks];
     init_blocks();
 
+    // Align tags to a cache line: each set of a power-of-2 number of ways then
+    // starts on a boundary as large as the set (up to the line size), which
+    // find_way() relies on for its aligned vector loads.
+    static const int TAG_ALIGN = 64;
+    tags_alloc = new addr_t[num_blocks + TAG_ALIGN / sizeof(addr_t)];
+    tags = (addr_t *)(((uintptr_t)tags_alloc + TAG_ALIGN - 1) &
+                      ~(uintptr_t)(TAG_ALIGN - 1));
+    counters = new int[num_blocks];
+    for (int i = 0; i < num_blocks; i++) {
+        tags[i] = TAG_INVALID;
+        counters[i] = 0;
+    }
+
     last_tag = TAG_INVALID; // sentinel
     return true;
 }
@@ -97,7 +113,7 @@ caching_device_t::request(const memref_t &memref_in)
     if (tag == final_tag && tag == last_tag) {
         // Make sure last_tag is properly in sync.
         assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag);
+               tag == get_tag(last_block_idx, last_way));
         stats->access(memref_in, true/*hit*/);
         if (parent != NULL)
             parent->stats->child_access(memref_in, true);
@@ -113,16 +129,12 @@ caching_device_t::request(const memref_t &memref_in)
         if (tag + 1 <= final_tag)
             memref.data.size = ((tag + 1) << block_size_bits) - memref.data.addr;
 
-        for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                stats->access(memref, true/*hit*/);
-                if (parent != NULL)
-                    parent->stats->child_access(memref, true);
-                break;
-            }
-        }
-
-        if (way == associativity) {
+        way = find_way(block_idx, tag);
+        if (way < associativity) {
+            stats->access(memref, true/*hit*/);
+            if (parent != NULL)
+                parent->stats->child_access(memref, true);
+        } else {
             stats->access(memref, false/*miss*/);
             // If no parent we assume we get the data from main memory
             if (parent != NULL) {
@@ -133,7 +145,7 @@ caching_device_t::request(const memref_t &memref_in)
             // FIXME i#1726: coherence policy
 
             way = replace_which_way(block_idx);
-            get_caching_device_block(block_idx, way).tag = tag;
+            get_tag(block_idx, way) = tag;
         }
 
         access_update(block_idx, way);
@@ -154,7 +166,7 @@ void
 caching_device_t::access_update(int block_idx, int way)
 {
     // We just inc the counter for LFU.  We live with any blip on overflow.
-    get_caching_device_block(block_idx, way).counter++;
+    get_counter(block_idx, way)++;
 }
 
 int
@@ -163,19 +175,19 @@ caching_device_t::replace_which_way(int block_idx)
     // The base caching device class only implements LFU.
     // A subclass can override this and access_update() to implement
     // some other scheme.
-    int min_counter = 0; /* avoid "may be used uninitialized" with GCC 4.4.7 */
-    int min_way = 0;
-    for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(block_idx, way).tag == TAG_INVALID) {
-            min_way = way;
-            break;
-        }
-        if (way == 0 || get_caching_device_block(block_idx, way).counter < min_counter) {
-            min_counter = get_caching_device_block(block_idx, way).counter;
-            min_way = way;
+    // An invalid way is always taken first.
+    int min_way = find_way(block_idx, TAG_INVALID);
+    if (min_way == associativity) {
+        int min_counter = get_counter(block_idx, 0);
+        min_way = 0;
+        for (int way = 1; way < associativity; ++way) {
+            if (get_counter(block_idx, way) < min_counter) {
+                min_counter = get_counter(block_idx, way);
+                min_way = way;
+            }
         }
     }
     // Clear the counter for LFU.
-    get_caching_device_block(block_idx, min_way).counter = 0;
+    get_counter(block_idx, min_way) = 0;
     return min_way;
 }
@@ -39,6 +39,14 @@
 #include "caching_device_block.h"
 #include "caching_device_stats.h"
 #include "../common/memref.h"
+#if defined(X64) && (defined(__SSE2__) || defined(_MSC_VER))
+# include <emmintrin.h>
+# define CACHING_DEVICE_SSE2 1
+#endif
+#if defined(X64) && defined(__AVX2__)
+# include <immintrin.h>
+# define CACHING_DEVICE_AVX2 1
+#endif
 
 // Statistics collection is abstracted out into the caching_device_stats_t class.
 
@@ -60,17 +68,75 @@ class caching_device_t
     caching_device_stats_t *get_stats() const { return stats; }
     caching_device_t *get_parent() const { return parent; }
 
+    // For sharded simulation (see cache_simulator_t), each shard only sees
+    // addresses whose low shard_bits set index bits match the shard, so its
+    // device only needs 1/2^shard_bits of the sets: the caller passes the
+    // reduced size to init() and then calls this to drop those index bits.
+    void set_shard_bits(int shard_bits) { set_index_shift = shard_bits; }
+
  protected:
     virtual void access_update(int block_idx, int way);
     virtual int replace_which_way(int block_idx);
 
     inline addr_t compute_tag(addr_t addr) { return addr >> block_size_bits; }
     inline int compute_block_idx(addr_t tag) {
-        return (tag & blocks_per_set_mask) << assoc_bits;
+        return ((tag >> set_index_shift) & blocks_per_set_mask) << assoc_bits;
     }
     inline caching_device_block_t& get_caching_device_block(int block_idx, int way) {
         return *(blocks[block_idx + way]);
     }
+    inline addr_t& get_tag(int block_idx, int way) {
+        return tags[block_idx + way];
+    }
+    inline int& get_counter(int block_idx, int way) {
+        return counters[block_idx + way];
+    }
+    // Returns the first way at or after start_way in the set at block_idx
+    // holding tag, or associativity if there is none.
+    inline int find_way(int block_idx, addr_t tag, int start_way = 0) {
+        const addr_t *set = tags + block_idx;
+#if defined(CACHING_DEVICE_AVX2)
+        // A set of 4 or more ways starts on a 32-byte boundary (see init()).
+        if (associativity >= 4) {
+            static const int first_way[16] = {
+                4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+            };
+            const __m256i key = _mm256_set1_epi64x((long long)tag);
+            for (int way = start_way & ~3; way < associativity; way += 4) {
+                __m256i eq = _mm256_cmpeq_epi64
+                    (_mm256_load_si256((const __m256i *)(set + way)), key);
+                int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+                if (way < start_way)
+                    mask &= ~0U << (start_way - way);
+                if (mask != 0)
+                    return way + first_way[mask];
+            }
+            return associativity;
+        }
+#elif defined(CACHING_DEVICE_SSE2)
+        // A set of 2 or more ways starts on a 16-byte boundary (see init()).
+        if (associativity >= 2) {
+            const __m128i key = _mm_set1_epi64x((long long)tag);
+            for (int way = start_way & ~1; way < associativity; way += 2) {
+                // SSE2 has no 64-bit compare: both 32-bit halves must match.
+                __m128i eq = _mm_cmpeq_epi32
+                    (_mm_load_si128((const __m128i *)(set + way)), key);
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+                int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+                if (way < start_way)
+                    mask &= ~1;
+                if (mask != 0)
+                    return way + ((mask & 1) != 0 ? 0 : 1);
+            }
+            return associativity;
+        }
+#endif
+        for (int way = start_way; way < associativity; ++way) {
+            if (set[way] == tag)
+                return way;
+        }
+        return associativity;
+    }
     // a pure virtual function for subclasses to initialize their own block array
     virtual void init_blocks() = 0;
 
@@ -82,11 +148,22 @@ class caching_device_t
     // an extended block class which has its own member variables cannot be indexed
     // correctly by base class pointers.
     caching_device_block_t **blocks;
+    // The tag and replacement counter of each block, indexed like blocks.
+    // The tags of a set are contiguous and the array is cache-line aligned,
+    // so a set never straddles more cache lines than it has to and find_way()
+    // can compare several ways per instruction.  A counter starts at 0: we
+    // expect any use of it to only occur *after* a valid tag is put in place,
+    // where for the current replacement code we also set the counter.
+    addr_t *tags;
+    // XXX: using int_least64_t here results in a ~4% slowdown for 32-bit apps.
+    // A 32-bit counter should be sufficient but we may want to revisit.
+    int *counters;
     int blocks_per_set;
     // Optimization fields for fast bit operations
     int blocks_per_set_mask;
     int assoc_bits;
     int block_size_bits;
+    int set_index_shift;
 
     caching_device_stats_t *stats;
 
@@ -94,6 +171,10 @@ class caching_device_t
     addr_t last_tag;
     int last_way;
     int last_block_idx;
+
+ private:
+    // The unaligned allocation backing tags.
+    addr_t *tags_alloc;
 };
 
 #endif /* _CACHING_DEVICE_H_ */
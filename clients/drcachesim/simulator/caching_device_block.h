@@ -45,23 +45,16 @@
 // block status.
 static const addr_t TAG_INVALID = (addr_t)-1; // block is invalid
 
+// The tag and replacement counter of each block are kept by caching_device_t
+// in flat per-set arrays (see caching_device_t::tags) so a lookup does not have
+// to chase a pointer per way.  This class holds any further per-block state:
+// e.g., tlb_entry_t adds the pid.
 class caching_device_block_t
 {
  public:
-    // Initializing counter to 0 is just to be safe and to make it easier to write new
-    // replacement algorithms without errors (and we expect negligible perf cost), as
-    // we expect any use of counter to only occur *after* a valid tag is put in place,
-    // where for the current replacement code we also set the counter at that time.
-    caching_device_block_t() : tag(TAG_INVALID), counter(0) {}
+    caching_device_block_t() {}
     // Destructor must be virtual and default is not.
     virtual ~caching_device_block_t() {}
-
-    addr_t tag;
-
-    // XXX: using int_least64_t here results in a ~4% slowdown for 32-bit apps.
-    // A 32-bit counter should be sufficient but we may want to revisit.
-    // We already have stdint.h so we can reinstate int_least64_t easily.
-    int counter; // for use by replacement policies
 };
 
 #endif /* _CACHING_DEVICE_BLOCK_H_ */
@@ -114,3 +114,11 @@ caching_device_stats_t::reset()
     num_misses = 0;
     num_child_hits = 0;
 }
+
+void
+caching_device_stats_t::merge(const caching_device_stats_t &other)
+{
+    num_hits += other.num_hits;
+    num_misses += other.num_misses;
+    num_child_hits += other.num_child_hits;
+}
@@ -58,6 +58,10 @@ class caching_device_stats_t
 
     virtual void reset();
 
+    // Adds the counts of other, which must be of the same type,
+    // e.g., to combine the shards of a sharded simulation.
+    virtual void merge(const caching_device_stats_t &other);
+
  protected:
     // print different groups of information, beneficial for code reuse
     virtual void print_counts(std::string prefix); // hit/miss numbers
@@ -0,0 +1,202 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iomanip>
+#include <iostream>
+#include <limits.h>
+#include "lru_sweep.h"
+#include "../common/utils.h"
+
+lru_stack_group_t::lru_stack_group_t(int num_sets_, int max_assoc_) :
+    num_sets(num_sets_), max_assoc(max_assoc_),
+    stacks((size_t)num_sets_ * max_assoc_), depths(num_sets_, 0)
+{
+}
+
+int
+lru_stack_group_t::access(addr_t tag)
+{
+    int set = (int)(tag & (num_sets - 1));
+    addr_t *stack = &stacks[(size_t)set * max_assoc];
+    int depth;
+    for (depth = 0; depth < depths[set]; ++depth) {
+        if (stack[depth] == tag)
+            break;
+    }
+    int found = depth;
+    if (depth == depths[set]) {
+        found = max_assoc;
+        if (depths[set] < max_assoc)
+            ++depths[set];
+        // Drop the bottom line if the stack is full.
+        depth = depths[set] - 1;
+    }
+    for (; depth > 0; --depth)
+        stack[depth] = stack[depth - 1];
+    stack[0] = tag;
+    return found;
+}
+
+void
+lru_stack_group_t::invalidate(addr_t tag)
+{
+    int set = (int)(tag & (num_sets - 1));
+    addr_t *stack = &stacks[(size_t)set * max_assoc];
+    for (int depth = 0; depth < depths[set]; ++depth) {
+        if (stack[depth] == tag) {
+            for (; depth + 1 < depths[set]; ++depth)
+                stack[depth] = stack[depth + 1];
+            --depths[set];
+            return;
+        }
+    }
+}
+
+lru_sweep_t::lru_sweep_t() : line_size_bits(0)
+{
+}
+
+lru_sweep_t::~lru_sweep_t()
+{
+    for (size_t i = 0; i < groups.size(); ++i)
+        delete groups[i];
+}
+
+bool
+lru_sweep_t::init(int line_size, const std::vector<lru_sweep_config_t> &configs_in)
+{
+    if (!IS_POWER_OF_2(line_size))
+        return false;
+    line_size_bits = compute_log2(line_size);
+    configs = configs_in;
+    // Group the configs by number of sets, each group as deep as its
+    // largest associativity.
+    std::vector<int> group_sets, group_assoc;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        if (configs[i].assoc <= 0 ||
+            configs[i].size % ((uint64_t)line_size * configs[i].assoc) != 0)
+            return false;
+        uint64_t sets = configs[i].size / line_size / configs[i].assoc;
+        if (!IS_POWER_OF_2(sets) || sets > INT_MAX)
+            return false;
+        size_t g;
+        for (g = 0; g < group_sets.size(); ++g) {
+            if (group_sets[g] == (int)sets)
+                break;
+        }
+        if (g == group_sets.size()) {
+            group_sets.push_back((int)sets);
+            group_assoc.push_back(configs[i].assoc);
+        } else if (configs[i].assoc > group_assoc[g])
+            group_assoc[g] = configs[i].assoc;
+        config_group.push_back((int)g);
+    }
+    for (size_t g = 0; g < group_sets.size(); ++g) {
+        groups.push_back(new lru_stack_group_t(group_sets[g], group_assoc[g]));
+        depth_counts.push_back(std::vector<int_least64_t>(group_assoc[g] + 1, 0));
+    }
+    return true;
+}
+
+void
+lru_sweep_t::access_line(addr_t tag, bool counted)
+{
+    for (size_t g = 0; g < groups.size(); ++g) {
+        int depth = groups[g]->access(tag);
+        if (counted)
+            ++depth_counts[g][depth];
+    }
+}
+
+void
+lru_sweep_t::request(const memref_t &memref)
+{
+    addr_t final_tag = (memref.data.addr + memref.data.size - 1/*avoid overflow*/) >>
+        line_size_bits;
+    bool counted = !type_is_prefetch(memref.data.type);
+    for (addr_t tag = memref.data.addr >> line_size_bits; tag <= final_tag; ++tag)
+        access_line(tag, counted);
+}
+
+void
+lru_sweep_t::flush(const memref_t &memref)
+{
+    addr_t final_tag = (memref.flush.addr + memref.flush.size - 1/*no overflow*/) >>
+        line_size_bits;
+    for (addr_t tag = memref.flush.addr >> line_size_bits; tag <= final_tag; ++tag) {
+        for (size_t g = 0; g < groups.size(); ++g)
+            groups[g]->invalidate(tag);
+    }
+}
+
+void
+lru_sweep_t::reset()
+{
+    for (size_t g = 0; g < depth_counts.size(); ++g)
+        depth_counts[g].assign(depth_counts[g].size(), 0);
+}
+
+void
+lru_sweep_t::merge(const lru_sweep_t &other)
+{
+    for (size_t g = 0; g < depth_counts.size(); ++g) {
+        for (size_t d = 0; d < depth_counts[g].size(); ++d)
+            depth_counts[g][d] += other.depth_counts[g][d];
+    }
+}
+
+void
+lru_sweep_t::print_results(const std::string &prefix)
+{
+    std::cerr << prefix << std::setw(12) << std::left << "Size" <<
+        std::setw(8) << std::right << "Assoc" <<
+        std::setw(20) << "Hits" << std::setw(20) << "Misses" <<
+        std::setw(12) << "Miss rate" << std::endl;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        const std::vector<int_least64_t> &counts = depth_counts[config_group[i]];
+        int_least64_t hits = 0, misses = 0;
+        for (size_t d = 0; d < counts.size(); ++d) {
+            if ((int)d < configs[i].assoc)
+                hits += counts[d];
+            else
+                misses += counts[d];
+        }
+        std::cerr << prefix << std::setw(12) << std::left << configs[i].size <<
+            std::setw(8) << std::right << configs[i].assoc <<
+            std::setw(20) << hits << std::setw(20) << misses;
+        if (hits + misses > 0) {
+            std::cerr << std::setw(11) << std::fixed << std::setprecision(2) <<
+                ((float)misses*100/(hits+misses)) << "%";
+        }
+        std::cerr << std::endl;
+    }
+}
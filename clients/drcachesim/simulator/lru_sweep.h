@@ -0,0 +1,105 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* lru_sweep: evaluates a family of LRU cache configurations in one pass.
+ */
+
+#ifndef _LRU_SWEEP_H_
+#define _LRU_SWEEP_H_ 1
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "../common/memref.h"
+
+// LRU is a stack algorithm (Mattson et al.): a cache with A ways per set hits
+// exactly when the line is among the A most recently used lines of its set.
+// For a given number of sets we thus keep one LRU stack per set, as deep as
+// the largest associativity of interest, and count how deep each access
+// finds its line: the hits for every associativity fall out of those counts.
+// Each distinct number of sets needs its own stacks.
+class lru_stack_group_t
+{
+ public:
+    lru_stack_group_t(int num_sets, int max_assoc);
+    // Moves the line to the top of its set's stack and returns the depth at
+    // which it was found, or max_assoc on a miss.
+    int access(addr_t tag);
+    void invalidate(addr_t tag);
+    int get_num_sets() const { return num_sets; }
+
+ private:
+    int num_sets;
+    int max_assoc;
+    // Set i's stack is stacks[i*max_assoc, i*max_assoc + depths[i]), top first.
+    std::vector<addr_t> stacks;
+    std::vector<int> depths;
+};
+
+struct lru_sweep_config_t {
+    uint64_t size;
+    int assoc;
+};
+
+class lru_sweep_t
+{
+ public:
+    lru_sweep_t();
+    ~lru_sweep_t();
+    // Returns false if a configuration is not a power-of-2 number of sets.
+    bool init(int line_size, const std::vector<lru_sweep_config_t> &configs);
+
+    // These mirror cache_t::request() and cache_t::flush(): a multi-line
+    // memref is counted once per line, and prefetches update the stacks
+    // without being counted as hits or misses.
+    void request(const memref_t &memref);
+    void flush(const memref_t &memref);
+    void reset();
+
+    // Adds the counts of other, which must have been given the same configs.
+    void merge(const lru_sweep_t &other);
+    void print_results(const std::string &prefix);
+
+ private:
+    void access_line(addr_t tag, bool counted);
+
+    int line_size_bits;
+    std::vector<lru_sweep_config_t> configs;
+    std::vector<lru_stack_group_t *> groups;
+    // For each group, the number of accesses found at each depth, with
+    // the last entry counting misses at every depth.
+    std::vector< std::vector<int_least64_t> > depth_counts;
+    // The group and associativity of each config.
+    std::vector<int> config_group;
+};
+
+#endif /* _LRU_SWEEP_H_ */
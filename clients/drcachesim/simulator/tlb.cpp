@@ -65,7 +65,7 @@ tlb_t::request(const memref_t &memref_in)
     if (tag == final_tag && tag == last_tag && pid == last_pid) {
         // Make sure last_tag and pid are properly in sync.
         assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag &&
+               tag == get_tag(last_block_idx, last_way) &&
                pid == ((tlb_entry_t &)get_caching_device_block(
                        last_block_idx, last_way)).pid);
         stats->access(memref_in, true/*hit*/);
@@ -83,9 +83,10 @@ tlb_t::request(const memref_t &memref_in)
         if (tag + 1 <= final_tag)
             memref.data.size = ((tag + 1) << block_size_bits) - memref.data.addr;
 
-        for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag &&
-                ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid == pid) {
+        // The same page may be present for several pids.
+        for (way = find_way(block_idx, tag); way < associativity;
+             way = find_way(block_idx, tag, way + 1)) {
+            if (((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid == pid) {
                 stats->access(memref, true/*hit*/);
                 if (parent != NULL)
                     parent->get_stats()->child_access(memref, true);
@@ -104,7 +105,7 @@ tlb_t::request(const memref_t &memref_in)
             // XXX: do we need to handle TLB coherency?
 
             way = replace_which_way(block_idx);
-            get_caching_device_block(block_idx, way).tag = tag;
+            get_tag(block_idx, way) = tag;
             ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid = pid;
         }
 
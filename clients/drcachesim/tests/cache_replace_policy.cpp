@@ -0,0 +1,224 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Feeds short access sequences to a single 4-way set under each replacement
+ * policy and checks which accesses hit.  Each sequence is small enough to
+ * work out by hand from the policy's definition, and several are chosen so
+ * that the policies disagree.  It also checks that splitting a multi-set cache
+ * into shards, as -cache_shards does, does not change any policy's results.
+ */
+
+#include "../simulator/cache_fifo.h"
+#include "../simulator/cache_lru.h"
+#include "../simulator/cache_plru.h"
+#include "../simulator/cache_rrip.h"
+#include "../simulator/cache_stats.h"
+#include <iostream>
+#include <string.h>
+#include <string>
+
+static const int LINE_SIZE = 64;
+static const int ASSOC = 4;
+
+// Exposes the hit and miss counts.
+class test_stats_t : public cache_stats_t
+{
+ public:
+    int_least64_t hits() const { return num_hits; }
+    int_least64_t misses() const { return num_misses; }
+};
+
+static bool failed;
+
+static void
+access(cache_t *cache, char line)
+{
+    memref_t ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.data.type = TRACE_TYPE_READ;
+    ref.data.addr = (line - 'A') * LINE_SIZE;
+    ref.data.size = 1;
+    cache->request(ref);
+}
+
+static void
+flush(cache_t *cache, char line)
+{
+    memref_t ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.flush.type = TRACE_TYPE_DATA_FLUSH;
+    ref.flush.addr = (line - 'A') * LINE_SIZE;
+    ref.flush.size = LINE_SIZE;
+    cache->flush(ref);
+}
+
+// Runs seq, in which each letter is an access to a different line of the one
+// set and a '-' flushes the line named by the next letter, through cache and
+// compares the counts.  Takes ownership of cache.
+static void
+check(const std::string &name, cache_t *cache, const std::string &seq,
+      int_least64_t hits, int_least64_t misses)
+{
+    test_stats_t stats;
+    if (!cache->init(ASSOC, LINE_SIZE, ASSOC * LINE_SIZE, NULL, &stats)) {
+        std::cerr << name << ": failed to initialize the cache\n";
+        failed = true;
+        delete cache;
+        return;
+    }
+    for (size_t i = 0; i < seq.size(); ++i) {
+        if (seq[i] == '-')
+            flush(cache, seq[++i]);
+        else
+            access(cache, seq[i]);
+    }
+    if (stats.hits() != hits || stats.misses() != misses) {
+        std::cerr << name << " " << seq << ": expected " << hits << " hits and "
+                  << misses << " misses, got " << stats.hits() << " and "
+                  << stats.misses() << "\n";
+        failed = true;
+    }
+    delete cache;
+}
+
+// Runs the same pseudo-random accesses through one cache of NUM_SETS sets and
+// through NUM_SHARDS caches that each hold the sets whose low index bits match
+// their shard, and compares the total counts.  A policy whose state is not
+// kept per set would make the two diverge.
+static void
+check_shards(const std::string &name, cache_t *(*create)())
+{
+    static const int NUM_SETS = 64;
+    static const int SHARD_BITS = 2;
+    static const int NUM_SHARDS = 1 << SHARD_BITS;
+    static const int NUM_LINES = NUM_SETS * ASSOC * 3;
+    static const int NUM_ACCESSES = 100000;
+    test_stats_t serial_stats;
+    test_stats_t shard_stats[NUM_SHARDS];
+    cache_t *serial = create();
+    cache_t *shards[NUM_SHARDS];
+    bool ok = serial->init(ASSOC, LINE_SIZE, NUM_SETS * ASSOC * LINE_SIZE, NULL,
+                           &serial_stats);
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        shards[i] = create();
+        if (!shards[i]->init(ASSOC, LINE_SIZE,
+                             NUM_SETS / NUM_SHARDS * ASSOC * LINE_SIZE, NULL,
+                             &shard_stats[i]))
+            ok = false;
+        shards[i]->set_shard_bits(SHARD_BITS);
+    }
+    if (!ok) {
+        std::cerr << name << ": failed to initialize the caches\n";
+        failed = true;
+    } else {
+        // A fixed linear congruential generator keeps the test reproducible.
+        unsigned int seed = 1;
+        memref_t ref;
+        memset(&ref, 0, sizeof(ref));
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.size = 1;
+        for (int i = 0; i < NUM_ACCESSES; ++i) {
+            seed = seed * 1103515245 + 12345;
+            // Favor low lines so that there are hits as well as misses.
+            unsigned int line = (seed >> 16) % NUM_LINES;
+            if ((seed & 1) != 0)
+                line %= NUM_SETS * ASSOC;
+            ref.data.addr = (addr_t)line * LINE_SIZE;
+            serial->request(ref);
+            shards[line % NUM_SHARDS]->request(ref);
+        }
+        int_least64_t hits = 0, misses = 0;
+        for (int i = 0; i < NUM_SHARDS; ++i) {
+            hits += shard_stats[i].hits();
+            misses += shard_stats[i].misses();
+        }
+        if (serial_stats.hits() != hits || serial_stats.misses() != misses) {
+            std::cerr << name << " sharded: expected " << serial_stats.hits()
+                      << " hits and " << serial_stats.misses() << " misses, got "
+                      << hits << " and " << misses << "\n";
+            failed = true;
+        }
+    }
+    delete serial;
+    for (int i = 0; i < NUM_SHARDS; ++i)
+        delete shards[i];
+}
+
+static cache_t *create_lru() { return new cache_lru_t; }
+static cache_t *create_fifo() { return new cache_fifo_t; }
+static cache_t *create_plru() { return new cache_plru_t; }
+static cache_t *create_srrip() { return new cache_rrip_t(false); }
+static cache_t *create_brrip() { return new cache_rrip_t(true); }
+
+int
+main(int argc, const char *argv[])
+{
+    // After the fills, A is the most recently used line.  LRU evicts B for E
+    // and C for B, while FIFO evicts A for E and keeps B and C.  The PLRU tree
+    // points away from A and D, so it evicts C for E and D for C.
+    check("LRU", new cache_lru_t, "ABCDAEBC", 1, 7);
+    check("FIFO", new cache_fifo_t, "ABCDAEBC", 3, 5);
+    check("PLRU", new cache_plru_t, "ABCDAEBC", 2, 6);
+    check("SRRIP", new cache_rrip_t(false), "ABCDAEBC", 1, 7);
+
+    // Reusing lines keeps SRRIP from dropping them for a scan, unlike LRU.
+    check("LRU", new cache_lru_t, "AABBWXYZAB", 2, 8);
+    check("SRRIP", new cache_rrip_t(false), "AABBWXYZAB", 4, 6);
+    check("BRRIP", new cache_rrip_t(true), "AABBWXYZAB", 4, 6);
+
+    // SRRIP gives new lines a second chance; BRRIP makes E the next victim.
+    check("LRU", new cache_lru_t, "ABCDAEFE", 2, 6);
+    check("SRRIP", new cache_rrip_t(false), "ABCDAEFE", 2, 6);
+    check("BRRIP", new cache_rrip_t(true), "ABCDAEFE", 1, 7);
+
+    // A flush of A, the next FIFO victim, leaves an invalid way that every
+    // policy fills with E.  After D hits, LRU, FIFO and PLRU evict B for A and
+    // C for B, while RRIP evicts E, the one line without a hit.  The flush used
+    // to lose FIFO's replacement pointer.
+    check("LRU", new cache_lru_t, "ABCD-AEDAB", 1, 7);
+    check("FIFO", new cache_fifo_t, "ABCD-AEDAB", 1, 7);
+    check("PLRU", new cache_plru_t, "ABCD-AEDAB", 1, 7);
+    check("SRRIP", new cache_rrip_t(false), "ABCD-AEDAB", 2, 6);
+    check("BRRIP", new cache_rrip_t(true), "ABCD-AEDAB", 2, 6);
+
+    check_shards("LRU", create_lru);
+    check_shards("FIFO", create_fifo);
+    check_shards("PLRU", create_plru);
+    check_shards("SRRIP", create_srrip);
+    // BRRIP used to count its fills across the whole cache.
+    check_shards("BRRIP", create_brrip);
+
+    if (failed)
+        return 1;
+    std::cerr << "all done\n";
+    return 0;
+}
@@ -0,0 +1,235 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Benchmarks raw2trace on a synthetic offline trace with many threads, which
+ * stresses the timestamp-ordered merge of the per-thread files rather than
+ * instruction decoding.  Every thread file has the same number of entries and
+ * the threads take turns in timestamp order, as in a trace of threads that are
+ * all running.
+ */
+
+#include "dr_api.h"
+#include "droption.h"
+#include "../common/trace_entry.h"
+#include "../tracer/drmemtrace.h"
+#include "../tracer/raw2trace.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static droption_t<std::string> op_dir
+(DROPTION_SCOPE_FRONTEND, "dir", "raw2trace_bench.dir",
+ "Scratch directory", "Specifies the directory in which to write the synthetic "
+ "trace.  It is removed at the end.");
+
+static droption_t<unsigned int> op_threads
+(DROPTION_SCOPE_FRONTEND, "threads", 512, "Number of synthetic threads",
+ "Specifies the number of thread files in the synthetic trace.");
+
+static droption_t<unsigned int> op_entries
+(DROPTION_SCOPE_FRONTEND, "entries", 16*1024, "Raw entries per thread",
+ "Specifies the number of instruction and memory reference entries in each thread "
+ "file.");
+
+static droption_t<unsigned int> op_segments
+(DROPTION_SCOPE_FRONTEND, "segments", 64, "Timestamps per thread",
+ "Specifies how many timestamps each thread file contains.  Each one is a point "
+ "where the merge may switch to another thread.");
+
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 1, "Number of conversion threads",
+ "Passed to raw2trace: see the drraw2trace option of the same name.");
+
+// Non-static for use by raw2trace.cpp
+droption_t<unsigned int> op_verbose
+(DROPTION_SCOPE_FRONTEND, "verbose", 0, "Verbosity level for diagnostic output",
+ "Verbosity level for diagnostic output.");
+
+#define FATAL_ERROR(msg, ...) do { \
+    fprintf(stderr, "ERROR: " msg "\n", ##__VA_ARGS__);    \
+    fflush(stderr); \
+    exit(1); \
+} while (0)
+
+static void
+write_entry(std::ofstream &out, int type, uint64 value)
+{
+    offline_entry_t entry;
+    entry.combined_value = 0;
+    entry.addr.addr = value;
+    entry.addr.type = type;
+    out.write((char*)&entry, sizeof(entry));
+}
+
+static void
+write_ext_entry(std::ofstream &out, uint ext, uint value)
+{
+    offline_entry_t entry;
+    entry.combined_value = 0;
+    entry.extended.type = OFFLINE_TYPE_EXTENDED;
+    entry.extended.ext = ext;
+    entry.extended.value = value;
+    out.write((char*)&entry, sizeof(entry));
+}
+
+static std::string
+thread_file_path(const std::string &rawdir, uint index)
+{
+    std::ostringstream path;
+    path << rawdir << DIRSEP << OUTFILE_PREFIX << ".bench." << 1000 + index << "."
+         << OUTFILE_SUFFIX;
+    return path.str();
+}
+
+// Writes a module list with just the non-module entry, and thread files whose
+// code is all outside of any module so that nothing needs to be decoded.
+static void
+write_trace(const std::string &rawdir)
+{
+    std::ofstream modfile((rawdir + DIRSEP + DRMEMTRACE_MODULE_LIST_FILENAME).c_str());
+    char addr[32];
+    dr_snprintf(addr, BUFFER_SIZE_ELEMENTS(addr), PIFX, (ptr_uint_t)0);
+    NULL_TERMINATE_BUFFER(addr);
+    modfile << "Module Table: version 3, count 1\n"
+            << "Columns: id, containing_id, start, end, entry, "
+#ifdef WINDOWS
+            << "checksum, timestamp, "
+#endif
+            << "path\n"
+            << "0, 0, " << addr << ", " << addr << ", " << addr << ", "
+#ifdef WINDOWS
+            << "0x00000000, 0x00000000, "
+#endif
+            << "<unknown>\n";
+    if (!modfile)
+        FATAL_ERROR("Failed to write module list in %s", rawdir.c_str());
+
+    uint threads = op_threads.get_value();
+    uint segments = op_segments.get_value();
+    uint per_segment = op_entries.get_value() / segments;
+    for (uint i = 0; i < threads; ++i) {
+        std::ofstream out(thread_file_path(rawdir, i).c_str(), std::ofstream::binary);
+        write_ext_entry(out, OFFLINE_EXT_TYPE_HEADER, OFFLINE_FILE_VERSION);
+        for (uint seg = 0; seg < segments; ++seg) {
+            // The threads take turns.
+            write_entry(out, OFFLINE_TYPE_TIMESTAMP, 1000 + (uint64)seg * threads + i);
+            if (seg == 0) {
+                write_entry(out, OFFLINE_TYPE_THREAD, 1000 + i);
+                write_entry(out, OFFLINE_TYPE_PID, 1000);
+            }
+            // Alternate single-instruction blocks and memory references.
+            for (uint j = 0; j < per_segment; ++j) {
+                if (j % 2 == 0)
+                    write_entry(out, OFFLINE_TYPE_PC, 0);
+                else {
+                    write_entry(out, OFFLINE_TYPE_MEMREF,
+                                0x10000 + (uint64)(i * per_segment + j) * 64);
+                }
+            }
+        }
+        write_ext_entry(out, OFFLINE_EXT_TYPE_FOOTER, 0);
+        if (!out)
+            FATAL_ERROR("Failed to write thread file %u", i);
+    }
+}
+
+// Returns the number of thread exits in the converted trace, while checking
+// that it ends in a footer.
+static uint
+count_thread_exits(const std::string &path, uint64 *num_entries)
+{
+    std::ifstream in(path.c_str(), std::ifstream::binary);
+    std::vector<trace_entry_t> buf(64*1024);
+    uint exits = 0;
+    trace_entry_t last = {};
+    *num_entries = 0;
+    while (in.read((char*)&buf[0], buf.size() * sizeof(buf[0])) || in.gcount() > 0) {
+        size_t count = (size_t)in.gcount() / sizeof(buf[0]);
+        for (size_t i = 0; i < count; ++i) {
+            if (buf[i].type == TRACE_TYPE_THREAD_EXIT)
+                ++exits;
+        }
+        if (count > 0)
+            last = buf[count - 1];
+        *num_entries += count;
+    }
+    if (last.type != TRACE_TYPE_FOOTER)
+        FATAL_ERROR("Converted trace %s is missing its footer", path.c_str());
+    return exits;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::string parse_err;
+    if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, argv,
+                                       &parse_err, NULL) ||
+        op_threads.get_value() == 0 || op_segments.get_value() == 0) {
+        FATAL_ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
+                    droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+    }
+    dr_standalone_init();
+
+    std::string dir = op_dir.get_value();
+    std::string rawdir = dir + DIRSEP + OUTFILE_SUBDIR;
+    std::string outname = dir + DIRSEP + "bench.trace";
+    // Tolerate directories left behind by an earlier run that failed.
+    if ((!dr_directory_exists(dir.c_str()) && !dr_create_dir(dir.c_str())) ||
+        (!dr_directory_exists(rawdir.c_str()) && !dr_create_dir(rawdir.c_str())))
+        FATAL_ERROR("Failed to create %s", rawdir.c_str());
+    write_trace(rawdir);
+
+    uint64 start = dr_get_milliseconds();
+    {
+        raw2trace_t raw2trace(rawdir, outname, op_jobs.get_value());
+        raw2trace.do_conversion();
+    }
+    uint64 elapsed = dr_get_milliseconds() - start;
+
+    uint64 num_entries;
+    uint exits = count_thread_exits(outname, &num_entries);
+    if (exits != op_threads.get_value())
+        FATAL_ERROR("Expected %u thread exits, found %u", op_threads.get_value(), exits);
+    std::cerr << "Converted " << op_threads.get_value() << " threads into "
+              << num_entries << " entries in " << elapsed << " ms\n";
+
+    for (uint i = 0; i < op_threads.get_value(); ++i)
+        dr_delete_file(thread_file_path(rawdir, i).c_str());
+    dr_delete_file((rawdir + DIRSEP + DRMEMTRACE_MODULE_LIST_FILENAME).c_str());
+    dr_delete_file(outname.c_str());
+    dr_delete_dir(rawdir.c_str());
+    dr_delete_dir(dir.c_str());
+    std::cerr << "all done\n";
+    return 0;
+}
@@ -80,6 +80,16 @@ bool cmp(const std::pair<addr_t, uint64_t> &l,
     return l.second > r.second;
 }
 
+bool
+histogram_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // The qualified call is not virtual and can be inlined into this loop.
+    bool res = true;
+    for (size_t i = 0; i < count; ++i)
+        res = histogram_t::process_memref(memrefs[i]) && res;
+    return res;
+}
+
 bool
 histogram_t::print_results()
 {
@@ -49,6 +49,7 @@ class histogram_t : public analysis_tool_t
                 unsigned int verbose);
     virtual ~histogram_t();
     virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
     virtual bool print_results();
 
  protected:
@@ -49,11 +49,34 @@ reuse_distance_tool_create(unsigned int line_size = 64,
                            unsigned int report_top = 10,
                            unsigned int skip_list_distance = 500,
                            bool verify_skip = false,
-                           unsigned int verbose = 0)
+                           unsigned int verbose = 0,
+                           bool use_fenwick = false,
+                           unsigned int sample_period = 1,
+                           unsigned int sample_max_lines = 0,
+                           bool report_miss_ratio_curve = false)
 {
     return new reuse_distance_t(line_size, report_histogram, distance_threshold,
                                 report_top, skip_list_distance, verify_skip,
-                                verbose);
+                                verbose, use_fenwick, sample_period,
+                                sample_max_lines, report_miss_ratio_curve);
+}
+
+// The sampling hash space.  It is large enough for rates well below 0.001.
+static const uint64_t SAMPLE_MODULUS = 1 << 24;
+
+// Returns the sampling hash of tag, which is below SAMPLE_MODULUS.
+// This is the 64-bit finalizer of MurmurHash3: unlike the multiplicative hash
+// of line_ref_tree_t's table, its low bits depend on every bit of tag.
+static inline uint64_t
+sample_hash(addr_t tag)
+{
+    uint64_t hash = (uint64_t)tag;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash & (SAMPLE_MODULUS - 1);
 }
 
 reuse_distance_t::reuse_distance_t(unsigned int line_size,
@@ -62,24 +85,44 @@ reuse_distance_t::reuse_distance_t(unsigned int line_size,
                                    unsigned int report_top,
                                    unsigned int skip_list_distance,
                                    bool verify_skip,
-                                   unsigned int verbose) :
+                                   unsigned int verbose,
+                                   bool use_fenwick,
+                                   unsigned int sample_period,
+                                   unsigned int sample_max_lines,
+                                   bool report_miss_ratio_curve) :
+    ref_list(NULL), ref_tree(NULL), sample_threshold(SAMPLE_MODULUS),
+    sample_weight(1.), est_refs(0.), est_unique_accesses(0.), est_unique_lines(0.),
     knob_line_size(line_size), knob_report_histogram(report_histogram),
-    knob_report_top(report_top), total_refs(0)
+    knob_distance_threshold(distance_threshold), knob_report_top(report_top),
+    knob_sample_max_lines(sample_max_lines),
+    knob_report_miss_ratio_curve(report_miss_ratio_curve), total_refs(0)
 {
     knob_verbose = verbose;
     line_size_bits = compute_log2((int)knob_line_size);
-    ref_list = new line_ref_list_t(distance_threshold,
-                                   skip_list_distance,
-                                   verify_skip);
+    sampling = sample_period > 1 || sample_max_lines > 0;
+    if (sample_period > 1) {
+        sample_threshold = std::max(SAMPLE_MODULUS / sample_period, (uint64_t)1);
+        sample_weight = (double)SAMPLE_MODULUS / sample_threshold;
+    }
+    // Sampling needs to remove lines, which only the tree supports.
+    if (use_fenwick || sampling) {
+        ref_tree = new line_ref_tree_t((uint64_t)(distance_threshold / sample_weight));
+    }
+    else {
+        ref_list = new line_ref_list_t(distance_threshold,
+                                       skip_list_distance,
+                                       verify_skip);
+    }
     if (DEBUG_VERBOSE(2)) {
         std::cerr << "cache line size " << knob_line_size << ", "
-                  << "reuse distance threshold " << ref_list->threshold << std::endl;
+                  << "reuse distance threshold " << distance_threshold << std::endl;
     }
 }
 
 reuse_distance_t::~reuse_distance_t()
 {
     delete ref_list;
+    delete ref_tree;
 }
 
 bool
@@ -104,51 +147,140 @@ reuse_distance_t::process_memref(const memref_t &memref)
         type_is_prefetch(memref.data.type)) {
         ++total_refs;
         addr_t tag = memref.data.addr >> line_size_bits;
-        std::map<addr_t, line_ref_t*>::iterator it = cache_map.find(tag);
-        if (it == cache_map.end()) {
-            line_ref_t *ref = new line_ref_t(tag);
-            // insert into the map
-            cache_map.insert(std::pair<addr_t, line_ref_t*>(tag, ref));
-            // insert into the list
-            ref_list->add_to_front(ref);
-        } else {
-            int_least64_t dist = ref_list->move_to_front(it->second);
-            std::map<int_least64_t, int_least64_t>::iterator dist_it =
+        if (sampling && sample_hash(tag) >= sample_threshold)
+            return true;
+        int_least64_t dist = -1;
+        if (ref_tree != NULL)
+            dist = ref_tree->access(tag);
+        else {
+            std::map<addr_t, line_ref_t*>::iterator it = cache_map.find(tag);
+            if (it == cache_map.end()) {
+                line_ref_t *ref = new line_ref_t(tag);
+                // insert into the map
+                cache_map.insert(std::pair<addr_t, line_ref_t*>(tag, ref));
+                // insert into the list
+                ref_list->add_to_front(ref);
+            } else
+                dist = ref_list->move_to_front(it->second);
+        }
+        if (sampling) {
+            // As in the engines, only a repeated reference to the most recent
+            // line, with a distance of 0, does not count as a unique access.
+            est_refs += sample_weight;
+            if (dist != 0)
+                est_unique_accesses += sample_weight;
+            if (dist < 0)
+                est_unique_lines += sample_weight;
+            else
+                dist = (int_least64_t)(dist * sample_weight + 0.5);
+        }
+        if (dist >= 0) {
+            std::map<int_least64_t, double>::iterator dist_it =
                 dist_map.find(dist);
             if (dist_it == dist_map.end())
-                dist_map.insert(std::pair<int_least64_t, int_least64_t>(dist, 1));
+                dist_map.insert(std::pair<int_least64_t, double>(dist, sample_weight));
             else
-                ++dist_it->second;
+                dist_it->second += sample_weight;
             if (DEBUG_VERBOSE(3)) {
                 std::cerr << "Distance is " << dist << "\n";
             }
-        }
+        } else if (knob_sample_max_lines > 0 &&
+                   ref_tree->live_lines > knob_sample_max_lines)
+            shrink_sample();
     }
     return true;
 }
 
-bool cmp_total_refs(const std::pair<addr_t, line_ref_t*> &l,
-                    const std::pair<addr_t, line_ref_t*> &r)
+void
+reuse_distance_t::shrink_sample()
+{
+    // Halving keeps the lines already tracked a superset of what a lower
+    // fixed rate would have tracked from the start.
+    while (ref_tree->live_lines > knob_sample_max_lines && sample_threshold > 1) {
+        sample_threshold /= 2;
+        for (size_t i = 0; i < ref_tree->lines.size(); ++i) {
+            if (ref_tree->lines[i].time_stamp != LINE_REMOVED &&
+                sample_hash(ref_tree->lines[i].tag) >= sample_threshold)
+                ref_tree->remove(i);
+        }
+    }
+    sample_weight = (double)SAMPLE_MODULUS / sample_threshold;
+    ref_tree->threshold = (uint64_t)(knob_distance_threshold / sample_weight);
+    if (DEBUG_VERBOSE(1)) {
+        std::cerr << "Reuse distance sampling rate lowered to 1/" << sample_weight
+                  << "\n";
+    }
+}
+
+// Both orders break ties by address so the results do not depend on the engine.
+static bool
+cmp_total_refs(const line_info_t &l, const line_info_t &r)
 {
-    if (l.second->total_refs > r.second->total_refs)
-        return true;
-    if (l.second->total_refs < r.second->total_refs)
-        return false;
-    if (l.second->distant_refs > r.second->distant_refs)
-        return true;
-    return false;
+    if (l.total_refs != r.total_refs)
+        return l.total_refs > r.total_refs;
+    if (l.distant_refs != r.distant_refs)
+        return l.distant_refs > r.distant_refs;
+    return l.tag < r.tag;
 }
 
-bool cmp_distant_refs(const std::pair<addr_t, line_ref_t*> &l,
-                      const std::pair<addr_t, line_ref_t*> &r)
+static bool
+cmp_distant_refs(const line_info_t &l, const line_info_t &r)
 {
-    if (l.second->distant_refs > r.second->distant_refs)
-        return true;
-    if (l.second->distant_refs < r.second->distant_refs)
-        return false;
-    if (l.second->total_refs > r.second->total_refs)
-        return true;
-    return false;
+    if (l.distant_refs != r.distant_refs)
+        return l.distant_refs > r.distant_refs;
+    if (l.total_refs != r.total_refs)
+        return l.total_refs > r.total_refs;
+    return l.tag < r.tag;
+}
+
+// Keeps the knob_report_top lines that cmp puts first in top, which is a heap
+// with the last of them at the front.
+void
+reuse_distance_t::add_top_line(std::vector<line_info_t> &top, const line_info_t &line,
+                               bool (*cmp)(const line_info_t &, const line_info_t &))
+{
+    if (top.size() < knob_report_top) {
+        top.push_back(line);
+        std::push_heap(top.begin(), top.end(), cmp);
+    } else if (!top.empty() && cmp(line, top.front())) {
+        std::pop_heap(top.begin(), top.end(), cmp);
+        top.back() = line;
+        std::push_heap(top.begin(), top.end(), cmp);
+    }
+}
+
+void
+reuse_distance_t::print_top_lines(const std::string &title,
+                                  bool (*cmp)(const line_info_t &, const line_info_t &))
+{
+    std::vector<line_info_t> top;
+    if (ref_tree != NULL) {
+        for (std::vector<line_info_t>::iterator it = ref_tree->lines.begin();
+             it != ref_tree->lines.end(); ++it) {
+            if (it->time_stamp != LINE_REMOVED)
+                add_top_line(top, *it, cmp);
+        }
+    } else {
+        for (std::map<addr_t, line_ref_t*>::iterator it = cache_map.begin();
+             it != cache_map.end(); ++it) {
+            line_info_t line(it->first);
+            line.total_refs = it->second->total_refs;
+            line.distant_refs = it->second->distant_refs;
+            add_top_line(top, line, cmp);
+        }
+    }
+    std::sort_heap(top.begin(), top.end(), cmp);
+    std::cerr << "Top " << knob_report_top << " " << title << "\n";
+    std::cerr << std::setw(18) << "cache line"
+              << ": " << std::setw(17) << "#references  "
+              << std::setw(14) << "#distant refs" << "\n";
+    for (std::vector<line_info_t>::iterator it = top.begin(); it != top.end(); ++it) {
+        std::cerr << std::setw(18) << std::hex << std::showbase
+                  << (it->tag << line_size_bits)
+                  << ": " << std::setw(12) << std::dec << it->total_refs
+                  << ", " << std::setw(12) << std::dec << it->distant_refs
+                  << "\n";
+    }
 }
 
 bool
@@ -156,16 +288,35 @@ reuse_distance_t::print_results()
 {
     std::cerr << TOOL_NAME << " results:\n";
     std::cerr << "Total accesses: " << total_refs << "\n";
-    std::cerr << "Unique accesses: " << ref_list->cur_time << "\n";
-    std::cerr << "Unique cache lines accessed: " << ref_list->unique_lines << "\n";
+    double unique_accesses, unique_lines, refs;
+    if (sampling) {
+        unique_accesses = est_unique_accesses;
+        unique_lines = est_unique_lines;
+        refs = est_refs;
+    } else if (ref_tree != NULL) {
+        unique_accesses = (double)ref_tree->cur_time;
+        unique_lines = (double)ref_tree->unique_lines;
+        refs = (double)total_refs;
+    } else {
+        unique_accesses = (double)ref_list->cur_time;
+        unique_lines = (double)ref_list->unique_lines;
+        refs = (double)total_refs;
+    }
+    std::cerr << "Unique accesses: " << (int_least64_t)(unique_accesses + 0.5) << "\n";
+    std::cerr << "Unique cache lines accessed: " << (int_least64_t)(unique_lines + 0.5)
+              << "\n";
+    if (sampling) {
+        std::cerr << "(Estimated from " << ref_tree->live_lines << " cache lines "
+                  << "sampled at a rate of 1/" << sample_weight << ".)\n";
+    }
     std::cerr << "\n";
 
     std::cerr.precision(2);
     std::cerr.setf(std::ios::fixed);
 
     double sum = 0.0;
-    int_least64_t count = 0;
-    for (std::map<int_least64_t, int_least64_t>::iterator it = dist_map.begin();
+    double count = 0;
+    for (std::map<int_least64_t, double>::iterator it = dist_map.begin();
          it != dist_map.end(); ++it) {
         sum += it->first * it->second;
         count += it->second;
@@ -173,15 +324,15 @@ reuse_distance_t::print_results()
     double mean = sum / count;
     std::cerr << "Reuse distance mean: " << mean << "\n";
     double sum_of_squares = 0;
-    int_least64_t recount = 0;
+    double recount = 0;
     bool have_median = false;
-    for (std::map<int_least64_t, int_least64_t>::iterator it = dist_map.begin();
+    for (std::map<int_least64_t, double>::iterator it = dist_map.begin();
          it != dist_map.end(); ++it) {
         double diff = it->first - mean;
         sum_of_squares += (diff * diff) * it->second;
         if (!have_median) {
             recount += it->second;
-            if (recount >= count/2) {
+            if (recount >= std::floor(count/2)) {
                 std::cerr << "Reuse distance median: " << it->first << "\n";
                 have_median = true;
             }
@@ -195,12 +346,12 @@ reuse_distance_t::print_results()
         std::cerr << "Distance" << std::setw(12) << "Count"
                   << "  Percent  Cumulative\n";
         double cum_percent = 0;
-        for (std::map<int_least64_t, int_least64_t>::iterator it = dist_map.begin();
+        for (std::map<int_least64_t, double>::iterator it = dist_map.begin();
              it != dist_map.end(); ++it) {
-            double percent = it->second / static_cast<double>(count);
+            double percent = it->second / count;
             cum_percent += percent;
             std::cerr << std::setw(8) << it->first
-                      << std::setw(12) << it->second
+                      << std::setw(12) << (int_least64_t)(it->second + 0.5)
                       << std::setw(8) << percent*100. << "%"
                       << std::setw(8) << cum_percent*100. << "%\n";
         }
@@ -208,44 +359,212 @@ reuse_distance_t::print_results()
         std::cerr << "(Pass -reuse_distance_histogram to see all the data.)\n";
     }
 
-    std::cerr << "\n";
-    std::cerr << "Reuse distance threshold = "
-              << ref_list->threshold << " cache lines\n";
-    std::vector<std::pair<addr_t, line_ref_t*> > top(knob_report_top);
-    std::partial_sort_copy(cache_map.begin(), cache_map.end(),
-                           top.begin(), top.end(), cmp_total_refs);
-    std::cerr << "Top " << top.size() << " frequently referenced cache lines\n";
-    std::cerr << std::setw(18) << "cache line"
-              << ": " << std::setw(17) << "#references  "
-              << std::setw(14) << "#distant refs" << "\n";
-    for (std::vector<std::pair<addr_t, line_ref_t*> >::iterator it = top.begin();
-         it != top.end(); ++it) {
-        if (it->second == NULL) // Very small app.
-            break;
-        std::cerr << std::setw(18) << std::hex << std::showbase
-                  << (it->first << line_size_bits)
-                  << ": " << std::setw(12) << std::dec << it->second->total_refs
-                  << ", " << std::setw(12) << std::dec << it->second->distant_refs
-                  << "\n";
-    }
-    top.clear();
-    top.resize(knob_report_top);
-    std::partial_sort_copy(cache_map.begin(), cache_map.end(),
-                           top.begin(), top.end(), cmp_distant_refs);
-    std::cerr << "Top " << top.size() << " distant repeatedly referenced cache lines\n";
-    std::cerr << std::setw(18) << "cache line"
-              << ": " << std::setw(17) << "#references  "
-              << std::setw(14) << "#distant refs" << "\n";
-    for (std::vector<std::pair<addr_t, line_ref_t*> >::iterator it = top.begin();
-         it != top.end(); ++it) {
-        if (it->second == NULL) // Very small app.
-            break;
-        std::cerr << std::setw(18) << std::hex << std::showbase
-                  << (it->first << line_size_bits)
-                  << ": " << std::setw(12) << std::dec << it->second->total_refs
-                  << ", " << std::setw(12) << std::dec << it->second->distant_refs
+    if (knob_report_miss_ratio_curve) {
+        // A fully associative LRU cache of n lines hits exactly the references
+        // with a distance below n.  First references always miss.
+        // Sampled distances are multiples of sample_weight, so we omit the
+        // sizes below it, which sampling cannot tell apart.
+        int_least64_t first_size = 1;
+        while (first_size < sample_weight)
+            first_size *= 2;
+        std::cerr << "\n";
+        std::cerr << "Miss ratio curve for fully associative LRU caches:\n";
+        std::cerr << std::setw(12) << "Cache lines" << std::setw(11) << "Miss rate"
                   << "\n";
+        for (int_least64_t size = first_size; ; size *= 2) {
+            double misses = unique_lines;
+            for (std::map<int_least64_t, double>::iterator it =
+                     dist_map.lower_bound(size);
+                 it != dist_map.end(); ++it)
+                misses += it->second;
+            std::cerr << std::setw(12) << size << std::setw(10)
+                      << (refs == 0 ? 0. : misses / refs * 100.) << "%\n";
+            if (size >= unique_lines)
+                break;
+        }
     }
 
+    std::cerr << "\n";
+    std::cerr << "Reuse distance threshold = " << knob_distance_threshold
+              << " cache lines\n";
+    print_top_lines("frequently referenced cache lines", cmp_total_refs);
+    print_top_lines("distant repeatedly referenced cache lines", cmp_distant_refs);
+
     return true;
 }
+
+// The initial sizes of line_ref_tree_t's hash table and tree.
+static const int TREE_TABLE_BITS = 16;
+static const uint64_t TREE_SLOTS = 1 << 16;
+
+line_ref_tree_t::line_ref_tree_t(uint64_t reuse_threshold) :
+    cur_time(0), unique_lines(0), live_lines(0), threshold(reuse_threshold),
+    table((size_t)1 << TREE_TABLE_BITS, 0), table_bits(TREE_TABLE_BITS),
+    tree(TREE_SLOTS, 0), owner(TREE_SLOTS, 0), next_slot(0), last_line(0)
+{
+}
+
+int_least64_t
+line_ref_tree_t::access(addr_t tag)
+{
+    // Renumber first so that the slot read below is current.
+    if (next_slot == tree.size())
+        renumber_slots();
+    bool added;
+    size_t idx = find_or_add(tag, &added);
+    if (added) {
+        ++unique_lines;
+        ++live_lines;
+        take_slot(idx);
+        return -1;
+    }
+    line_info_t &line = lines[idx];
+    ++line.total_refs;
+    if (idx == last_line)
+        return 0;
+    int_least64_t dist = live_lines - count_through(line.time_stamp);
+    if ((uint64_t)dist > threshold)
+        ++line.distant_refs;
+    add_to_tree(line.time_stamp, -1);
+    take_slot(idx);
+    return dist;
+}
+
+// Fibonacci hashing spreads the consecutive tags of a streaming access
+// pattern across the table.
+#define TREE_TABLE_HASH(tag, bits) \
+    ((size_t)(((uint64_t)(tag) * 0x9e3779b97f4a7c15ULL) >> (64 - (bits))))
+
+size_t
+line_ref_tree_t::find_or_add(addr_t tag, bool *added)
+{
+    size_t mask = table.size() - 1;
+    for (size_t i = TREE_TABLE_HASH(tag, table_bits); ; i = (i + 1) & mask) {
+        uint32_t entry = table[i];
+        if (entry == 0) {
+            size_t idx;
+            if (free_lines.empty()) {
+                idx = lines.size();
+                lines.push_back(line_info_t(tag));
+            } else {
+                idx = free_lines.back();
+                free_lines.pop_back();
+                lines[idx] = line_info_t(tag);
+            }
+            table[i] = (uint32_t)(idx + 1);
+            // Keep the table at most half full for short probe sequences.
+            if (lines.size() * 2 > table.size())
+                grow_table();
+            *added = true;
+            return idx;
+        }
+        if (lines[entry - 1].tag == tag) {
+            *added = false;
+            return entry - 1;
+        }
+    }
+}
+
+void
+line_ref_tree_t::grow_table()
+{
+    ++table_bits;
+    table.assign((size_t)1 << table_bits, 0);
+    size_t mask = table.size() - 1;
+    for (size_t idx = 0; idx < lines.size(); ++idx) {
+        if (lines[idx].time_stamp == LINE_REMOVED)
+            continue;
+        size_t i = TREE_TABLE_HASH(lines[idx].tag, table_bits);
+        while (table[i] != 0)
+            i = (i + 1) & mask;
+        table[i] = (uint32_t)(idx + 1);
+    }
+}
+
+void
+line_ref_tree_t::remove(size_t idx)
+{
+    line_info_t &line = lines[idx];
+    add_to_tree(line.time_stamp, -1);
+    line.time_stamp = LINE_REMOVED;
+    --live_lines;
+    if (idx == last_line)
+        last_line = (size_t)-1;
+    free_lines.push_back((uint32_t)idx);
+    // Remove it from the table, moving any later entry of its probe sequence
+    // back into the hole so that lookups need no tombstones.
+    size_t mask = table.size() - 1;
+    size_t hole = TREE_TABLE_HASH(line.tag, table_bits);
+    while (table[hole] != idx + 1)
+        hole = (hole + 1) & mask;
+    table[hole] = 0;
+    for (size_t i = (hole + 1) & mask; table[i] != 0; i = (i + 1) & mask) {
+        size_t home = TREE_TABLE_HASH(lines[table[i] - 1].tag, table_bits);
+        // The entry stays if its home is cyclically within (hole, i].
+        if (hole < i ? (home > hole && home <= i) : (home > hole || home <= i))
+            continue;
+        table[hole] = table[i];
+        table[i] = 0;
+        hole = i;
+    }
+}
+
+void
+line_ref_tree_t::take_slot(size_t idx)
+{
+    lines[idx].time_stamp = next_slot;
+    owner[next_slot] = (uint32_t)idx;
+    add_to_tree(next_slot, 1);
+    ++next_slot;
+    ++cur_time;
+    last_line = idx;
+}
+
+void
+line_ref_tree_t::renumber_slots()
+{
+    // A slot is live if its owner has not moved on to a later one.  We give
+    // the live ones consecutive slots from 0 and leave as many free, so this
+    // linear pass is amortized over at least as many references.
+    uint64_t size = std::max(TREE_SLOTS, 2 * live_lines);
+    std::vector<uint32_t> new_owner(size, 0);
+    uint64_t count = 0;
+    for (uint64_t slot = 0; slot < next_slot; ++slot) {
+        line_info_t &line = lines[owner[slot]];
+        if (line.time_stamp == slot) {
+            line.time_stamp = count;
+            new_owner[count++] = owner[slot];
+        }
+    }
+    owner.swap(new_owner);
+    next_slot = count;
+    // Build the tree over count ones in linear time.
+    tree.assign(size, 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        if (i < count)
+            ++tree[i];
+        uint64_t parent = i | (i + 1);
+        if (parent < size)
+            tree[parent] += tree[i];
+    }
+    if (DEBUG_VERBOSE(2)) {
+        std::cerr << "Renumbered " << count << " reuse distance slots into "
+                  << size << "\n";
+    }
+}
+
+void
+line_ref_tree_t::add_to_tree(uint64_t slot, int delta)
+{
+    for (uint64_t i = slot; i < tree.size(); i |= i + 1)
+        tree[i] += delta;
+}
+
+uint64_t
+line_ref_tree_t::count_through(uint64_t slot)
+{
+    uint64_t sum = 0;
+    for (int_least64_t i = (int_least64_t)slot; i >= 0; i = (i & (i + 1)) - 1)
+        sum += tree[i];
+    return sum;
+}
@@ -38,6 +38,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <assert.h>
 #include <iostream>
 #include "../analysis_tool.h"
@@ -55,6 +56,8 @@
 
 struct line_ref_t;
 struct line_ref_list_t;
+struct line_info_t;
+struct line_ref_tree_t;
 
 class reuse_distance_t : public analysis_tool_t
 {
@@ -65,7 +68,11 @@ class reuse_distance_t : public analysis_tool_t
                      unsigned int report_top,
                      unsigned int skip_list_distance,
                      bool verify_skip,
-                     unsigned int verbose);
+                     unsigned int verbose,
+                     bool use_fenwick = false,
+                     unsigned int sample_period = 1,
+                     unsigned int sample_max_lines = 0,
+                     bool report_miss_ratio_curve = false);
     virtual ~reuse_distance_t();
     virtual bool process_memref(const memref_t &memref);
     virtual bool print_results();
@@ -76,13 +83,40 @@ class reuse_distance_t : public analysis_tool_t
  protected:
     /* XXX i#2020: use unsorted_map (C++11) for faster lookup */
     std::map<addr_t, line_ref_t*> cache_map;
-    // This is our reuse distance histogram.
-    std::map<int_least64_t, int_least64_t> dist_map;
+    // This is our reuse distance histogram.  The counts are weighted by the
+    // inverse of the sampling rate, and are thus integers unless sampling.
+    std::map<int_least64_t, double> dist_map;
+    // Exactly one of these two engines is used: see -reuse_fenwick.
     line_ref_list_t *ref_list;
+    line_ref_tree_t *ref_tree;
+
+    // Spatial sampling as in "Efficient MRC Construction with SHARDS" by
+    // Waldspurger et al., FAST 2015: only the lines whose tag hashes below
+    // sample_threshold out of SAMPLE_MODULUS are tracked.  Their distances
+    // and counts are scaled by sample_weight, the inverse of the rate.
+    // With a maximum number of lines, the threshold is halved, and the lines
+    // above it dropped, whenever more lines than that are tracked.
+    bool sampling;
+    uint64_t sample_threshold;
+    double sample_weight;
+    // The scaled estimates of the values line_ref_list_t keeps exactly.
+    double est_refs;
+    double est_unique_accesses;
+    double est_unique_lines;
+
+    void shrink_sample();
+
+    void add_top_line(std::vector<line_info_t> &top, const line_info_t &line,
+                      bool (*cmp)(const line_info_t &, const line_info_t &));
+    void print_top_lines(const std::string &title,
+                         bool (*cmp)(const line_info_t &, const line_info_t &));
 
     unsigned int knob_line_size;
     bool knob_report_histogram;
+    unsigned int knob_distance_threshold;
     unsigned int knob_report_top; /* most accessed lines */
+    unsigned int knob_sample_max_lines;
+    bool knob_report_miss_ratio_curve;
 
     uint64_t time_stamp;
     size_t line_size_bits;
@@ -330,4 +364,86 @@ struct line_ref_list_t
     }
 };
 
+// The time_stamp of an entry of line_ref_tree_t::lines whose line was removed.
+static const uint64_t LINE_REMOVED = ~(uint64_t)0;
+
+// The per-line data of line_ref_tree_t.  The order of the lines lives in
+// the tree, so unlike line_ref_t this needs no links.
+struct line_info_t
+{
+    addr_t tag;
+    uint64_t time_stamp;      // the tree slot of the most recent reference, or
+                              // LINE_REMOVED
+    uint64_t total_refs;      // the total number of references on this line
+    uint64_t distant_refs;    // the total number of distant references on this line
+
+    line_info_t() : tag(0), time_stamp(0), total_refs(0), distant_refs(0)
+    {
+    }
+    explicit line_info_t(addr_t val) :
+        tag(val), time_stamp(0), total_refs(1), distant_refs(0)
+    {
+    }
+};
+
+// An alternative to line_ref_list_t whose exact reuse distances take
+// O(log n) time for n unique lines, however far apart the references are.
+// A line is found through an open-addressing hash table.  Each line's most
+// recent reference holds a time slot, and a Fenwick tree over the slots
+// counts the lines holding each one: the reuse distance of a line is the
+// number of lines whose slot is later than its own.  When the slots run out
+// the live ones are renumbered from 0 in the same order.
+// The results match line_ref_list_t's, including cur_time, which does not
+// advance on a repeated reference to the most recent line.
+// Lines can also be removed, as sampling does, which keeps the memory
+// proportional to the lines being tracked.
+struct line_ref_tree_t
+{
+    // Removed entries have a time_stamp of LINE_REMOVED and are reused.
+    std::vector<line_info_t> lines;
+    uint64_t cur_time;      // current time stamp
+    uint64_t unique_lines;  // the total number of unique cache lines accessed
+    uint64_t live_lines;    // the number of lines currently tracked
+    uint64_t threshold;     // the reuse distance threshold
+
+    explicit line_ref_tree_t(uint64_t reuse_threshold);
+
+    // Returns the reuse distance of this reference to tag, or -1 if tag is
+    // not tracked: i.e., this is its first reference or it was removed.
+    int_least64_t
+    access(addr_t tag);
+
+    // Stops tracking lines[idx].  It no longer counts toward any distance.
+    void
+    remove(size_t idx);
+
+ private:
+    size_t
+    find_or_add(addr_t tag, bool *added);
+
+    void
+    grow_table();
+
+    void
+    take_slot(size_t line);
+
+    void
+    renumber_slots();
+
+    // Fenwick tree operations over slots.
+    void
+    add_to_tree(uint64_t slot, int delta);
+
+    uint64_t
+    count_through(uint64_t slot);
+
+    std::vector<uint32_t> table;  // 1 + an index into lines, or 0 if empty
+    int table_bits;
+    std::vector<uint32_t> tree;   // the Fenwick tree of slot counts
+    std::vector<uint32_t> owner;  // the line that took each slot
+    uint64_t next_slot;
+    size_t last_line;             // the most recently referenced line
+    std::vector<uint32_t> free_lines; // removed entries of lines
+};
+
 #endif /* _REUSE_DISTANCE_H_ */
@@ -45,6 +45,10 @@ reuse_distance_tool_create(unsigned int line_size = 64,
                            unsigned int report_top = 10,
                            unsigned int skip_list_distance = 500,
                            bool verify_skip = false,
-                           unsigned int verbose = 0);
+                           unsigned int verbose = 0,
+                           bool use_fenwick = false,
+                           unsigned int sample_period = 1,
+                           unsigned int sample_max_lines = 0,
+                           bool report_miss_ratio_curve = false);
 
 #endif /* _REUSE_DISTANCE_CREATE_H_ */
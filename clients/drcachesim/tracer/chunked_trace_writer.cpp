@@ -0,0 +1,166 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <zlib.h>
+#include "chunked_trace_writer.h"
+
+chunked_trace_writer_t::chunked_trace_writer_t(uint64_t chunk_entries_in) :
+    chunk_entries(chunk_entries_in), offset(0), num_entries(0), cur_tid(0), cur_pid(0)
+{
+    if (chunk_entries == 0)
+        chunk_entries = 1;
+}
+
+chunked_trace_writer_t::~chunked_trace_writer_t()
+{
+    // We deliberately do not write the index if close() was not called, so an
+    // interrupted conversion never looks complete.
+}
+
+bool
+chunked_trace_writer_t::open(const std::string &path)
+{
+    out.open(path.c_str(), std::ofstream::binary);
+    if (!out)
+        return false;
+    chunked_trace_header_t header;
+    header.magic = CHUNKED_TRACE_MAGIC;
+    header.version = CHUNKED_TRACE_VERSION;
+    header.chunk_entries = chunk_entries;
+    if (!out.write((char*)&header, sizeof(header)))
+        return false;
+    offset = sizeof(header);
+    chunk.reserve((size_t)chunk_entries);
+    return true;
+}
+
+bool
+chunked_trace_writer_t::write_chunk()
+{
+    if (chunk.empty())
+        return true;
+    uLong size = (uLong)(chunk.size() * sizeof(trace_entry_t));
+    uLongf compressed_size = compressBound(size);
+    compressed.resize(compressed_size);
+    if (compress((Bytef*)&compressed[0], &compressed_size, (Bytef*)&chunk[0],
+                 size) != Z_OK ||
+        !out.write(&compressed[0], compressed_size))
+        return false;
+    cur_chunk.offset = offset;
+    cur_chunk.compressed_size = compressed_size;
+    cur_chunk.num_entries = chunk.size();
+    index.push_back(cur_chunk);
+    offset += compressed_size;
+    chunk.clear();
+    return true;
+}
+
+bool
+chunked_trace_writer_t::write(const trace_entry_t *entries, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const trace_entry_t &entry = entries[i];
+        // The reader of a chunk needs the instr before a bundle or a data
+        // reference, and the start of a flush before its end, so we never
+        // split those.
+        if (chunk.size() >= chunk_entries &&
+            entry.type > TRACE_TYPE_PREFETCH_INSTR &&
+            entry.type != TRACE_TYPE_INSTR_BUNDLE &&
+            entry.type != TRACE_TYPE_INSTR_FLUSH_END &&
+            entry.type != TRACE_TYPE_DATA_FLUSH_END) {
+            if (!write_chunk())
+                return false;
+        }
+        if (chunk.empty()) {
+            cur_chunk.num_refs = 0;
+            cur_chunk.tid = cur_tid;
+            cur_chunk.pid = cur_pid;
+        }
+        chunk.push_back(entry);
+        ++num_entries;
+        // We track the thread and process the same way reader_t does.
+        if (entry.type == TRACE_TYPE_THREAD || entry.type == TRACE_TYPE_THREAD_EXIT) {
+            cur_tid = entry.addr;
+            std::map<uint64_t, size_t>::iterator it = tid2thread.find(cur_tid);
+            if (it != tid2thread.end())
+                cur_pid = threads[it->second].pid;
+            else {
+                cur_pid = 0;
+                // The converter's very first thread entry has an invalid id.
+                if (cur_tid != 0) {
+                    chunked_trace_thread_t thread = {cur_tid, 0, 0, index.size()};
+                    tid2thread[cur_tid] = threads.size();
+                    threads.push_back(thread);
+                }
+            }
+        } else if (entry.type == TRACE_TYPE_PID) {
+            cur_pid = entry.addr;
+            std::map<uint64_t, size_t>::iterator it = tid2thread.find(cur_tid);
+            if (it != tid2thread.end())
+                threads[it->second].pid = cur_pid;
+        } else if (entry.type == TRACE_TYPE_INSTR_BUNDLE)
+            cur_chunk.num_refs += entry.size;
+        else if (type_is_instr((trace_type_t)entry.type) ||
+                 entry.type <= TRACE_TYPE_PREFETCH_INSTR)
+            ++cur_chunk.num_refs;
+    }
+    return true;
+}
+
+void
+chunked_trace_writer_t::set_thread_timestamp(uint64_t tid, uint64_t timestamp)
+{
+    std::map<uint64_t, size_t>::iterator it = tid2thread.find(tid);
+    if (it != tid2thread.end())
+        threads[it->second].first_timestamp = timestamp;
+}
+
+bool
+chunked_trace_writer_t::close()
+{
+    if (!write_chunk())
+        return false;
+    chunked_trace_trailer_t trailer;
+    trailer.index_offset = offset;
+    trailer.num_chunks = index.size();
+    trailer.num_threads = threads.size();
+    trailer.num_entries = num_entries;
+    trailer.magic = CHUNKED_TRACE_MAGIC;
+    if ((!index.empty() &&
+         !out.write((char*)&index[0], index.size() * sizeof(index[0]))) ||
+        (!threads.empty() &&
+         !out.write((char*)&threads[0], threads.size() * sizeof(threads[0]))) ||
+        !out.write((char*)&trailer, sizeof(trailer)))
+        return false;
+    out.close();
+    return !out.fail();
+}
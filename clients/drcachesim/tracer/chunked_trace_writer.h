@@ -0,0 +1,78 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* chunked_trace_writer: writes a trace_entry_t stream as a chunked trace file
+ * (see chunked_trace_header_t), for reading by chunked_file_reader_t.
+ */
+
+#ifndef _CHUNKED_TRACE_WRITER_H_
+#define _CHUNKED_TRACE_WRITER_H_ 1
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "../common/trace_entry.h"
+
+class chunked_trace_writer_t
+{
+ public:
+    // The default amounts to 12MB of 64-bit entries per chunk.
+    explicit chunked_trace_writer_t(uint64_t chunk_entries = 1 << 20);
+    ~chunked_trace_writer_t();
+    bool open(const std::string &path);
+    bool write(const trace_entry_t *entries, size_t count);
+    // Records the timestamp at which a thread starts, for the index.
+    void set_thread_timestamp(uint64_t tid, uint64_t timestamp);
+    // Writes out the last chunk and the index.  Until this is called the file
+    // is not complete.
+    bool close();
+
+ private:
+    bool write_chunk();
+
+    std::ofstream out;
+    uint64_t chunk_entries;
+    std::vector<trace_entry_t> chunk;
+    std::vector<char> compressed;
+    std::vector<chunked_trace_chunk_t> index;
+    std::vector<chunked_trace_thread_t> threads;
+    // Maps a thread id to its entry in threads.
+    std::map<uint64_t, size_t> tid2thread;
+    uint64_t offset;
+    uint64_t num_entries;
+    uint64_t cur_tid;
+    uint64_t cur_pid;
+    chunked_trace_chunk_t cur_chunk;
+};
+
+#endif /* _CHUNKED_TRACE_WRITER_H_ */
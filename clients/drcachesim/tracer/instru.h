@@ -80,6 +80,10 @@ public:
     virtual int instrument_ibundle(void *drcontext, instrlist_t *ilist, instr_t *where,
                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
                                    instr_t **delay_instrs, int num_delay_instrs) = 0;
+    // Adds an entry with app's PC but no instr fetch, for its next data reference.
+    virtual int instrument_no_fetch(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                                    instr_t *app) = 0;
 
     virtual void bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded) = 0;
@@ -127,6 +131,9 @@ public:
     virtual int instrument_ibundle(void *drcontext, instrlist_t *ilist, instr_t *where,
                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
                                    instr_t **delay_instrs, int num_delay_instrs);
+    virtual int instrument_no_fetch(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                                    instr_t *app);
 
     virtual void bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded);
@@ -176,6 +183,9 @@ public:
     virtual int instrument_ibundle(void *drcontext, instrlist_t *ilist, instr_t *where,
                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
                                    instr_t **delay_instrs, int num_delay_instrs);
+    virtual int instrument_no_fetch(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                    reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                                    instr_t *app);
 
     virtual void bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded);
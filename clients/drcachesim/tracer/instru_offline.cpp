@@ -319,6 +319,17 @@ offline_instru_t::instrument_ibundle(void *drcontext, instrlist_t *ilist, instr_
     return adjust;
 }
 
+int
+offline_instru_t::instrument_no_fetch(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                      reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                                      instr_t *app)
+{
+    // The post-processor supplies the PC of every data reference.  This is only
+    // used by -L0_filter, which is not supported offline.
+    DR_ASSERT(false);
+    return adjust;
+}
+
 void
 offline_instru_t::bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded)
@@ -339,6 +339,19 @@ online_instru_t::instrument_ibundle(void *drcontext, instrlist_t *ilist, instr_t
     return adjust;
 }
 
+int
+online_instru_t::instrument_no_fetch(void *drcontext, instrlist_t *ilist, instr_t *where,
+                                     reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                                     instr_t *app)
+{
+    insert_save_type_and_size(drcontext, ilist, where, reg_ptr, reg_tmp,
+                              TRACE_TYPE_INSTR_NO_FETCH,
+                              (ushort)instr_length(drcontext, app), adjust);
+    insert_save_pc(drcontext, ilist, where, reg_ptr, reg_tmp,
+                   instr_get_app_pc(app), adjust);
+    return (adjust + sizeof(trace_entry_t));
+}
+
 void
 online_instru_t::bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded)
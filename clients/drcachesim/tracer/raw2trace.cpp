@@ -42,10 +42,18 @@
 #include "dr_frontend.h"
 #include "raw2trace.h"
 #include "instru.h"
+#ifdef HAS_ZLIB
+# include "chunked_trace_writer.h"
+#endif
 #include "../common/memref.h"
 #include "../common/trace_entry.h"
 #include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <thread>
 #include <vector>
+#include <stdio.h> /* remove */
 
 #ifdef UNIX
 # include <dirent.h> /* opendir, readdir */
@@ -66,6 +74,13 @@ extern droption_t<unsigned int> op_verbose;
 // XXX: DR should export this
 #define INVALID_THREAD_ID 0
 
+// The number of offline entries read from a thread file at once.
+#define INPUT_WINDOW_ENTRIES (8 * 1024)
+
+// The number of trace entries written to an output file at once.  This is
+// also the size of each copy from a converted thread file to the output file.
+#define OUTPUT_BUFFER_ENTRIES (64 * 1024)
+
 #define FATAL_ERROR(msg, ...) do { \
     fprintf(stderr, "ERROR: " msg "\n", ##__VA_ARGS__);    \
     fflush(stderr); \
@@ -94,6 +109,53 @@ extern droption_t<unsigned int> op_verbose;
     } \
 } while (0)
 
+/***************************************************************************
+ * Output buffering
+ */
+
+trace_buffer_t::trace_buffer_t(std::ostream *out_in)
+    : out(out_in), chunks(NULL), entries(OUTPUT_BUFFER_ENTRIES), used(0), count(0)
+{
+}
+
+trace_buffer_t::trace_buffer_t(chunked_trace_writer_t *chunks_in)
+    : out(NULL), chunks(chunks_in), entries(OUTPUT_BUFFER_ENTRIES), used(0), count(0)
+{
+}
+
+trace_entry_t *
+trace_buffer_t::reserve(size_t num)
+{
+    CHECK(num <= entries.size(), "Output reservation is too large");
+    if (used + num > entries.size())
+        flush();
+    return &entries[used];
+}
+
+void
+trace_buffer_t::commit(trace_entry_t *end)
+{
+    size_t num = end - &entries[used];
+    CHECK(used + num <= entries.size(), "Output buffer overflow");
+    used += num;
+    count += num;
+}
+
+void
+trace_buffer_t::flush()
+{
+    if (used == 0)
+        return;
+    if (chunks != NULL) {
+#ifdef HAS_ZLIB
+        if (!chunks->write(&entries[0], used))
+            FATAL_ERROR("Failed to write to output file");
+#endif
+    } else if (!out->write((char*)&entries[0], used * sizeof(trace_entry_t)))
+        FATAL_ERROR("Failed to write to output file");
+    used = 0;
+}
+
 /***************************************************************************
  * Module list
  */
@@ -194,12 +256,13 @@ raw2trace_t::open_thread_log_file(const char *basename)
         FATAL_ERROR("Failed to get full path of file %s", basename);
     }
     NULL_TERMINATE_BUFFER(path);
-    thread_files.push_back(new std::ifstream(path, std::ifstream::binary));
-    if (!(*thread_files.back()))
+    threads.push_back(raw2trace_thread_t());
+    threads.back().in = new std::ifstream(path, std::ifstream::binary);
+    if (!(*threads.back().in))
         FATAL_ERROR("Failed to open thread log file %s", path);
     // Check version header.
     offline_entry_t ver_entry;
-    if (!thread_files.back()->read((char*)&ver_entry, sizeof(ver_entry)))
+    if (!threads.back().in->read((char*)&ver_entry, sizeof(ver_entry)))
         FATAL_ERROR("Unable to read thread log file %s", path);
     if (ver_entry.extended.type != OFFLINE_TYPE_EXTENDED ||
         ver_entry.extended.ext != OFFLINE_EXT_TYPE_HEADER)
@@ -208,6 +271,7 @@ raw2trace_t::open_thread_log_file(const char *basename)
         FATAL_ERROR("Version mismatch: expect %d vs %d in file %s",
                     OFFLINE_FILE_VERSION, (int)ver_entry.extended.value, path);
     }
+    threads.back().in_buf.resize(INPUT_WINDOW_ENTRIES);
     VPRINT(1, "Opened thread log file %s\n", path);
 }
 
@@ -271,13 +335,128 @@ instr_is_rep_string(instr_t *instr)
 #endif
 }
 
+static trace_entry_t
+memref_template(instr_t *instr, opnd_t ref, bool write)
+{
+    trace_entry_t entry;
+    if (instr_is_prefetch(instr)) {
+        entry.type = instru_t::instr_to_prefetch_type(instr);
+        entry.size = 1;
+    } else if (instru_t::instr_is_flush(instr)) {
+        entry.type = TRACE_TYPE_DATA_FLUSH;
+        entry.size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
+    } else {
+        if (write)
+            entry.type = TRACE_TYPE_WRITE;
+        else
+            entry.type = TRACE_TYPE_READ;
+        entry.size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
+    }
+    entry.addr = 0;
+    return entry;
+}
+
+// Decoding dominates the conversion time, so we decode each block only the first
+// time we see it.  A block always starts at the same pc in the same module, so
+// a cached block covering at least instr_count instrs gives the same entries.
+const bb_template_t *
+raw2trace_t::get_bb_template(bb_cache_t *cache, offline_entry_t *in_entry)
+{
+    uint instr_count = in_entry->pc.instr_count;
+    const module_t &mod = modvec[in_entry->pc.modidx];
+    app_pc start_pc = mod.map_base + in_entry->pc.modoffs;
+    bb_cache_t::iterator existing = cache->find(start_pc);
+    if (existing != cache->end()) {
+        if (existing->second->instrs.size() >= instr_count ||
+            existing->second->invalid_end)
+            return existing->second;
+        // We saw a shorter execution of this block: decode it again.
+        delete existing->second;
+        cache->erase(existing);
+    }
+
+    bb_template_t *tmpl = new bb_template_t;
+    tmpl->invalid_end = false;
+    instr_t instr;
+    app_pc pc, decode_pc = start_pc;
+    instr_init(dcontext, &instr);
+    for (uint i = 0; i < instr_count; ++i) {
+        instr_reset(dcontext, &instr);
+        // We assume the default ISA mode and currently require the 32-bit
+        // postprocessor for 32-bit applications.
+        pc = decode(dcontext, decode_pc, &instr);
+        if (pc == NULL || !instr_valid(&instr)) {
+            tmpl->invalid_end = true;
+            break;
+        }
+        DO_VERBOSE(3, {
+            instr_set_translation(&instr, decode_pc - mod.map_base + mod.orig_base);
+            dr_print_instr(dcontext, STDOUT, &instr, "");
+        });
+        bb_instr_t bb_instr;
+        bb_instr.entry.type = instru_t::instr_to_instr_type(&instr);
+        bb_instr.entry.size = (ushort) instr_length(dcontext, &instr);
+        bb_instr.entry.addr = (addr_t) (decode_pc - start_pc);
+        bb_instr.rep_string = instr_is_rep_string(&instr);
+        bb_instr.cti = instr_is_cti(&instr);
+        bb_instr.num_memrefs = 0;
+        if (instr_reads_memory(&instr) || instr_writes_memory(&instr)) { // Check OP_lea.
+            for (int i = 0; i < instr_num_srcs(&instr); i++) {
+                if (opnd_is_memory_reference(instr_get_src(&instr, i))) {
+                    tmpl->memrefs.push_back
+                        (memref_template(&instr, instr_get_src(&instr, i), false));
+                    ++bb_instr.num_memrefs;
+                }
+            }
+            for (int i = 0; i < instr_num_dsts(&instr); i++) {
+                if (opnd_is_memory_reference(instr_get_dst(&instr, i))) {
+                    tmpl->memrefs.push_back
+                        (memref_template(&instr, instr_get_dst(&instr, i), true));
+                    ++bb_instr.num_memrefs;
+                }
+            }
+        }
+        tmpl->instrs.push_back(bb_instr);
+        decode_pc = pc;
+    }
+    instr_free(dcontext, &instr);
+    (*cache)[start_pc] = tmpl;
+    return tmpl;
+}
+
+// Reads the next entry of the thread file from its input window, refilling the
+// window when it runs out.  Returns false at the end of the file or on an error.
+bool
+raw2trace_t::read_entry(raw2trace_thread_t *thread, offline_entry_t *entry)
+{
+    if (thread->in_pos == thread->in_count) {
+        thread->in->read((char*)&thread->in_buf[0],
+                         thread->in_buf.size() * sizeof(offline_entry_t));
+        // A partial trailing entry is dropped, just like a failed read of it.
+        thread->in_count = (size_t)thread->in->gcount() / sizeof(offline_entry_t);
+        thread->in_pos = 0;
+        if (thread->in_count == 0)
+            return false;
+    }
+    *entry = thread->in_buf[thread->in_pos++];
+    return true;
+}
+
+// Puts back the entry last returned by read_entry().
+void
+raw2trace_t::unread_entry(raw2trace_thread_t *thread)
+{
+    CHECK(thread->in_pos > 0, "Nothing to put back");
+    --thread->in_pos;
+}
+
 trace_entry_t *
-raw2trace_t::append_memref(trace_entry_t *buf_in, uint tidx, instr_t *instr,
-                           opnd_t ref, bool write)
+raw2trace_t::append_memref(trace_entry_t *buf_in, raw2trace_thread_t *thread,
+                           const trace_entry_t &ref)
 {
     trace_entry_t *buf = buf_in;
     offline_entry_t in_entry;
-    if (!thread_files[tidx]->read((char*)&in_entry, sizeof(in_entry)))
+    if (!read_entry(thread, &in_entry))
         FATAL_ERROR("Trace ends mid-block");
     if (in_entry.addr.type != OFFLINE_TYPE_MEMREF &&
         in_entry.addr.type != OFFLINE_TYPE_MEMREF_HIGH) {
@@ -288,23 +467,11 @@ raw2trace_t::append_memref(trace_entry_t *buf_in, uint tidx, instr_t *instr,
         VPRINT(4, "Missing memref (next type is 0x" ZHEX64_FORMAT_STRING ")\n",
                in_entry.combined_value);
         // Put back the entry.
-        thread_files[tidx]->seekg(-(std::streamoff)sizeof(in_entry),
-                                  thread_files[tidx]->cur);
+        unread_entry(thread);
         return buf;
     }
-    if (instr_is_prefetch(instr)) {
-        buf->type = instru_t::instr_to_prefetch_type(instr);
-        buf->size = 1;
-    } else if (instru_t::instr_is_flush(instr)) {
-        buf->type = TRACE_TYPE_DATA_FLUSH;
-        buf->size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
-    } else {
-        if (write)
-            buf->type = TRACE_TYPE_WRITE;
-        else
-            buf->type = TRACE_TYPE_READ;
-        buf->size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
-    }
+    buf->type = ref.type;
+    buf->size = ref.size;
     // We take the full value, to handle low or high.
     buf->addr = (addr_t) in_entry.combined_value;
     VPRINT(4, "Appended memref to " PFX "\n", (ptr_uint_t)buf->addr);
@@ -313,15 +480,14 @@ raw2trace_t::append_memref(trace_entry_t *buf_in, uint tidx, instr_t *instr,
 }
 
 bool
-raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry)
+raw2trace_t::append_bb_entries(raw2trace_thread_t *thread, bb_cache_t *cache,
+                               trace_buffer_t *out, offline_entry_t *in_entry)
 {
     uint instr_count = in_entry->pc.instr_count;
-    instr_t instr;
-    trace_entry_t buf_start[MAX_COMBINED_ENTRIES];
-    app_pc start_pc = modvec[in_entry->pc.modidx].map_base + in_entry->pc.modoffs;
-    app_pc pc, decode_pc = start_pc;
+    const module_t &mod = modvec[in_entry->pc.modidx];
+    app_pc start_pc = mod.map_base + in_entry->pc.modoffs;
     if ((in_entry->pc.modidx == 0 && in_entry->pc.modoffs == 0) ||
-        modvec[in_entry->pc.modidx].map_base == NULL) {
+        mod.map_base == NULL) {
         // FIXME i#2062: add support for code not in a module (vsyscall, JIT, etc.).
         // Once that support is in we can remove the bool return value and handle
         // the memrefs up here.
@@ -330,66 +496,46 @@ raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry)
     } else {
         VPRINT(3, "Appending %u instrs in bb " PFX " in mod %u +" PIFX " = %s\n",
                instr_count, (ptr_uint_t)start_pc, (uint)in_entry->pc.modidx,
-               (ptr_uint_t)in_entry->pc.modoffs, modvec[in_entry->pc.modidx].path);
+               (ptr_uint_t)in_entry->pc.modoffs, mod.path);
     }
-    instr_init(dcontext, &instr);
+    const bb_template_t *tmpl = get_bb_template(cache, in_entry);
+    app_pc orig_start = mod.orig_base + in_entry->pc.modoffs;
+    const trace_entry_t *ref = tmpl->memrefs.empty() ? NULL : &tmpl->memrefs[0];
     for (uint i = 0; i < instr_count; ++i) {
+        trace_entry_t *buf_start = out->reserve(MAX_COMBINED_ENTRIES);
         trace_entry_t *buf = buf_start;
-        app_pc orig_pc = decode_pc - modvec[in_entry->pc.modidx].map_base +
-            modvec[in_entry->pc.modidx].orig_base;
         bool skip_instr = false;
-        instr_reset(dcontext, &instr);
-        // We assume the default ISA mode and currently require the 32-bit
-        // postprocessor for 32-bit applications.
-        pc = decode(dcontext, decode_pc, &instr);
-        if (pc == NULL || !instr_valid(&instr)) {
+        if (i >= tmpl->instrs.size()) {
             WARN("Encountered invalid/undecodable instr @ %s+" PFX,
-                 modvec[in_entry->pc.modidx].path, (ptr_uint_t)in_entry->pc.modoffs);
+                 mod.path, (ptr_uint_t)in_entry->pc.modoffs);
             break;
         }
-        CHECK(!instr_is_cti(&instr) || i == instr_count - 1, "invalid cti");
-        if (instr_is_rep_string(&instr)) {
+        const bb_instr_t &bb_instr = tmpl->instrs[i];
+        CHECK(!bb_instr.cti || i == instr_count - 1, "invalid cti");
+        if (bb_instr.rep_string) {
             // We want it to look like the original rep string instead of the
             // drutil-expanded loop.
-            if (!prev_instr_was_rep_string)
-                prev_instr_was_rep_string = true;
+            if (!thread->prev_instr_was_rep_string)
+                thread->prev_instr_was_rep_string = true;
             else
                 skip_instr = true;
         } else
-            prev_instr_was_rep_string = false;
+            thread->prev_instr_was_rep_string = false;
         // FIXME i#1729: make bundles via lazy accum until hit memref/end.
         if (!skip_instr) {
-            DO_VERBOSE(3, {
-                instr_set_translation(&instr, orig_pc);
-                dr_print_instr(dcontext, STDOUT, &instr, "");
-            });
-            buf->type = instru_t::instr_to_instr_type(&instr);
-            buf->size = (ushort) instr_length(dcontext, &instr);
-            buf->addr = (addr_t) orig_pc;
+            *buf = bb_instr.entry;
+            buf->addr = (addr_t) (orig_start + bb_instr.entry.addr);
             ++buf;
-        } else
-            VPRINT(3, "Skipping instr fetch for " PFX "\n", (ptr_uint_t)decode_pc);
-        decode_pc = pc;
-        // We need to interleave instrs with memrefs.
-        if (instr_reads_memory(&instr) || instr_writes_memory(&instr)) { // Check OP_lea.
-            for (int i = 0; i < instr_num_srcs(&instr); i++) {
-                if (opnd_is_memory_reference(instr_get_src(&instr, i))) {
-                    buf = append_memref(buf, tidx, &instr, instr_get_src(&instr, i),
-                                        false);
-                }
-            }
-            for (int i = 0; i < instr_num_dsts(&instr); i++) {
-                if (opnd_is_memory_reference(instr_get_dst(&instr, i))) {
-                    buf = append_memref(buf, tidx, &instr, instr_get_dst(&instr, i),
-                                        true);
-                }
-            }
+        } else {
+            VPRINT(3, "Skipping instr fetch for " PFX "\n",
+                   (ptr_uint_t)(start_pc + bb_instr.entry.addr));
         }
+        // We need to interleave instrs with memrefs.
+        for (uint j = 0; j < bb_instr.num_memrefs; j++)
+            buf = append_memref(buf, thread, *ref++);
         CHECK((size_t)(buf - buf_start) < MAX_COMBINED_ENTRIES, "Too many entries");
-        if (!out_file.write((char*)buf_start, (buf - buf_start)*sizeof(trace_entry_t)))
-            FATAL_ERROR("Failed to write to output file");
+        out->commit(buf);
     }
-    instr_free(dcontext, &instr);
     return true;
 }
 
@@ -397,95 +543,66 @@ raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry)
  * Top-level
  */
 
-void
-raw2trace_t::merge_and_process_thread_files()
+uint64
+raw2trace_t::read_timestamp(raw2trace_thread_t *thread)
+{
+    offline_entry_t entry;
+    if (!read_entry(thread, &entry))
+        FATAL_ERROR("Failed to read from input file");
+    if (entry.timestamp.type != OFFLINE_TYPE_TIMESTAMP)
+        FATAL_ERROR("Missing timestamp entry");
+    VPRINT(3, "Thread %u timestamp is @0x" ZHEX64_FORMAT_STRING "\n",
+           (uint)thread->tid, entry.timestamp.usec);
+    thread->first_timestamp = entry.timestamp.usec;
+    return entry.timestamp.usec;
+}
+
+// Converts the entries of one thread up to its next timestamp, which is returned
+// in next_timestamp, or up to its footer, in which case this returns false.
+// We convert each offline entry into a trace_entry_t.
+// We fill in instr entries and memref type and size.
+bool
+raw2trace_t::process_thread_segment(raw2trace_thread_t *thread, bb_cache_t *cache,
+                                    trace_buffer_t *out, uint64 *next_timestamp)
 {
-    // The current thread we're processing is tidx.  If it's set to thread_files.size()
-    // that means we need to pick a new thread.
-    uint tidx = (uint)thread_files.size();
-    uint thread_count = (uint)thread_files.size();
     offline_entry_t in_entry;
     online_instru_t instru(NULL);
-    bool last_bb_handled = true;
-    std::vector<thread_id_t> tids(thread_files.size(), INVALID_THREAD_ID);
-    std::vector<uint64> times(thread_files.size(), 0);
-    byte buf_base[MAX_COMBINED_ENTRIES * sizeof(trace_entry_t)];
-
-    // We read the thread files simultaneously in lockstep and merge them into
-    // a single output file in timestamp order.
-    // When a thread file runs out we leave its times[] entry as 0 and its file at eof.
-    // We convert each offline entry into a trace_entry_t.
-    // We fill in instr entries and memref type and size.
-    do {
+    while (true) {
         int size = 0;
+        byte *buf_base = (byte *) out->reserve(MAX_COMBINED_ENTRIES);
         byte *buf = buf_base;
-        if (tidx >= thread_files.size()) {
-            // Pick the next thread by looking for the smallest timestamp.
-            uint64 min_time = 0xffffffffffffffff;
-            uint next_tidx = 0;
-            for (uint i=0; i<times.size(); ++i) {
-                if (times[i] == 0 && !thread_files[i]->eof()) {
-                    offline_entry_t entry;
-                    if (!thread_files[i]->read((char*)&entry, sizeof(entry)))
-                        FATAL_ERROR("Failed to read from input file");
-                    if (entry.timestamp.type != OFFLINE_TYPE_TIMESTAMP)
-                        FATAL_ERROR("Missing timestamp entry");
-                    times[i] = entry.timestamp.usec;
-                    VPRINT(3, "Thread %u timestamp is @0x" ZHEX64_FORMAT_STRING
-                           "\n", (uint)tids[i], times[i]);
-                }
-                if (times[i] != 0 && times[i] < min_time) {
-                    min_time = times[i];
-                    next_tidx = i;
-                }
-            }
-            VPRINT(2, "Next thread in timestamp order is %u @0x" ZHEX64_FORMAT_STRING
-                   "\n", (uint)tids[next_tidx], times[next_tidx]);
-            tidx = next_tidx;
-            times[tidx] = 0; // Read from file for this thread's next timestamp.
-            size += instru.append_tid(buf, tids[tidx]);
-            // We have to write this now before we append any bb entries.
-            CHECK((uint)size < MAX_COMBINED_ENTRIES, "Too many entries");
-            if (!out_file.write((char*)buf_base, size))
-                FATAL_ERROR("Failed to write to output file");
-            buf = buf_base;
-            size = 0;
-        }
-        VPRINT(4, "About to read thread %d at pos %d\n",
-               (uint)tids[tidx], (int)thread_files[tidx]->tellg());
-        if (!thread_files[tidx]->read((char*)&in_entry, sizeof(in_entry))) {
-            if (thread_files[tidx]->eof()) {
+        VPRINT(4, "About to read thread %d\n", (uint)thread->tid);
+        if (!read_entry(thread, &in_entry)) {
+            if (thread->in->eof()) {
                 // Rather than a FATAL_ERROR we try to continue to provide partial
                 // results in case the disk was full or there was some other issue.
-                WARN("Input file for thread %d is truncated", (uint)tids[tidx]);
+                WARN("Input file for thread %d is truncated", (uint)thread->tid);
                 in_entry.extended.type = OFFLINE_TYPE_EXTENDED;
                 in_entry.extended.ext = OFFLINE_EXT_TYPE_FOOTER;
             } else
-                FATAL_ERROR("Failed to read from file for thread %d", (uint)tids[tidx]);
+                FATAL_ERROR("Failed to read from file for thread %d", (uint)thread->tid);
         }
         if (in_entry.extended.type == OFFLINE_TYPE_EXTENDED) {
             if (in_entry.extended.ext == OFFLINE_EXT_TYPE_FOOTER) {
                 // Push forward to EOF.
                 offline_entry_t entry;
-                if (thread_files[tidx]->read((char*)&entry, sizeof(entry)) ||
-                    !thread_files[tidx]->eof())
+                if (read_entry(thread, &entry) || !thread->in->eof())
                     FATAL_ERROR("Footer is not the final entry");
-                CHECK(tids[tidx] != INVALID_THREAD_ID, "Missing thread id");
-                VPRINT(2, "Thread %d exit\n", (uint)tids[tidx]);
-                size += instru.append_thread_exit(buf, tids[tidx]);
-                buf += size;
-                --thread_count;
-                tidx = (uint)thread_files.size(); // Request thread scan.
+                CHECK(thread->tid != INVALID_THREAD_ID, "Missing thread id");
+                VPRINT(2, "Thread %d exit\n", (uint)thread->tid);
+                size += instru.append_thread_exit(buf, thread->tid);
+                out->commit((trace_entry_t *)(buf_base + size));
+                return false;
             } else
                 FATAL_ERROR("Invalid extension type %d", (int)in_entry.extended.ext);
         } else if (in_entry.timestamp.type == OFFLINE_TYPE_TIMESTAMP) {
             VPRINT(2, "Thread %u timestamp 0x" ZHEX64_FORMAT_STRING "\n",
-                   (uint)tids[tidx], in_entry.timestamp.usec);
-            times[tidx] = in_entry.timestamp.usec;
-            tidx = (uint)thread_files.size(); // Request thread scan.
+                   (uint)thread->tid, in_entry.timestamp.usec);
+            *next_timestamp = in_entry.timestamp.usec;
+            return true;
         } else if (in_entry.addr.type == OFFLINE_TYPE_MEMREF ||
                    in_entry.addr.type == OFFLINE_TYPE_MEMREF_HIGH) {
-            if (!last_bb_handled) {
+            if (!thread->last_bb_handled) {
                 // For currently-unhandled non-module code, memrefs are handled here
                 // where we can easily handle the transition out of the bb.
                 trace_entry_t *entry = (trace_entry_t *) buf;
@@ -501,11 +618,11 @@ raw2trace_t::merge_and_process_thread_files()
                 CHECK(false, "memref entry found outside of bb");
             }
         } else if (in_entry.pc.type == OFFLINE_TYPE_PC) {
-            last_bb_handled = append_bb_entries(tidx, &in_entry);
+            thread->last_bb_handled = append_bb_entries(thread, cache, out, &in_entry);
         } else if (in_entry.tid.type == OFFLINE_TYPE_THREAD) {
             VPRINT(2, "Thread %u entry\n", (uint)in_entry.tid.tid);
-            if (tids[tidx] == INVALID_THREAD_ID)
-                tids[tidx] = in_entry.tid.tid;
+            if (thread->tid == INVALID_THREAD_ID)
+                thread->tid = in_entry.tid.tid;
             size += instru.append_tid(buf, in_entry.tid.tid);
             buf += size;
         } else if (in_entry.pid.type == OFFLINE_TYPE_PID) {
@@ -515,44 +632,232 @@ raw2trace_t::merge_and_process_thread_files()
         } else
             FATAL_ERROR("Unknown trace type %d", (int)in_entry.timestamp.type);
         if (size > 0) {
-            CHECK((uint)size < MAX_COMBINED_ENTRIES, "Too many entries");
-            if (!out_file.write((char*)buf_base, size))
-                FATAL_ERROR("Failed to write to output file");
+            CHECK((uint)size < MAX_COMBINED_ENTRIES * sizeof(trace_entry_t),
+                  "Too many entries");
+            out->commit((trace_entry_t *)(buf_base + size));
         }
-    } while (thread_count > 0);
+    }
+}
+
+// A min-heap of (timestamp, thread index) for picking the next thread to merge.
+// Ties go to the lowest thread index.
+typedef std::pair<uint64, uint> merge_key_t;
+typedef std::priority_queue<merge_key_t, std::vector<merge_key_t>,
+                            std::greater<merge_key_t> > merge_queue_t;
+
+void
+raw2trace_t::append_tid_entry(trace_buffer_t *out, thread_id_t tid)
+{
+    online_instru_t instru(NULL);
+    byte *buf = (byte *) out->reserve(MAX_COMBINED_ENTRIES);
+    int size = instru.append_tid(buf, tid);
+    out->commit((trace_entry_t *)(buf + size));
+}
+
+static void
+free_bb_cache(bb_cache_t *cache)
+{
+    for (bb_cache_t::iterator it = cache->begin(); it != cache->end(); ++it)
+        delete it->second;
+    cache->clear();
+}
+
+void
+raw2trace_t::merge_and_process_thread_files(trace_buffer_t *out)
+{
+    // We read the thread files simultaneously in lockstep and merge them into
+    // a single output file in timestamp order.
+    // When a thread file runs out we drop it from the queue.
+    merge_queue_t queue;
+    bb_cache_t cache;
+
+    for (uint i = 0; i < threads.size(); ++i)
+        queue.push(merge_key_t(read_timestamp(&threads[i]), i));
+    while (!queue.empty()) {
+        uint tidx = queue.top().second;
+        VPRINT(2, "Next thread in timestamp order is %u @0x" ZHEX64_FORMAT_STRING
+               "\n", (uint)threads[tidx].tid, queue.top().first);
+        queue.pop();
+        append_tid_entry(out, threads[tidx].tid);
+        uint64 next_time;
+        if (process_thread_segment(&threads[tidx], &cache, out, &next_time))
+            queue.push(merge_key_t(next_time, tidx));
+    }
+    free_bb_cache(&cache);
+}
+
+/***************************************************************************
+ * Parallel conversion
+ */
+
+// Each worker converts whole thread files, one at a time, into a separate file of
+// trace entries and records where each timestamp falls.  Only the merge of the
+// converted files in timestamp order is serial.
+void
+raw2trace_t::worker_func(raw2trace_t *self, uint worker_index)
+{
+    // Each worker has its own decode cache to avoid synchronization.
+    // All workers decode with the same standalone dcontext.  That is safe:
+    // in standalone mode it is GLOBAL_DCONTEXT, which holds no per-decode state.
+    // The ISA mode it reports is a global that is only written in our
+    // constructor, before any worker starts, and the instr_t operands are
+    // allocated from the global heap, which takes its own lock.
+    bb_cache_t cache;
+    uint tidx;
+    while ((tidx = self->next_thread++) < self->threads.size()) {
+        raw2trace_thread_t *thread = &self->threads[tidx];
+        VPRINT(1, "Worker %u converting thread file %u\n", worker_index, tidx);
+        std::ofstream out_file(thread->converted_path.c_str(), std::ofstream::binary);
+        if (!out_file)
+            FATAL_ERROR("Failed to open %s", thread->converted_path.c_str());
+        trace_buffer_t out(&out_file);
+        uint64 timestamp = self->read_timestamp(thread);
+        bool more = true;
+        while (more) {
+            thread_segment_t segment;
+            segment.timestamp = timestamp;
+            // The merge announces each segment with the thread id known so far,
+            // just like the serial conversion does.
+            segment.tid = thread->tid;
+            uint64 start = out.get_count();
+            more = self->process_thread_segment(thread, &cache, &out, &timestamp);
+            segment.num_entries = out.get_count() - start;
+            thread->segments.push_back(segment);
+        }
+        out.flush();
+        out_file.close();
+        if (!out_file)
+            FATAL_ERROR("Failed to write to %s", thread->converted_path.c_str());
+    }
+    free_bb_cache(&cache);
+}
+
+void
+raw2trace_t::convert_thread_files()
+{
+    std::vector<std::thread> workers;
+    uint num_workers = worker_count;
+    if (num_workers > threads.size())
+        num_workers = (uint)threads.size();
+    for (uint i = 0; i < threads.size(); ++i) {
+        std::ostringstream path;
+        path << outname << "." << i << ".tmp";
+        threads[i].converted_path = path.str();
+    }
+    next_thread = 0;
+    VPRINT(1, "Converting %u thread files on %u workers\n",
+           (uint)threads.size(), num_workers);
+    for (uint i = 0; i < num_workers; ++i)
+        workers.push_back(std::thread(worker_func, this, i));
+    for (uint i = 0; i < num_workers; ++i)
+        workers[i].join();
+}
+
+// This produces the same output as merge_and_process_thread_files().
+void
+raw2trace_t::merge_converted_thread_files(trace_buffer_t *out)
+{
+    std::vector<std::ifstream*> converted(threads.size());
+    std::vector<size_t> next_segment(threads.size(), 0);
+    merge_queue_t queue;
+
+    for (uint i = 0; i < threads.size(); ++i) {
+        converted[i] = new std::ifstream(threads[i].converted_path.c_str(),
+                                         std::ifstream::binary);
+        if (!(*converted[i]))
+            FATAL_ERROR("Failed to open %s", threads[i].converted_path.c_str());
+        if (!threads[i].segments.empty())
+            queue.push(merge_key_t(threads[i].segments[0].timestamp, i));
+    }
+    while (!queue.empty()) {
+        uint tidx = queue.top().second;
+        queue.pop();
+        const thread_segment_t &segment = threads[tidx].segments[next_segment[tidx]];
+        VPRINT(2, "Next thread in timestamp order is %u @0x" ZHEX64_FORMAT_STRING
+               "\n", (uint)threads[tidx].tid, segment.timestamp);
+        append_tid_entry(out, segment.tid);
+        // Segments are copied straight into the output buffer.
+        for (uint64 left = segment.num_entries; left > 0; ) {
+            size_t chunk = left < OUTPUT_BUFFER_ENTRIES ?
+                (size_t)left : OUTPUT_BUFFER_ENTRIES;
+            trace_entry_t *buf = out->reserve(chunk);
+            if (!converted[tidx]->read((char*)buf, chunk * sizeof(trace_entry_t)))
+                FATAL_ERROR("Failed to read %s", threads[tidx].converted_path.c_str());
+            out->commit(buf + chunk);
+            left -= chunk;
+        }
+        if (++next_segment[tidx] < threads[tidx].segments.size()) {
+            queue.push(merge_key_t(threads[tidx].segments[next_segment[tidx]].timestamp,
+                                   tidx));
+        }
+    }
+    for (uint i = 0; i < threads.size(); ++i) {
+        delete converted[i];
+        if (remove(threads[i].converted_path.c_str()) != 0)
+            WARN("Failed to remove %s", threads[i].converted_path.c_str());
+    }
 }
 
 void
 raw2trace_t::do_conversion()
 {
-    trace_entry_t entry;
-    entry.type = TRACE_TYPE_HEADER;
-    entry.size = 0;
-    entry.addr = TRACE_ENTRY_VERSION;
-    if (!out_file.write((char*)&entry, sizeof(entry)))
-        FATAL_ERROR("Failed to write header to output file %s", outname.c_str());
+    trace_buffer_t out = chunk_writer != NULL ? trace_buffer_t(chunk_writer) :
+        trace_buffer_t(&out_file);
+    trace_entry_t *entry = out.reserve(1);
+    entry->type = TRACE_TYPE_HEADER;
+    entry->size = 0;
+    entry->addr = TRACE_ENTRY_VERSION;
+    out.commit(entry + 1);
 
     read_and_map_modules();
     open_thread_files();
-    merge_and_process_thread_files();
+    if (worker_count > 1 && threads.size() > 1) {
+        convert_thread_files();
+        merge_converted_thread_files(&out);
+    } else
+        merge_and_process_thread_files(&out);
 
-    entry.type = TRACE_TYPE_FOOTER;
-    entry.size = 0;
-    entry.addr = 0;
-    if (!out_file.write((char*)&entry, sizeof(entry)))
-        FATAL_ERROR("Failed to write footer to output file %s", outname.c_str());
+    entry = out.reserve(1);
+    entry->type = TRACE_TYPE_FOOTER;
+    entry->size = 0;
+    entry->addr = 0;
+    out.commit(entry + 1);
+    out.flush();
+
+#ifdef HAS_ZLIB
+    if (chunk_writer != NULL) {
+        for (uint i = 0; i < threads.size(); ++i)
+            chunk_writer->set_thread_timestamp(threads[i].tid, threads[i].first_timestamp);
+        if (!chunk_writer->close())
+            FATAL_ERROR("Failed to write index to output file %s", outname.c_str());
+    }
+#endif
 }
 
-raw2trace_t::raw2trace_t(std::string indir_in, std::string outname_in)
-    : indir(indir_in), outname(outname_in)
+raw2trace_t::raw2trace_t(std::string indir_in, std::string outname_in,
+                         unsigned int worker_count_in, bool chunked)
+    : indir(indir_in), outname(outname_in), chunk_writer(NULL),
+      worker_count(worker_count_in)
 {
     // Support passing both base dir and raw/ subdir.
     if (indir.find(OUTFILE_SUBDIR) == std::string::npos)
         indir += std::string(DIRSEP) + OUTFILE_SUBDIR;
-    out_file.open(outname.c_str(), std::ofstream::binary);
-    if (!out_file)
-        FATAL_ERROR("Failed to open output file %s", outname.c_str());
+    if (chunked) {
+#ifdef HAS_ZLIB
+        chunk_writer = new chunked_trace_writer_t();
+        if (!chunk_writer->open(outname))
+            FATAL_ERROR("Failed to open output file %s", outname.c_str());
+#else
+        FATAL_ERROR("Chunked trace output requires zlib");
+#endif
+    } else {
+        out_file.open(outname.c_str(), std::ofstream::binary);
+        if (!out_file)
+            FATAL_ERROR("Failed to open output file %s", outname.c_str());
+    }
     VPRINT(1, "Writing to %s\n", outname.c_str());
+    if (worker_count == 0)
+        worker_count = std::thread::hardware_concurrency();
 
     dcontext = dr_standalone_init();
 #ifdef ARM
@@ -565,8 +870,13 @@ raw2trace_t::raw2trace_t(std::string indir_in, std::string outname_in)
 raw2trace_t::~raw2trace_t()
 {
     out_file.close();
-    for (std::vector<std::ifstream*>::iterator fi = thread_files.begin();
-         fi != thread_files.end(); ++fi)
-        (*fi)->close();
+#ifdef HAS_ZLIB
+    delete chunk_writer;
+#endif
+    for (std::vector<raw2trace_thread_t>::iterator ti = threads.begin();
+         ti != threads.end(); ++ti) {
+        ti->in->close();
+        delete ti->in;
+    }
     unmap_modules();
 }
@@ -39,7 +39,10 @@
 #include "dr_api.h"
 #include "drmemtrace.h"
 #include "../common/trace_entry.h"
+#include <atomic>
 #include <fstream>
+#include <map>
+#include <string>
 #include <vector>
 
 #define OUTFILE_PREFIX "drmemtrace"
@@ -47,6 +50,8 @@
 #define OUTFILE_SUBDIR "raw"
 #define TRACE_FILENAME "drmemtrace.trace"
 
+class chunked_trace_writer_t;
+
 struct module_t {
     module_t(const char *path, app_pc orig, byte *map, size_t size) :
         path(path), orig_base(orig), map_base(map), map_size(size) {}
@@ -56,9 +61,83 @@ struct module_t {
     size_t map_size;
 };
 
+// A basic block decoded once and then reused for every execution of the block.
+// The memrefs of each instr are in operand order; whether each one is present
+// in a given execution still depends on the raw entries (for predication).
+struct bb_instr_t {
+    trace_entry_t entry; // The addr field holds the offset from the block start.
+    bool rep_string;
+    bool cti;
+    uint num_memrefs;
+};
+
+struct bb_template_t {
+    std::vector<bb_instr_t> instrs;
+    std::vector<trace_entry_t> memrefs;
+    // Whether decoding stopped at an invalid instr after instrs.
+    bool invalid_end;
+};
+
+// Keyed by the block start in our mapping of its module.
+typedef std::map<app_pc, bb_template_t *> bb_cache_t;
+
+// A range of a thread's converted entries that runs from one of its timestamps
+// up to the next, for merging converted threads by timestamp.
+struct thread_segment_t {
+    uint64 timestamp;
+    thread_id_t tid;
+    uint64 num_entries;
+};
+
+// Batches converted entries into large writes, to a stream or to a chunked
+// trace file.
+class trace_buffer_t {
+public:
+    explicit trace_buffer_t(std::ostream *out);
+    explicit trace_buffer_t(chunked_trace_writer_t *chunks);
+    // Returns room for count more entries, first writing out the buffer if needed.
+    trace_entry_t *reserve(size_t count);
+    // Adds the entries from the last reserve() up to end.
+    void commit(trace_entry_t *end);
+    void flush();
+    // The number of entries added so far.
+    uint64 get_count() const { return count; }
+
+private:
+    std::ostream *out;
+    chunked_trace_writer_t *chunks;
+    std::vector<trace_entry_t> entries;
+    size_t used;
+    uint64 count;
+};
+
+// The conversion state of one thread log file.
+struct raw2trace_thread_t {
+    raw2trace_thread_t() : in(NULL), in_pos(0), in_count(0), tid(0),
+        first_timestamp(0), prev_instr_was_rep_string(false), last_bb_handled(true) {}
+    std::ifstream *in;
+    // A window of the input, to read many entries at once.
+    std::vector<offline_entry_t> in_buf;
+    size_t in_pos;
+    size_t in_count;
+    thread_id_t tid;
+    uint64 first_timestamp;
+    bool prev_instr_was_rep_string;
+    bool last_bb_handled;
+    // Only used when threads are converted in parallel.
+    std::string converted_path;
+    std::vector<thread_segment_t> segments;
+};
+
 class raw2trace_t {
 public:
-    raw2trace_t(std::string indir, std::string outname);
+    // Up to worker_count threads convert the thread files in parallel, with 0
+    // meaning one per hardware thread.  A parallel conversion stages each thread
+    // in an <outname>.N.tmp file until the merge, roughly doubling the disk
+    // space needed.  If chunked is set the output is a compressed chunked trace
+    // file (see chunked_trace_header_t).
+    raw2trace_t(std::string indir, std::string outname, unsigned int worker_count = 1,
+                bool chunked = false);
     ~raw2trace_t();
     void do_conversion();
 
@@ -67,20 +146,34 @@ private:
     void unmap_modules(void);
     void open_thread_log_file(const char *basename);
     void open_thread_files();
-    void merge_and_process_thread_files();
-    bool append_bb_entries(uint tidx, offline_entry_t *in_entry);
-    trace_entry_t *append_memref(trace_entry_t *buf_in, uint tidx, instr_t *instr,
-                                 opnd_t ref, bool write);
+    void merge_and_process_thread_files(trace_buffer_t *out);
+    void convert_thread_files();
+    void merge_converted_thread_files(trace_buffer_t *out);
+    static void worker_func(raw2trace_t *self, uint worker_index);
+    bool read_entry(raw2trace_thread_t *thread, offline_entry_t *entry);
+    void unread_entry(raw2trace_thread_t *thread);
+    uint64 read_timestamp(raw2trace_thread_t *thread);
+    void append_tid_entry(trace_buffer_t *out, thread_id_t tid);
+    bool process_thread_segment(raw2trace_thread_t *thread, bb_cache_t *cache,
+                                trace_buffer_t *out, uint64 *next_timestamp);
+    const bb_template_t *get_bb_template(bb_cache_t *cache, offline_entry_t *in_entry);
+    bool append_bb_entries(raw2trace_thread_t *thread, bb_cache_t *cache,
+                           trace_buffer_t *out, offline_entry_t *in_entry);
+    trace_entry_t *append_memref(trace_entry_t *buf_in, raw2trace_thread_t *thread,
+                                 const trace_entry_t &ref);
 
     std::string indir;
     std::string outname;
     std::ofstream out_file;
+    chunked_trace_writer_t *chunk_writer;
     static const uint MAX_COMBINED_ENTRIES = 64;
     void *modhandle;
     std::vector<module_t> modvec;
-    std::vector<std::ifstream*> thread_files;
+    std::vector<raw2trace_thread_t> threads;
     void *dcontext;
-    bool prev_instr_was_rep_string;
+    unsigned int worker_count;
+    // The next thread for a worker to convert.
+    std::atomic<uint> next_thread;
 };
 
 #endif /* _RAW2TRACE_H_ */
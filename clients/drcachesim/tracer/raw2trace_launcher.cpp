@@ -58,6 +58,21 @@ static droption_t<std::string> op_out
 (DROPTION_SCOPE_FRONTEND, "out", "", "[Required] Path to output file",
  "Specifies the path to the output file.");
 
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 1, "Number of conversion threads",
+ "Specifies how many threads convert the per-thread raw files in parallel before "
+ "they are merged in timestamp order.  The default of 1 converts serially without "
+ "any intermediate files.  0 uses one thread per hardware thread.  Any value other "
+ "than 1 writes each thread's converted trace to an intermediate <out>.N.tmp file "
+ "that is only removed after the merge, so the conversion temporarily needs about "
+ "twice the disk space of the final trace.");
+
+static droption_t<bool> op_chunked
+(DROPTION_SCOPE_FRONTEND, "chunked", false, "Write a compressed chunked trace",
+ "Stores the output as separately compressed chunks with a trailing index rather "
+ "than as raw trace entries.  Such a file can be read by drcachesim with -infile.  "
+ "This requires zlib support.");
+
 // Non-static for use by raw2trace.cpp
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_FRONTEND, "verbose", 0, "Verbosity level for diagnostic output",
@@ -80,7 +95,8 @@ _tmain(int argc, const TCHAR *targv[])
         FATAL_ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
                     droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
     }
-    raw2trace_t raw2trace(op_indir.get_value(), op_out.get_value());
+    raw2trace_t raw2trace(op_indir.get_value(), op_out.get_value(),
+                          op_jobs.get_value(), op_chunked.get_value());
     raw2trace.do_conversion();
     return 0;
 }
@@ -58,6 +58,8 @@
 
 #ifdef ARM
 # include "../../../core/unix/include/syscall_linux_arm.h" // for SYS_cacheflush
+#elif defined(LINUX)
+# include <sys/syscall.h> // for SYS_exit_group
 #endif
 
 /* Make sure we export function name as the symbol name without mangling. */
@@ -89,8 +91,16 @@ static size_t trace_buf_size;
 static size_t redzone_size;
 static size_t max_buf_size;
 
+/* For -async_writer: one trace buffer in a thread's pool */
+typedef struct _pool_buf_t {
+    byte *base;
+    byte *end; /* the buffer pointer when it was handed to the writer */
+    struct _per_thread_t *owner;
+    struct _pool_buf_t *next;
+} pool_buf_t;
+
 /* thread private buffer and counter */
-typedef struct {
+typedef struct _per_thread_t {
     byte *seg_base;
     byte *buf_base;
     uint64 num_refs;
@@ -101,6 +111,19 @@ typedef struct {
     /* For file_ops_func.handoff_buf */
     uint num_buffers;
     byte *reserve_buf;
+    /* For -L0_filter */
+    ptr_uint_t *l0_dcache;
+    ptr_uint_t *l0_icache;
+    /* For -async_writer.  The owner alone grows the pool; free_bufs and
+     * num_pending are shared with the writer thread under writer_lock.
+     */
+    pool_buf_t *pool;
+    pool_buf_t *cur_buf;
+    uint pool_size;
+    uint pool_limit;
+    uint num_pool_bufs;
+    pool_buf_t *free_bufs;
+    uint num_pending;
 } per_thread_t;
 
 #define MAX_NUM_DELAY_INSTRS 32
@@ -124,6 +147,24 @@ static client_id_t client_id;
 static void  *mutex;    /* for multithread support */
 static uint64 num_refs; /* keep a global memory reference count */
 
+/* For -async_writer: full buffers queued for the writer thread.  Whoever
+ * writes out queued buffers, the writer thread or a thread that cannot wait
+ * for it, holds writer_busy throughout, and takes it before writer_lock.
+ * DR never suspends a client thread that holds a client lock, so a suspended
+ * writer has no buffer in flight and a thread that acquires writer_busy can
+ * drain the queue itself.  Once the process starts exiting, writer_active is
+ * cleared and all threads go back to writing their own buffers, as DR
+ * suspends the writer thread during exit.
+ */
+static bool use_async_writer;
+static void *writer_lock;
+static void *writer_busy;
+static void *writer_wakeup; /* event: the queue is non-empty */
+static pool_buf_t *write_queue_head;
+static pool_buf_t *write_queue_tail;
+static uint num_queued;
+static bool writer_active;
+
 /* virtual to physical translation */
 static bool have_phys;
 static physaddr_t physaddr;
@@ -204,16 +245,26 @@ drmemtrace_custom_module_data(void * (*load_cb)(module_data_t *module),
 /* Allocated TLS slot offsets */
 enum {
     MEMTRACE_TLS_OFFS_BUF_PTR,
+    /* For -L0_filter: the per-thread tag arrays of the inlined caches. */
+    MEMTRACE_TLS_OFFS_DCACHE,
+    MEMTRACE_TLS_OFFS_ICACHE,
     MEMTRACE_TLS_COUNT, /* total number of TLS slots allocated */
 };
 static reg_id_t tls_seg;
 static uint     tls_offs;
 static int      tls_idx;
-#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base)+tls_offs+(enum_val))
+#define TLS_OFFS(enum_val) (tls_offs + sizeof(void *)*(enum_val))
+#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base)+TLS_OFFS(enum_val))
 #define BUF_PTR(tls_base) *(byte **)TLS_SLOT(tls_base, MEMTRACE_TLS_OFFS_BUF_PTR)
 /* We leave a slot at the start so we can easily insert a header entry */
 #define BUF_HDR_SLOTS 1
 static size_t buf_hdr_slots_size;
+/* For -L0_filter: the number of lines in each inlined cache (0 means that
+ * stream is not filtered) and the shift from an address to its line.
+ */
+static ptr_uint_t l0_dcache_lines;
+static ptr_uint_t l0_icache_lines;
+static int line_bits;
 
 static void
 create_buffer(per_thread_t *data)
@@ -287,13 +338,181 @@ write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end)
         return atomic_pipe_write(drcontext, towrite_start, towrite_end);
 }
 
+/* Our instrumentation reads from the buffer and skips the clean call if the
+ * content is 0, so a buffer must be zero with a non-zero sentinel in the
+ * redzone before reuse.  Entries are only ever written below the final buffer
+ * pointer, so only that much needs to be cleared.
+ */
+static void
+rearm_buffer(byte *buf_base, byte *buf_end)
+{
+    byte *redzone = buf_base + trace_buf_size;
+    memset(buf_base, 0, (buf_end < redzone ? buf_end : redzone) - buf_base);
+    if (buf_end > redzone) {
+        // Set sentinel (non-zero) value in redzone
+        memset(redzone, -1, buf_end - redzone);
+    }
+}
+
+/* Writes out and re-arms the head of the queue and returns it to its owner.
+ * The caller must hold writer_busy and writer_lock, which is released during
+ * the write.  Returns false if the queue is empty.
+ */
+static bool
+writer_write_one(void)
+{
+    pool_buf_t *buf = write_queue_head;
+    per_thread_t *owner;
+    ssize_t size;
+    if (buf == NULL)
+        return false;
+    write_queue_head = buf->next;
+    if (write_queue_head == NULL)
+        write_queue_tail = NULL;
+    dr_mutex_unlock(writer_lock);
+
+    owner = buf->owner;
+    size = buf->end - buf->base;
+    if (file_ops_func.write_file(owner->file, buf->base, size) < size) {
+        NOTIFY(0, "Fatal error: failed to write trace\n");
+        dr_abort();
+    }
+    rearm_buffer(buf->base, buf->end);
+
+    dr_mutex_lock(writer_lock);
+    buf->next = owner->free_bufs;
+    owner->free_bufs = buf;
+    owner->num_pending--;
+    num_queued--;
+    return true;
+}
+
+/* The -async_writer thread: writes out queued buffers in FIFO order, which
+ * preserves each thread's own order, and returns them re-armed to their owners.
+ * It only lets go of writer_busy when the queue is empty.
+ */
+static void
+writer_thread_main(void *arg)
+{
+    while (true) {
+        dr_mutex_lock(writer_busy);
+        dr_mutex_lock(writer_lock);
+        while (writer_write_one())
+            ; /* keep going */
+        dr_mutex_unlock(writer_lock);
+        dr_mutex_unlock(writer_busy);
+        dr_event_wait(writer_wakeup);
+    }
+}
+
+/* Writes out everything queued, on the calling thread.  We never wait for the
+ * writer thread to make progress, as DR may have suspended it for process
+ * exit, whatever path the exit takes.  If the writer is running we get
+ * writer_busy once it has emptied the queue.  Either way, on return every
+ * buffer handed to the writer before the call has been written.
+ */
+static void
+writer_drain(void)
+{
+    dr_mutex_lock(writer_busy);
+    dr_mutex_lock(writer_lock);
+    while (writer_write_one())
+        ; /* keep going */
+    dr_mutex_unlock(writer_lock);
+    dr_mutex_unlock(writer_busy);
+}
+
+/* Hands the current buffer, filled up to buf_end, to the writer thread and
+ * swaps in a free one from the pool, growing the pool up to -writer_buffers.
+ * Returns false if the writer is no longer active, in which case the caller
+ * must write the buffer itself.
+ */
+static bool
+writer_enqueue(per_thread_t *data, byte *buf_end)
+{
+    pool_buf_t *buf = data->cur_buf;
+    dr_mutex_lock(writer_lock);
+    if (!writer_active) {
+        dr_mutex_unlock(writer_lock);
+        // Our earlier buffers must reach the file first.
+        writer_drain();
+        return false;
+    }
+    buf->end = buf_end;
+    buf->next = NULL;
+    if (write_queue_tail == NULL)
+        write_queue_head = buf;
+    else
+        write_queue_tail->next = buf;
+    write_queue_tail = buf;
+    num_queued++;
+    data->num_pending++;
+    dr_event_signal(writer_wakeup);
+    while (data->free_bufs == NULL) {
+        if (data->num_pool_bufs < data->pool_limit) {
+            pool_buf_t *fresh = &data->pool[data->num_pool_bufs];
+            dr_mutex_unlock(writer_lock);
+            fresh->base = (byte *)
+                dr_raw_mem_alloc(max_buf_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+            dr_mutex_lock(writer_lock);
+            if (fresh->base == NULL) {
+                // Make do with what we have: we just queued a buffer, so one
+                // will come back.
+                data->pool_limit = data->num_pool_bufs;
+                continue;
+            }
+            /* dr_raw_mem_alloc guarantees to give us zeroed memory */
+            memset(fresh->base + trace_buf_size, -1, redzone_size);
+            fresh->owner = data;
+            fresh->next = data->free_bufs;
+            data->free_bufs = fresh;
+            data->num_pool_bufs++;
+        } else {
+            // The writer is behind, or suspended: help it out.
+            dr_mutex_unlock(writer_lock);
+            writer_drain();
+            dr_mutex_lock(writer_lock);
+        }
+    }
+    data->cur_buf = data->free_bufs;
+    data->free_bufs = data->cur_buf->next;
+    dr_mutex_unlock(writer_lock);
+    data->buf_base = data->cur_buf->base;
+    return true;
+}
+
+/* Called when the process starts to exit: switches everyone to synchronous
+ * writes and drains the queue on the calling thread.
+ */
+static void
+writer_stop(void)
+{
+    dr_mutex_lock(writer_lock);
+    writer_active = false;
+    dr_mutex_unlock(writer_lock);
+    writer_drain();
+}
+
+/* Under -L0_filter, returns whether a pipe write can start with an entry of
+ * this type: i.e., whether the reader needs no earlier entry of the same thread
+ * to process it.
+ */
+static bool
+can_split_filtered_before(trace_type_t type)
+{
+    return (type_is_instr(type) && type != TRACE_TYPE_INSTR_BUNDLE) ||
+        type == TRACE_TYPE_INSTR_NO_FETCH ||
+        type == TRACE_TYPE_INSTR_FLUSH || type == TRACE_TYPE_DATA_FLUSH;
+}
+
 static void
 memtrace(void *drcontext, bool skip_size_cap)
 {
     per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
     byte *mem_ref, *buf_ptr;
-    byte *pipe_start, *pipe_end, *redzone;
+    byte *pipe_start, *pipe_end;
     bool do_write = true;
+    bool handed_off = false;
     size_t header_size = buf_hdr_slots_size;
 
     buf_ptr = BUF_PTR(data->seg_base);
@@ -345,8 +564,14 @@ memtrace(void *drcontext, bool skip_size_cap)
             if (!op_offline.get_value()) {
                 // Split up the buffer into multiple writes to ensure atomic pipe writes.
                 // We can only split before TRACE_TYPE_INSTR, assuming only a few data
-                // entries in between instr entries.
-                if (instru->get_entry_type(mem_ref) == TRACE_TYPE_INSTR) {
+                // entries in between instr entries.  With -L0_filter an arbitrary
+                // number of data entries can follow an instr entry, but each one
+                // has its own TRACE_TYPE_INSTR_NO_FETCH entry with its PC, so we
+                // can also split before those and before any other instr, though
+                // not between the two entries of a large flush.
+                if (instru->get_entry_type(mem_ref) == TRACE_TYPE_INSTR ||
+                    (op_L0_filter.get_value() &&
+                     can_split_filtered_before(instru->get_entry_type(mem_ref)))) {
                     if ((mem_ref - pipe_start) > ipc_pipe.get_atomic_write_size())
                         pipe_start = atomic_pipe_write(drcontext, pipe_start, pipe_end);
                     // Advance pipe_end pointer
@@ -355,7 +580,10 @@ memtrace(void *drcontext, bool skip_size_cap)
             }
         }
         if (op_offline.get_value()) {
-            write_trace_data(drcontext, pipe_start, buf_ptr);
+            if (use_async_writer)
+                handed_off = writer_enqueue(data, buf_ptr);
+            if (!handed_off)
+                write_trace_data(drcontext, pipe_start, buf_ptr);
         } else {
             // Write the rest to pipe
             // The last few entries (e.g., instr + refs) may exceed the atomic write size,
@@ -367,20 +595,13 @@ memtrace(void *drcontext, bool skip_size_cap)
         }
     }
 
-    if (do_write && file_ops_func.handoff_buf != NULL) {
+    if (handed_off) {
+        // The writer thread re-arms the old buffer: we already have a new one.
+    } else if (do_write && file_ops_func.handoff_buf != NULL) {
         // The owner of the handoff callback now owns the buffer, and we get a new one.
         create_buffer(data);
-    } else {
-        // Our instrumentation reads from buffer and skips the clean call if the
-        // content is 0, so we need set zero in the trace buffer and set non-zero
-        // in redzone.
-        memset(data->buf_base, 0, trace_buf_size);
-        redzone = data->buf_base + trace_buf_size;
-        if (buf_ptr > redzone) {
-            // Set sentinel (non-zero) value in redzone
-            memset(redzone, -1, buf_ptr - redzone);
-        }
-    }
+    } else
+        rearm_buffer(data->buf_base, buf_ptr);
     BUF_PTR(data->seg_base) = data->buf_base + buf_hdr_slots_size;
 }
 
@@ -397,7 +618,7 @@ insert_load_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                     reg_id_t reg_ptr)
 {
     dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
-                           tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+                           TLS_OFFS(MEMTRACE_TLS_OFFS_BUF_PTR), reg_ptr);
 }
 
 static void
@@ -411,7 +632,7 @@ insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                              opnd_create_reg(reg_ptr),
                              OPND_CREATE_INT16(adjust)));
     dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg,
-                            tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+                            TLS_OFFS(MEMTRACE_TLS_OFFS_BUF_PTR), reg_ptr);
 #ifdef ARM // X86 does not support general predicated execution
     if (pred != DR_PRED_NONE) {
         instr_t *instr;
@@ -425,6 +646,223 @@ insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
 #endif
 }
 
+/* Inserts our "L0" filter: a direct-mapped cache of line tags in thread-local
+ * memory, checked inline.  A reference that touches two lines (the first and
+ * last of a larger one) hits only if both do.  On a hit we jump to skip; on a
+ * miss we install the new tags and fall through.  If is_fetch this checks the
+ * instruction fetch of app, else the address of ref.  Clobbers reg_ptr and
+ * reg_tmp.
+ */
+static void
+insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   reg_id_t reg_ptr, reg_id_t reg_tmp, opnd_t ref, instr_t *app,
+                   bool is_fetch, instr_t *skip)
+{
+#ifdef X86
+    reg_id_t reg_idx, reg_end = DR_REG_NULL;
+    bool ok;
+    ptr_uint_t mask = (is_fetch ? l0_icache_lines : l0_dcache_lines) - 1;
+    opnd_t slot;
+    uint size;
+    app_pc pc = instr_get_app_pc(app);
+    if (is_fetch) {
+        size = instr_length(drcontext, app);
+        // We know up front whether the fetch crosses a line.
+        if (((ptr_uint_t)pc >> line_bits) == (((ptr_uint_t)pc + size - 1) >> line_bits))
+            size = 1;
+    } else {
+        size = drutil_opnd_mem_size_in_bytes(ref, where);
+        // A prefetch can have a zero-sized reference.
+        if (size == 0)
+            size = 1;
+    }
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_idx) !=
+        DRREG_SUCCESS ||
+        (size > 1 &&
+         drreg_reserve_register(drcontext, ilist, where, NULL, &reg_end) !=
+         DRREG_SUCCESS)) {
+        NOTIFY(0, "Fatal error: failed to reserve scratch registers\n");
+        dr_abort();
+    }
+    if (is_fetch) {
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)pc,
+                                         opnd_create_reg(reg_tmp),
+                                         ilist, where, NULL, NULL);
+        if (size > 1) {
+            instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)pc + size - 1,
+                                             opnd_create_reg(reg_end),
+                                             ilist, where, NULL, NULL);
+        }
+    } else {
+        if (opnd_uses_reg(ref, reg_ptr))
+            drreg_get_app_value(drcontext, ilist, where, reg_ptr, reg_ptr);
+        if (opnd_uses_reg(ref, reg_tmp))
+            drreg_get_app_value(drcontext, ilist, where, reg_tmp, reg_tmp);
+        if (opnd_uses_reg(ref, reg_idx))
+            drreg_get_app_value(drcontext, ilist, where, reg_idx, reg_idx);
+        if (reg_end != DR_REG_NULL && opnd_uses_reg(ref, reg_end))
+            drreg_get_app_value(drcontext, ilist, where, reg_end, reg_end);
+        ok = drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_tmp, reg_ptr);
+        DR_ASSERT(ok);
+        if (size > 1) {
+            MINSERT(ilist, where,
+                    INSTR_CREATE_lea(drcontext, opnd_create_reg(reg_end),
+                                     OPND_CREATE_MEM_lea(reg_tmp, DR_REG_NULL, 0,
+                                                         size - 1)));
+        }
+    }
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS) {
+        NOTIFY(0, "Fatal error: failed to reserve aflags\n");
+        dr_abort();
+    }
+    // reg_tmp = tag, reg_end = the last line's tag, reg_idx = tag % lines,
+    // reg_ptr = the tag array.
+    MINSERT(ilist, where,
+            INSTR_CREATE_shr(drcontext, opnd_create_reg(reg_tmp),
+                             OPND_CREATE_INT8(line_bits)));
+    if (size > 1) {
+        MINSERT(ilist, where,
+                INSTR_CREATE_shr(drcontext, opnd_create_reg(reg_end),
+                                 OPND_CREATE_INT8(line_bits)));
+    }
+    MINSERT(ilist, where,
+            XINST_CREATE_move(drcontext, opnd_create_reg(reg_idx),
+                              opnd_create_reg(reg_tmp)));
+    MINSERT(ilist, where,
+            XINST_CREATE_and_s(drcontext, opnd_create_reg(reg_idx),
+                               OPND_CREATE_INT32((int)mask)));
+    dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
+                           TLS_OFFS(is_fetch ? MEMTRACE_TLS_OFFS_ICACHE :
+                                    MEMTRACE_TLS_OFFS_DCACHE), reg_ptr);
+    slot = opnd_create_base_disp(reg_ptr, reg_idx, sizeof(ptr_uint_t), 0, OPSZ_PTR);
+    MINSERT(ilist, where,
+            XINST_CREATE_cmp(drcontext, slot, opnd_create_reg(reg_tmp)));
+    if (size == 1) {
+        MINSERT(ilist, where,
+                INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip)));
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext, slot, opnd_create_reg(reg_tmp)));
+    } else {
+        instr_t *miss = INSTR_CREATE_label(drcontext);
+        instr_t *install_end = INSTR_CREATE_label(drcontext);
+        MINSERT(ilist, where,
+                INSTR_CREATE_jcc(drcontext, OP_jne, opnd_create_instr(miss)));
+        // The first line hit.  Check the last line, if it is another one.
+        MINSERT(ilist, where,
+                XINST_CREATE_cmp(drcontext, opnd_create_reg(reg_end),
+                                 opnd_create_reg(reg_tmp)));
+        MINSERT(ilist, where,
+                INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip)));
+        MINSERT(ilist, where,
+                XINST_CREATE_move(drcontext, opnd_create_reg(reg_idx),
+                                  opnd_create_reg(reg_end)));
+        MINSERT(ilist, where,
+                XINST_CREATE_and_s(drcontext, opnd_create_reg(reg_idx),
+                                   OPND_CREATE_INT32((int)mask)));
+        MINSERT(ilist, where,
+                XINST_CREATE_cmp(drcontext, slot, opnd_create_reg(reg_end)));
+        MINSERT(ilist, where,
+                INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip)));
+        MINSERT(ilist, where,
+                XINST_CREATE_jump(drcontext, opnd_create_instr(install_end)));
+        // The first line missed: install both.  If they are the same line we
+        // just store its tag twice.
+        MINSERT(ilist, where, miss);
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext, slot, opnd_create_reg(reg_tmp)));
+        MINSERT(ilist, where,
+                XINST_CREATE_move(drcontext, opnd_create_reg(reg_idx),
+                                  opnd_create_reg(reg_end)));
+        MINSERT(ilist, where,
+                XINST_CREATE_and_s(drcontext, opnd_create_reg(reg_idx),
+                                   OPND_CREATE_INT32((int)mask)));
+        MINSERT(ilist, where, install_end);
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext, slot, opnd_create_reg(reg_end)));
+    }
+    if (drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS ||
+        drreg_unreserve_register(drcontext, ilist, where, reg_idx) != DRREG_SUCCESS ||
+        (reg_end != DR_REG_NULL &&
+         drreg_unreserve_register(drcontext, ilist, where, reg_end) != DRREG_SUCCESS))
+        DR_ASSERT(false);
+#else
+    // XXX: add the shift and conditional branch sequences for ARM and AArch64.
+    // We refuse -L0_filter at init time on these platforms.
+    DR_ASSERT(false);
+#endif
+}
+
+/* Under -L0_filter, an entry is only written if its reference misses in the
+ * filter, so the buffer pointer update becomes conditional.  We commit any
+ * pending adjustment up front and commit each new entry on its own.
+ * A data entry is preceded by a TRACE_TYPE_INSTR_NO_FETCH entry with its PC:
+ * its instr fetch may have been filtered out, and memtrace() may split the
+ * pipe write between the fetch and the data entry.
+ * These return the new adjustment just like the instru_t routines they wrap.
+ */
+static int
+instrument_filtered_entry(void *drcontext, void *tag, instrlist_t *ilist,
+                          instr_t *where, reg_id_t reg_ptr, reg_id_t reg_tmp,
+                          int adjust, opnd_t ref, bool write, dr_pred_type_t pred,
+                          instr_t *app, bool is_fetch, void **bb_field)
+{
+    instr_t *skip = INSTR_CREATE_label(drcontext);
+    if (adjust != 0)
+        insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE, adjust);
+    insert_filter_addr(drcontext, ilist, where, reg_ptr, reg_tmp, ref, app, is_fetch,
+                       skip);
+    insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+    if (is_fetch) {
+        adjust = instru->instrument_instr(drcontext, tag, bb_field, ilist, where,
+                                          reg_ptr, reg_tmp, 0, app);
+    } else {
+        adjust = instru->instrument_no_fetch(drcontext, ilist, where, reg_ptr, reg_tmp,
+                                             0, app);
+        adjust = instru->instrument_memref(drcontext, ilist, where, reg_ptr, reg_tmp,
+                                           adjust, ref, write, pred);
+    }
+    insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, pred, adjust);
+    MINSERT(ilist, where, skip);
+    // The filter clobbered reg_ptr on the hit path.
+    insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+    return 0;
+}
+
+static int
+instrument_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
+                  reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust,
+                  opnd_t ref, bool write, dr_pred_type_t pred, instr_t *app)
+{
+    // Flushes must always reach the simulator.
+    if (!op_L0_filter.get_value() || instru_t::instr_is_flush(where)) {
+        return instru->instrument_memref(drcontext, ilist, where, reg_ptr, reg_tmp,
+                                         adjust, ref, write, pred);
+    }
+    if (l0_dcache_lines == 0) {
+        // Unfiltered, but the instr fetch may still have been filtered.
+        adjust = instru->instrument_no_fetch(drcontext, ilist, where, reg_ptr, reg_tmp,
+                                             adjust, app);
+        return instru->instrument_memref(drcontext, ilist, where, reg_ptr, reg_tmp,
+                                         adjust, ref, write, pred);
+    }
+    return instrument_filtered_entry(drcontext, NULL, ilist, where, reg_ptr, reg_tmp,
+                                     adjust, ref, write, pred, app, false, NULL);
+}
+
+static int
+instrument_instr(void *drcontext, void *tag, void **bb_field,
+                 instrlist_t *ilist, instr_t *where,
+                 reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust, instr_t *app)
+{
+    if (!op_L0_filter.get_value() || l0_icache_lines == 0) {
+        return instru->instrument_instr(drcontext, tag, bb_field, ilist, where,
+                                        reg_ptr, reg_tmp, adjust, app);
+    }
+    return instrument_filtered_entry(drcontext, tag, ilist, where, reg_ptr, reg_tmp,
+                                     adjust, opnd_create_null(), false, DR_PRED_NONE,
+                                     app, true, bb_field);
+}
+
 static int
 instrument_delay_instrs(void *drcontext, void *tag, instrlist_t *ilist,
                         user_data_t *ud, instr_t *where,
@@ -602,6 +1040,8 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
          // bundle-ends-in-this-branch-type to avoid this but for now it's not worth it.
          (!op_offline.get_value() && !op_online_instr_types.get_value())) &&
         ud->strex == NULL &&
+        // Each instr fetch is filtered separately, so there are no bundles.
+        !op_L0_filter.get_value() &&
         // The delay instr buffer is not full.
         ud->num_delay_instrs < MAX_NUM_DELAY_INSTRS) {
         ud->delay_instrs[ud->num_delay_instrs++] = instr;
@@ -638,11 +1078,11 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
 
     if (ud->strex != NULL) {
         DR_ASSERT(instr_is_exclusive_store(ud->strex));
-        adjust = instru->instrument_instr(drcontext, tag, &ud->instru_field, bb,
-                                          instr, reg_ptr, reg_tmp, adjust, ud->strex);
-        adjust = instru->instrument_memref(drcontext, bb, instr, reg_ptr, reg_tmp,
-                                           adjust, instr_get_dst(ud->strex, 0),
-                                           true, instr_get_predicate(ud->strex));
+        adjust = instrument_instr(drcontext, tag, &ud->instru_field, bb,
+                                  instr, reg_ptr, reg_tmp, adjust, ud->strex);
+        adjust = instrument_memref(drcontext, bb, instr, reg_ptr, reg_tmp,
+                                   adjust, instr_get_dst(ud->strex, 0),
+                                   true, instr_get_predicate(ud->strex), ud->strex);
         ud->strex = NULL;
     }
 
@@ -660,8 +1100,8 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     // See comment in instrument_delay_instrs: we only want the original string
     // ifetch and not any of the expansion instrs.
     if (is_memref || !ud->repstr) {
-        adjust = instru->instrument_instr(drcontext, tag, &ud->instru_field, bb,
-                                          instr, reg_ptr, reg_tmp, adjust, instr);
+        adjust = instrument_instr(drcontext, tag, &ud->instru_field, bb,
+                                  instr, reg_ptr, reg_tmp, adjust, instr);
     }
     ud->last_app_pc = instr_get_app_pc(instr);
 
@@ -677,20 +1117,24 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
         /* insert code to add an entry for each memory reference opnd */
         for (i = 0; i < instr_num_srcs(instr); i++) {
             if (opnd_is_memory_reference(instr_get_src(instr, i))) {
-                adjust = instru->instrument_memref(drcontext, bb, instr, reg_ptr,
-                                                   reg_tmp, adjust,
-                                                   instr_get_src(instr, i), false, pred);
+                adjust = instrument_memref(drcontext, bb, instr, reg_ptr,
+                                           reg_tmp, adjust,
+                                           instr_get_src(instr, i), false, pred,
+                                           instr);
             }
         }
 
         for (i = 0; i < instr_num_dsts(instr); i++) {
             if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
-                adjust = instru->instrument_memref(drcontext, bb, instr, reg_ptr,
-                                                   reg_tmp, adjust,
-                                                   instr_get_dst(instr, i), true, pred);
+                adjust = instrument_memref(drcontext, bb, instr, reg_ptr,
+                                           reg_tmp, adjust,
+                                           instr_get_dst(instr, i), true, pred,
+                                           instr);
             }
         }
-        insert_update_buf_ptr(drcontext, bb, instr, reg_ptr, pred, adjust);
+        // With -L0_filter each entry was already committed.
+        if (adjust != 0)
+            insert_update_buf_ptr(drcontext, bb, instr, reg_ptr, pred, adjust);
     } else if (adjust != 0)
         insert_update_buf_ptr(drcontext, bb, instr, reg_ptr, DR_PRED_NONE, adjust);
 
@@ -761,12 +1205,40 @@ event_pre_syscall(void *drcontext, int sysnum)
                 instru->append_iflush(BUF_PTR(data->seg_base), start, end - start);
         }
     }
+#endif
+#ifdef LINUX
+    // From here on everyone writes synchronously.  Other exit paths, such as
+    // a final SYS_exit or a fatal signal, leave the writer active and rely on
+    // event_thread_exit draining the queue itself.
+    if (use_async_writer && sysnum == SYS_exit_group)
+        writer_stop();
 #endif
     if (file_ops_func.handoff_buf == NULL)
         memtrace(drcontext, false);
     return true;
 }
 
+#ifdef LINUX
+static void
+event_fork_init(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (!use_async_writer)
+        return;
+    /* The writer thread does not exist in the child, and it may have held
+     * writer_lock or writer_busy at the fork.  We leak the old locks and let
+     * the child write its own buffers.  The parent's queued buffers are dropped.
+     */
+    writer_lock = dr_mutex_create();
+    writer_busy = dr_mutex_create();
+    writer_active = false;
+    write_queue_head = NULL;
+    write_queue_tail = NULL;
+    num_queued = 0;
+    data->num_pending = 0;
+}
+#endif
+
 static void
 event_thread_init(void *drcontext)
 {
@@ -784,6 +1256,35 @@ event_thread_init(void *drcontext)
     data->seg_base = (byte *) dr_get_dr_segment_base(tls_seg);
     DR_ASSERT(data->seg_base != NULL);
     create_buffer(data);
+    if (use_async_writer) {
+        /* The pool grows lazily so idle threads use just the one buffer. */
+        data->pool_size = op_writer_buffers.get_value();
+        data->pool_limit = data->pool_size;
+        data->pool = (pool_buf_t *)
+            dr_thread_alloc(drcontext, data->pool_size * sizeof(pool_buf_t));
+        data->pool[0].base = data->buf_base;
+        data->pool[0].owner = data;
+        data->num_pool_bufs = 1;
+        data->cur_buf = &data->pool[0];
+    }
+
+    if (op_L0_filter.get_value()) {
+        /* Tag 0 is the line at address 0, which no one should be accessing,
+         * so zeroed arrays start out empty.
+         */
+        if (l0_dcache_lines > 0) {
+            data->l0_dcache = (ptr_uint_t *)
+                dr_thread_alloc(drcontext, l0_dcache_lines * sizeof(ptr_uint_t));
+            memset(data->l0_dcache, 0, l0_dcache_lines * sizeof(ptr_uint_t));
+            *TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DCACHE) = data->l0_dcache;
+        }
+        if (l0_icache_lines > 0) {
+            data->l0_icache = (ptr_uint_t *)
+                dr_thread_alloc(drcontext, l0_icache_lines * sizeof(ptr_uint_t));
+            memset(data->l0_icache, 0, l0_icache_lines * sizeof(ptr_uint_t));
+            *TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_ICACHE) = data->l0_icache;
+        }
+    }
 
     if (op_offline.get_value()) {
         /* We do not need to call drx_init before using drx_open_unique_appid_file.
@@ -854,15 +1355,30 @@ event_thread_exit(void *drcontext)
 
     memtrace(drcontext, true);
 
+    // This may be the process exiting, with the writer suspended, so we do
+    // not wait for it.
+    if (use_async_writer)
+        writer_drain();
     if (op_offline.get_value())
         file_ops_func.close_file(data->file);
 
     dr_mutex_lock(mutex);
     num_refs += data->num_refs;
     dr_mutex_unlock(mutex);
-    dr_raw_mem_free(data->buf_base, max_buf_size);
+    if (data->pool != NULL) {
+        uint i;
+        // The pool includes the current buffer.
+        for (i = 0; i < data->num_pool_bufs; i++)
+            dr_raw_mem_free(data->pool[i].base, max_buf_size);
+        dr_thread_free(drcontext, data->pool, data->pool_size * sizeof(pool_buf_t));
+    } else
+        dr_raw_mem_free(data->buf_base, max_buf_size);
     if (data->reserve_buf != NULL)
         dr_raw_mem_free(data->reserve_buf, max_buf_size);
+    if (data->l0_dcache != NULL)
+        dr_thread_free(drcontext, data->l0_dcache, l0_dcache_lines * sizeof(ptr_uint_t));
+    if (data->l0_icache != NULL)
+        dr_thread_free(drcontext, data->l0_icache, l0_icache_lines * sizeof(ptr_uint_t));
     dr_thread_free(drcontext, data, sizeof(per_thread_t));
 }
 
@@ -887,6 +1403,18 @@ event_exit(void)
     if (!dr_raw_tls_cfree(tls_offs, MEMTRACE_TLS_COUNT))
         DR_ASSERT(false);
 
+    if (use_async_writer) {
+        /* All threads have drained the queue, so the writer is idle and will
+         * not run again.
+         */
+#ifdef LINUX
+        dr_unregister_fork_init_event(event_fork_init);
+#endif
+        dr_event_destroy(writer_wakeup);
+        dr_mutex_destroy(writer_busy);
+        dr_mutex_destroy(writer_lock);
+    }
+
     if (!drmgr_unregister_tls_field(tls_idx) ||
         !drmgr_unregister_thread_init_event(event_thread_init) ||
         !drmgr_unregister_thread_exit_event(event_thread_exit) ||
@@ -981,6 +1509,51 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         dr_abort();
     }
 
+    if (op_L0_filter.get_value()) {
+#ifndef X86
+        NOTIFY(0, "Usage error: -L0_filter is not yet supported on this platform\n");
+        dr_abort();
+#endif
+        // XXX: raw2trace reconstructs each bb's entries from its decoded instrs,
+        // so it would need to know which of them were filtered out.
+        if (op_offline.get_value()) {
+            NOTIFY(0, "Usage error: -L0_filter is not yet supported with -offline\n");
+            dr_abort();
+        }
+        line_bits = compute_log2((int)op_line_size.get_value());
+        if (line_bits < 0) {
+            NOTIFY(0, "Usage error: -line_size must be a power of two\n");
+            dr_abort();
+        }
+        l0_icache_lines = (ptr_uint_t)(op_L0I_size.get_value() >> line_bits);
+        l0_dcache_lines = (ptr_uint_t)(op_L0D_size.get_value() >> line_bits);
+        if ((l0_icache_lines << line_bits) != op_L0I_size.get_value() ||
+            (l0_dcache_lines << line_bits) != op_L0D_size.get_value() ||
+            (l0_icache_lines != 0 && !IS_POWER_OF_2(l0_icache_lines)) ||
+            (l0_dcache_lines != 0 && !IS_POWER_OF_2(l0_dcache_lines))) {
+            NOTIFY(0, "Usage error: -L0I_size and -L0D_size must be power of two "
+                   "multiples of -line_size\n");
+            dr_abort();
+        }
+        // The filter needs a 3rd and a 4th scratch register.
+        ops.num_spill_slots += 2;
+    }
+
+    if (op_async_writer.get_value() && op_offline.get_value()) {
+#ifdef LINUX
+        if (op_writer_buffers.get_value() < 2) {
+            NOTIFY(0, "Usage error: -writer_buffers must be at least 2\n");
+            dr_abort();
+        }
+        // A handoff_buf callback already takes the buffers off our hands.
+        use_async_writer = (file_ops_func.handoff_buf == NULL);
+#else
+        // XXX: we need to drain the writer before the process exits, which
+        // we only detect on Linux.
+        NOTIFY(0, "-async_writer is not yet supported on this platform\n");
+#endif
+    }
+
     if (op_offline.get_value()) {
         void *buf;
         if (!init_offline_dir()) {
@@ -1056,6 +1629,20 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
     if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, MEMTRACE_TLS_COUNT, 0))
         DR_ASSERT(false);
 
+    if (use_async_writer) {
+        writer_lock = dr_mutex_create();
+        writer_busy = dr_mutex_create();
+        writer_wakeup = dr_event_create();
+        writer_active = true;
+        if (!dr_create_client_thread(writer_thread_main, NULL)) {
+            NOTIFY(0, "Failed to create the writer thread: writing synchronously.\n");
+            writer_active = false;
+        }
+#ifdef LINUX
+        dr_register_fork_init_event(event_fork_init);
+#endif
+    }
+
     /* make it easy to tell, by looking at log file, which client executed */
     dr_log(NULL, LOG_ALL, 1, "drcachesim client initializing\n");
 
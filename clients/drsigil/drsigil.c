@@ -11,9 +11,6 @@
 #include "drreg.h"
 
 
-volatile bool roi = true;
-/* unused currently */
-
 static uint64 num_threads = 0;
 /* Thread IDs are generated by the order of each thread's initialization */
 
@@ -37,29 +34,21 @@ event_bb_instrument(void *drcontext, /*UNUSED*/ void *tag,
 
     per_thread_t *tcxt = drmgr_get_tls_field(drcontext, tls_idx);
 
-    /* reset the event block state if a new event block*/
-    if (instrlist_first_app(ilist) == where ||
-        instr_is_cti(instr_get_prev_app(where)))
-        instrument_reset(drcontext, ilist, where, tcxt);
-
-    /* set up the current iblock */
-    instr_block_t *iblock = tcxt->iblocks + tcxt->iblock_count;
-    iblock->instr = where;
-    iblock->mem_ref_count = 0;
-    iblock->comp_count = 0;
-    tcxt->iblock_count += 1;
-    tcxt->event_block_events += 1; //instr
+    if (instrlist_first_app(ilist) == where)
+    {
+        tcxt->instrument_bb = instrumenting;
+        instrument_sample_budget(drcontext, ilist, where);
+    }
 
-    if (instr_reads_memory(where) || instr_writes_memory(where))
-        instrument_mem_cache(drcontext, ilist, where, &iblock->mem_ref_count);
-    tcxt->event_block_events += iblock->mem_ref_count;
+    /* between samples, the application runs (almost) uninstrumented */
+    if (!tcxt->instrument_bb)
+        return DR_EMIT_DEFAULT;
 
-    instrument_comp_cache(where, &iblock->comp_count, tcxt->current_iblock_comp);
-    tcxt->event_block_events += iblock->comp_count;
-    tcxt->current_iblock_comp += iblock->comp_count;
+    /* reserve the event slots if a new event block */
+    if (is_event_block_start(drcontext, where))
+        instrument_event_block(drcontext, ilist, where, tcxt);
 
-    if (instr_is_cti(where) || where == instrlist_last_app(ilist))
-        instrument_sigil_events(drcontext, ilist, where, tcxt);
+    instrument_instr_events(drcontext, ilist, where, tcxt);
 
     return DR_EMIT_DEFAULT;
 }
@@ -94,38 +83,45 @@ event_thread_init(void *drcontext)
                             DRREG_CONTAINS_SPANNING_CONTROL_FLOW | DRREG_IGNORE_CONTROL_FLOW);
 
     per_thread_t *init = dr_thread_alloc(drcontext, sizeof(per_thread_t));
-    init->memrefs      = dr_thread_alloc(drcontext, MEM_BUF_SIZE);
-    init->comps        = dr_thread_alloc(drcontext, COMP_BUF_SIZE);
-    init->iblocks      = dr_thread_alloc(drcontext, IBLOCK_BUF_SIZE);
     init->sync_ev      = dr_thread_alloc(drcontext, sizeof(SglSyncEv));
+    init->discard      = dr_thread_alloc(drcontext, DISCARD_BUF_SIZE);
+    init->anchor_offs  = dr_thread_alloc(drcontext, ANCHOR_OFFS_BUF_SIZE);
+    init->compact_record = dr_thread_alloc(drcontext, DISCARD_BUF_SIZE);
 
     if (init          == NULL ||
-        init->memrefs == NULL ||
-        init->comps   == NULL ||
         init->sync_ev == NULL ||
-        init->iblocks == NULL)
+        init->discard == NULL ||
+        init->anchor_offs == NULL ||
+        init->compact_record == NULL)
         DR_ABORT_MSG("Failed to allocate per-thread data\n");
 
     init->thread_id = __sync_add_and_fetch(&num_threads,1);
     init->has_channel_lock = false;
+    init->has_buffer = false;
+    init->buf_idx = 0;
     init->is_blocked = false;
-    init->current_iblock_comp = init->comps;
-    init->iblock_count = 0;
+    init->event_block_slot = 0;
+    init->event_block_mem = 0;
     init->event_block_events = 0;
+    init->discard_used = 0;
 
     init->seg_base = dr_get_dr_segment_base(raw_tls_seg);
     PERTHR_PTR(init->seg_base)     = init;
-    IBLOCKS_PTR(init->seg_base)    = init->iblocks;
-    MEMREFBASE_PTR(init->seg_base) = init->memrefs;
-    MEMREFCURR_PTR(init->seg_base) = init->memrefs;
+    BLOCK_PTR(init->seg_base)      = init->discard;
+    DISCARD_PTR(init->seg_base)    = init->discard;
     SGLEV_PTR(init->seg_base)      = NULL;
     SGLEND_PTR(init->seg_base)     = NULL;
     SGLUSED_PTR(init->seg_base)    = NULL;
+    COMMIT_EV_PTR(init->seg_base)  = NULL;
+    COMMIT_USED_PTR(init->seg_base) = &init->discard_used;
     SGLSYNCEV_PTR(init->seg_base)  = NULL;
+    init_thread_sampling(init);
     ACTIVE(init->seg_base)         = true;
-    /* TODO(someday) are we sure we want to activate
-     * this thread right away? */
     drmgr_set_tls_field(drcontext, tls_idx, init);
+
+    /* Client threads can only be relied upon once the app is running */
+    if (init->thread_id == 1 && clo.ipc_bench > 0)
+        benchmark_IPC(clo.ipc_bench);
 }
 
 
@@ -134,10 +130,11 @@ event_thread_exit(void *drcontext)
 {
     per_thread_t *tcxt = drmgr_get_tls_field(drcontext, tls_idx);
     force_thread_flush(tcxt);
-    dr_thread_free(drcontext, tcxt->memrefs, MEM_BUF_SIZE);
-    dr_thread_free(drcontext, tcxt->comps, COMP_BUF_SIZE);
-    dr_thread_free(drcontext, tcxt->iblocks, IBLOCK_BUF_SIZE);
+    exit_thread_sampling(tcxt);
     dr_thread_free(drcontext, tcxt->sync_ev, sizeof(SglSyncEv));
+    dr_thread_free(drcontext, tcxt->discard, DISCARD_BUF_SIZE);
+    dr_thread_free(drcontext, tcxt->anchor_offs, ANCHOR_OFFS_BUF_SIZE);
+    dr_thread_free(drcontext, tcxt->compact_record, DISCARD_BUF_SIZE);
     dr_thread_free(drcontext, tcxt, sizeof(per_thread_t));
 }
 
@@ -147,6 +144,8 @@ event_exit(void)
 {
     for(int i=0; i<clo.frontend_threads; ++i)
         terminate_IPC(i);
+    if (clo.event_templates)
+        terminate_event_templates();
 
     if (!dr_raw_tls_cfree(raw_tls_memref_offs, MEMREF_TLS_COUNT))
         DR_ABORT_MSG("failed to free raw tls");
@@ -215,6 +214,9 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
 {
     parse(argc, (char**)argv, &clo);
 
+    /* compact records must start in a single event slot */
+    DR_ASSERT(sizeof(compact_block_header_t) <= sizeof(SglEvVariant));
+
     dr_set_client_name("DrSigil",
                        "https://github.com/VANDAL/sigil2/issues");
     dr_register_exit_event(event_exit);
@@ -249,6 +251,10 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     /* There are 'frontend_threads' number of channels */
     for(int i=0; i<clo.frontend_threads; ++i)
         init_IPC(i, clo.ipc_dir, clo.standalone);
+    if (clo.event_templates)
+        init_event_templates(clo.ipc_dir, clo.standalone);
+
+    init_sampling();
 
     /* initialize thread local resources */
     tls_idx = drmgr_register_tls_field();
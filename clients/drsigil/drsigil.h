@@ -8,6 +8,8 @@
 
 #define MINSERT instrlist_meta_preinsert
 
+#define ALIGN_UP(x, alignment) (((x) + (alignment) - 1) & ~((alignment) - 1))
+
 #define RESERVE_REGISTER(reg) \
     if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg) != DRREG_SUCCESS) \
         DR_ASSERT(false);
@@ -50,6 +52,38 @@ typedef struct _ticket_queue_t
 } ticket_queue_t;
 
 
+typedef struct _ipc_doorbell_t
+{
+    /* Futex-based signalling between DrSigil and Sigil2
+     *
+     * This lives in its own small shared memory file next to the event
+     * buffers. Instead of a fifo write/read per buffer hand-off, the state
+     * of each buffer is kept here, and either side only parks on a futex
+     * when the other side is actually behind. */
+
+    volatile int buf_state[SIGIL2_IPC_BUFFERS];
+    /* DRSIGIL_BUF_EMPTY or DRSIGIL_BUF_FULL;
+     * DrSigil parks on a buffer's state word when it is still full */
+
+    volatile int full_count;
+    /* Incremented for every full buffer;
+     * Sigil2 parks on this word when there is nothing to consume */
+
+    volatile int producer_waiting;
+    volatile int consumer_waiting;
+    /* Only issue a futex wake if the other side is parked */
+} ipc_doorbell_t;
+
+#define DRSIGIL_BUF_EMPTY 0
+#define DRSIGIL_BUF_FULL  1
+#define DRSIGIL_IPC_DOORBELL_BASENAME "sgl2-doorbell"
+
+#define DRSIGIL_BUF_UNCLAIMED 0
+#define DRSIGIL_BUF_CLAIMED   1
+#define DRSIGIL_BUF_DONE      2
+/* ipc_channel_t::buf_owner states */
+
+
 typedef struct _ipc_channel_t
 {
     /* The shared memory channel between this DynamoRIO client application and
@@ -77,16 +111,55 @@ typedef struct _ipc_channel_t
     /* Sigil2 updates DynamoRIO with the last
      * buffer consumed(empty) via this fifo */
 
+    ipc_doorbell_t *doorbell;
+    /* If not NULL, buffer hand-offs are signalled through this
+     * instead of the fifos. The fifos are then only used for
+     * the termination sequence */
+
     uint shmem_buf_idx;
     /* The current buffer being filled in shared memory
      * Must wrap around back to 0 at 'SIGIL2_DBI_BUFFERS' */
 
-    bool empty_buf_idx[SIGIL2_IPC_BUFFERS];
+    volatile bool empty_buf_idx[SIGIL2_IPC_BUFFERS];
     /* Corresponds to each buffer that is available for writing */
 
     uint last_active_tid;
     /* Required to let Sigil2 know when the TID of the current thread has changed */
 
+    volatile uint next_seq;
+    /* Lock-free mode only.
+     * Sequence number of the next shared memory buffer to be claimed.
+     * Each application thread claims whole buffers for itself, and
+     * tags each buffer with this sequence number. Buffers are handed off
+     * in this order, see notify_seq */
+
+    volatile uint buf_turn[SIGIL2_IPC_BUFFERS];
+    /* Lock-free mode only.
+     * For each buffer, the sequence number of its current or next user.
+     * It only advances once the buffer has been handed off, so only the
+     * one thread holding that sequence number can take the buffer */
+
+    volatile uint buf_owner[SIGIL2_IPC_BUFFERS];
+    /* Lock-free mode only.
+     * For each buffer, whether the user in buf_turn has claimed it yet,
+     * and whether it has finished with it.
+     * Kept apart from buf_turn, so a state can never be mistaken for a
+     * sequence number, even once the sequence numbers wrap around */
+
+    volatile uint notify_seq;
+    void *notify_lock;
+    /* Lock-free mode only.
+     * Sequence number of the next buffer to hand off to Sigil2.
+     * Buffers are handed off strictly in sequence order, so the full fifo
+     * sees the same order of buffers as with the ticket lock; a buffer
+     * finished out of order is handed off by the thread that finishes
+     * the buffers before it */
+
+    void *empty_fifo_lock;
+    /* Lock-free mode only.
+     * Taken only on the slow path, when a claimed buffer has not been
+     * released by Sigil2 yet and the empty fifo must be read */
+
     bool initialized;
     /* If this is a valid channel */
 
@@ -96,33 +169,143 @@ typedef struct _ipc_channel_t
 } ipc_channel_t;
 
 /////////////////////////////////////////////////////////////////////
-//                           Thread Data                           //
+//                        Event Block Templates                    //
 /////////////////////////////////////////////////////////////////////
+/* With --event-templates, the static part of each event block's compact
+ * record (everything but the anchors) is built once, at translation time,
+ * and published in a template table that Sigil2 maps. Each execution of
+ * the event block then only sends a compact_template_ref_t followed by
+ * its anchor addresses.
+ *
+ * The template table is a file in the ipc directory, created by DrSigil:
+ *
+ *   template_table_t
+ *   entries, each 8-byte aligned:
+ *     uint32_t id
+ *     uint32_t len
+ *     byte     record[len]   (the static part of a compact record)
+ *
+ * Entries are only appended. An entry is complete before num_templates
+ * and used are updated, and before any event referencing it is sent. */
 
-typedef struct _mem_ref_t
+#define DRSIGIL_TEMPLATE_TAG 0x81
+#define DRSIGIL_IPC_TEMPLATES_BASENAME "sgl2-templates"
+#define DRSIGIL_TEMPLATE_TABLE_MB 64
+/* default size of the template table, see --template-table-mb */
+
+typedef struct _compact_template_ref_t
 {
-    MemType type;
-    ushort size; // XXX big enough?
-    void *addr;
-} mem_ref_t;
+    uint8_t  tag;          /* DRSIGIL_TEMPLATE_TAG */
+    uint8_t  reserved;
+    uint16_t num_anchors;  /* anchors follow this header */
+    uint32_t template_id;
+} compact_template_ref_t;
 
-#define MAX_NUM_MEM_REFS 2048
-#define MEM_BUF_SIZE (sizeof(mem_ref_t) * MAX_NUM_MEM_REFS)
-/* we should not have more than this many memory references per basic block */
+typedef struct _template_table_t
+{
+    volatile uint64_t used;  /* bytes, including this header */
+    volatile uint32_t num_templates;
+    uint32_t reserved;
+} template_table_t;
 
-typedef struct _instr_block_t
+typedef struct _event_template_t event_template_t;
+struct _event_template_t
 {
-    instr_t *instr;
-    uint mem_ref_count;
-    uint comp_count;
-} instr_block_t;
+    /* The translation-time layout of an event block, shared by all threads
+     * and never modified once created */
+
+    uint id;
+    app_pc start;
+    uint num_instrs;
+    uint code_len;
+    uint64 code_hash;
+    /* Identifies the code the template was built from,
+     * in case the code at 'start' changes */
+
+    uint num_mem;
+    int *anchor_offs;
+    /* For each memory reference, the offset of the anchor it computes
+     * in a template ref record, or -1 */
+
+    uint num_slots;
+    /* Event slots taken by a template ref record, including anchors */
+
+    compact_template_ref_t ref;
+    /* The static part of a template ref record */
+
+    event_template_t *next;
+};
+
+
+/////////////////////////////////////////////////////////////////////
+//                           Thread Data                           //
+/////////////////////////////////////////////////////////////////////
+
+#define MAX_EVENT_BLOCK_EVENTS 4096
+#define DISCARD_BUF_SIZE (sizeof(SglEvVariant) * MAX_EVENT_BLOCK_EVENTS)
+/* we should not have more sigil events than this per event block */
+
+#define MAX_EVENT_BLOCK_MEM_REFS 2048
+#define ANCHOR_OFFS_BUF_SIZE (sizeof(int) * MAX_EVENT_BLOCK_MEM_REFS)
+/* we should not have more memory references than this per event block */
+
+
+/////////////////////////////////////////////////////////////////////
+//                      Compact Event Encoding                     //
+/////////////////////////////////////////////////////////////////////
+/* With --compact-events, each event block is sent as a single variable
+ * length record instead of one SglEvVariant per event. The record takes
+ * up a whole number of event slots, and is laid out as:
+ *
+ *   compact_block_header_t
+ *   compact_instr_desc_t  [num_instrs]
+ *   compact_mem_desc_t    [num_mem]
+ *   delta                 [num_mem]     (delta_width bytes each, signed)
+ *   (padding to 8 bytes)
+ *   PtrVal anchors        [num_anchors]
+ *
+ * Memory addresses are sent as an anchor address plus a delta.
+ * Accesses through the same base/index registers, with no write to those
+ * registers in between, share an anchor; their deltas are the differences
+ * in displacement. Only the anchors are computed at runtime, the rest of
+ * the record is the same for every execution of the event block.
+ *
+ * Compute events are coalesced into per-block counters.
+ * Instruction addresses are sent as the first pc plus instruction lengths,
+ * so an event block never spans a gap in the code, such as an elided
+ * direct jmp or call (see is_event_block_end).
+ *
+ * Sigil2 decodes these records on its side. */
 
-#define MAX_NUM_COMPS 1024
-#define COMP_BUF_SIZE (sizeof(SglCompEv) * MAX_NUM_COMPS)
+#define DRSIGIL_COMPACT_TAG 0x80
+/* Does not collide with the SglEvVariant tags */
 
-#define MAX_NUM_IBLOCKS 1024
-#define IBLOCK_BUF_SIZE (sizeof(instr_block_t) * MAX_NUM_IBLOCKS)
-/* we should not need more than this per basic block */
+typedef struct _compact_block_header_t
+{
+    uint8_t  tag;          /* DRSIGIL_COMPACT_TAG */
+    uint8_t  delta_width;  /* 1, 2, or 4 */
+    uint16_t num_instrs;
+    uint16_t num_mem;
+    uint16_t num_anchors;
+    uint16_t num_iops;
+    uint16_t num_flops;
+    uint32_t num_slots;    /* event slots taken by the entire record */
+    PtrVal   first_pc;
+} compact_block_header_t;
+
+typedef struct _compact_instr_desc_t
+{
+    uint8_t length;
+    uint8_t num_mem;
+} compact_instr_desc_t;
+
+typedef struct _compact_mem_desc_t
+{
+    uint8_t  type;         /* MemType */
+    uint8_t  reserved;
+    uint16_t size;
+    uint16_t anchor;       /* index into anchors */
+} compact_mem_desc_t;
 
 typedef struct _per_thread_t
 {
@@ -143,6 +326,15 @@ typedef struct _per_thread_t
     bool has_channel_lock;
     /* Is allowed to use the ipc channel */
 
+    bool has_buffer;
+    uint buf_idx;
+    /* Lock-free mode only.
+     * The shared memory buffer this thread owns exclusively, if any */
+
+    uint sample_phase;
+    /* Periodic sampling only.
+     * The last global sampling phase this thread has seen */
+
     bool is_blocked;
     /* Mostly used for debugging.
      * Is about to wait on a application-side lock.
@@ -150,29 +342,40 @@ typedef struct _per_thread_t
      * has the channel lock while blocked, otherwise
      * we end up with an application-side deadlock */
 
-    mem_ref_t *memrefs;
-    /* Track memory references per event block.
-     * This is used as an optimization in the instrumentation implementation.
-     * A local buffer will hold all mem refs, and only at the end of each
-     * branching instruction, all sigil events will be written to shared memory
-     * (e.g. the mem refs, instructions, compute, synchronization, ...) */
-
-    SglCompEv *comps;
-    SglCompEv *current_iblock_comp;
-    /* Keep a local buffer of compute per event block.
-     * This just simplifies instrumentation */
-
     SglSyncEv *sync_ev;
     /* The latest sync event */
 
-    instr_block_t *iblocks;
-    uint iblock_count;
-    /* Each iblock holds sigil event data for a single instruction.
-     * The iblock buffer holds event data for a single event block */
+    uint event_block_slot;
+    /* Translation-time only.
+     * Slot of the next event within the event block being instrumented.
+     * Each event block reserves all of its event slots up front, and each
+     * instruction writes its events straight into its own slots */
 
     uint event_block_events;
-    /* total sigil events for the current event block
-     * (single-entry, single-exit) */
+    /* Translation-time only.
+     * Event slots reserved by the event block being instrumented */
+
+    SglEvVariant *discard;
+    size_t discard_used;
+    /* Event blocks of an inactive thread write their events here,
+     * so instructions never need to check if the thread is active */
+
+    uint event_block_mem;
+    int *anchor_offs;
+    byte *compact_record;
+    /* Translation-time only, for compact events.
+     * The next memory reference within the event block, the byte offset of
+     * the anchor each memory reference computes (or -1 if it is a delta),
+     * and the static part of the event block's record */
+
+    bool instrument_bb;
+    /* Translation-time only.
+     * Whether the basic block being built gets full instrumentation,
+     * fixed at its first instruction in case sampling switches mid-block */
+
+    const int *event_block_anchor_offs;
+    /* Translation-time only.
+     * Either anchor_offs, or the anchor offsets of the event block's template */
 
     byte *seg_base;
     /* So we can access the raw TLS from client clean calls */
@@ -181,17 +384,26 @@ typedef struct _per_thread_t
 
 #define MIN_DR_PER_THREAD_BUFFER_EVENTS (1UL << 20)
 
-volatile extern bool roi;
 /* Region-Of-Interest (ROI)
  *
  * If data should be collected or not, depending on command line arguments.
  * If no relevant args are supplied, then the ROI is assumed to be the
  * entirety of the application.
  *
- * Assumes the ROI is correctly implemented, and gets turned on/off in the
- * serial portion of the application.
- * XXX There is no per-thread ROI.
- * TODO Make atomic */
+ * The ROI is per-thread, see MEMREF_TLS_OFFS_IN_ROI: a thread collects
+ * events between its own calls to start_func and stop_func.
+ * Without a start_func, every thread starts inside its ROI.
+ * With one, every thread starts outside of it, including threads that
+ * already exist, or are spawned, while another thread is inside its ROI;
+ * entering or leaving the ROI never changes any other thread's state */
+
+volatile extern bool instrumenting;
+/* Sampling only.
+ * Whether newly built fragments get full instrumentation.
+ * Fragments built outside of a sample only count instructions
+ * (periodic sampling), or nothing at all (ROI sampling), so the application
+ * runs at near-native speed between samples. Every switch flushes the
+ * code cache, so fragments are rebuilt for the new mode */
 
 extern int tls_idx;
 /* thread-local storage for per_thread_t */
@@ -206,18 +418,32 @@ enum
     MEMREF_TLS_OFFS_SGLUSED_PTR,
     /* sigil shared memory buffer */
 
-    MEMREF_TLS_OFFS_IBLOCKS_PTR,
+    MEMREF_TLS_OFFS_BLOCK_PTR,
+    /* the first event slot reserved by the current event block */
+
+    MEMREF_TLS_OFFS_COMMIT_EV_PTR,
+    MEMREF_TLS_OFFS_COMMIT_USED_PTR,
+    /* The events_ptr to publish, and the events_used to bump,
+     * once the current event block has written all of its events */
 
-    MEMREF_TLS_OFFS_MEMREFBASE_PTR,
-    MEMREF_TLS_OFFS_MEMREFCURR_PTR,
-    /* the mem cache where addresses are stored */
+    MEMREF_TLS_OFFS_DISCARD_PTR,
+    /* where inactive threads write their events */
 
     MEMREF_TLS_OFFS_SGLSYNCEV_PTR,
     /* holds NULL if no event, otherwise holds a SglSyncEv */
 
     MEMREF_TLS_OFFS_ACTIVE,
     /* whether the thread is under active instrumentation,
-     * e.g. a thread is inactive in a lock */
+     * e.g. a thread is inactive in a lock.
+     * Events are only collected if the thread is also inside its ROI */
+
+    MEMREF_TLS_OFFS_IN_ROI,
+    /* whether the thread is inside its Region-Of-Interest,
+     * only ever written by the thread itself */
+
+    MEMREF_TLS_OFFS_SAMPLE_BUDGET,
+    /* Periodic sampling only.
+     * Instructions left in the current sampling phase, as a signed count */
 
     MEMREF_TLS_COUNT,
 };
@@ -231,21 +457,27 @@ extern uint     raw_tls_memref_offs;
 #define SGLEV_PTR(tls_base) *(SglEvVariant **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_SGLEV_PTR)
 #define SGLEND_PTR(tls_base) *(SglEvVariant **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_SGLEND_PTR)
 #define SGLUSED_PTR(tls_base) *(size_t **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_SGLUSED_PTR)
-#define IBLOCKS_PTR(tls_base) *(instr_block_t **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_IBLOCKS_PTR)
-#define MEMREFBASE_PTR(tls_base) *(mem_ref_t **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_MEMREFBASE_PTR)
-#define MEMREFCURR_PTR(tls_base) *(mem_ref_t **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_MEMREFCURR_PTR)
+#define BLOCK_PTR(tls_base) *(SglEvVariant **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_BLOCK_PTR)
+#define COMMIT_EV_PTR(tls_base) *(SglEvVariant **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_COMMIT_EV_PTR)
+#define COMMIT_USED_PTR(tls_base) *(size_t **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_COMMIT_USED_PTR)
+#define DISCARD_PTR(tls_base) *(SglEvVariant **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_DISCARD_PTR)
 #define ACTIVE(tls_base) *(bool *)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_ACTIVE)
+#define IN_ROI(tls_base) *(bool *)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_IN_ROI)
 #define SGLSYNCEV_PTR(tls_base) *(SglSyncEv **)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_SGLSYNCEV_PTR)
+#define SAMPLE_BUDGET(tls_base) *(ptr_int_t *)TLS_SLOT(tls_base, MEMREF_TLS_OFFS_SAMPLE_BUDGET)
 
 #define PERTHR_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_PERTHR_PTR*sizeof(void*))
 #define SGLEV_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_SGLEV_PTR*sizeof(void*))
 #define SGLEND_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_SGLEND_PTR*sizeof(void*))
 #define SGLUSED_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_SGLUSED_PTR*sizeof(void*))
-#define IBLOCKS_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_IBLOCKS_PTR*sizeof(void*))
-#define MEMREFBASE_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_MEMREFBASE_PTR*sizeof(void*))
-#define MEMREFCURR_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_MEMREFCURR_PTR*sizeof(void*))
+#define BLOCK_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_BLOCK_PTR*sizeof(void*))
+#define COMMIT_EV_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_COMMIT_EV_PTR*sizeof(void*))
+#define COMMIT_USED_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_COMMIT_USED_PTR*sizeof(void*))
+#define DISCARD_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_DISCARD_PTR*sizeof(void*))
 #define ACTIVE_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_ACTIVE*sizeof(void*))
+#define IN_ROI_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_IN_ROI*sizeof(void*))
 #define SGLSYNCEV_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_SGLSYNCEV_PTR*sizeof(void*))
+#define SAMPLE_BUDGET_OFFS (raw_tls_memref_offs + MEMREF_TLS_OFFS_SAMPLE_BUDGET*sizeof(void*))
 
 /////////////////////////////////////////////////////////////////////
 //                           Option Parsing                        //
@@ -270,6 +502,47 @@ struct _command_line_options
      * to run this tool without Sigil2.
      * This flag instructs the tool to ignore IPC with the
      * Sigil2 core */
+
+    bool lockfree;
+    /* Each application thread claims entire shared memory buffers
+     * for itself, instead of taking turns on a channel's ticket lock.
+     * Every buffer starts with a thread swap event carrying the thread id
+     * and the buffer's sequence number. Buffers are handed to Sigil2 in
+     * sequence order, so the fifo protocol is the same as without this */
+
+    bool futex_ipc;
+    /* Signal full/empty buffers through shared memory state words
+     * and futexes, instead of the full/empty fifos */
+
+    int ipc_bench;
+    /* Standalone only.
+     * Measure this many buffer hand-offs through both the fifo and the
+     * futex signalling paths at startup, and report hand-offs/sec */
+
+    bool compact_events;
+    /* Send each event block as one compact record,
+     * see compact_block_header_t */
+
+    bool event_templates;
+    /* Send each event block as a template id and its anchors,
+     * see compact_template_ref_t. Implies compact_events */
+
+    uint64 sample_on;
+    uint64 sample_off;
+    /* Periodic sampling.
+     * Alternate between this many instructions (given in millions)
+     * with full instrumentation, and this many without.
+     * Zero disables periodic sampling */
+
+    bool sample_roi;
+    /* Only build instrumented fragments while some thread is in the ROI.
+     * Requires start_func */
+
+    uint64 template_table_mb;
+    /* Size of the event template table, in MB.
+     * Only the pages that templates are written to are ever backed by
+     * memory, but the whole table is mapped up front so that Sigil2 can
+     * map it once; Sigil2 takes the size from the table file */
 } clo;
 
 
@@ -277,24 +550,40 @@ struct _command_line_options
 //                         FUNCTION DECLARATIONS                   //
 /////////////////////////////////////////////////////////////////////
 
-/* The instrumentation functions MUST be called in a specific order */
-/* TODO document preconditions/postconditions */
-void instrument_reset(void *drcontext, instrlist_t *ilist, instr_t *where,
-                      per_thread_t *tcxt);
+/* The instrumentation functions MUST be called in a specific order:
+ * instrument_event_block() at the first instruction of each event block,
+ * then instrument_instr_events() at every instruction of the event block */
+void instrument_event_block(void *drcontext, instrlist_t *ilist, instr_t *where,
+                            per_thread_t *tcxt);
 
-void instrument_mem_cache(void *drcontext, instrlist_t *ilist, instr_t *where,
-                          uint *mem_ref_count);
-
-void instrument_comp_cache(instr_t *instr, uint *comp_count, SglCompEv *cache);
-
-void instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
+void instrument_instr_events(void *drcontext, instrlist_t *ilist, instr_t *where,
                              per_thread_t *tcxt);
 
+bool is_event_block_start(void *drcontext, instr_t *instr);
+bool is_event_block_end(void *drcontext, instr_t *instr);
+
 /* IPC */
 void init_IPC(int idx, const char *path, bool standalone);
 void terminate_IPC(int idx);
 void set_shared_memory_buffer(per_thread_t *tcxt);
 void force_thread_flush(per_thread_t *tcxt);
+void benchmark_IPC(int handoffs);
+
+/* Event block templates */
+void init_event_templates(const char *path, bool standalone);
+void terminate_event_templates(void);
+const event_template_t *get_event_template(void *drcontext, instr_t *first,
+                                           per_thread_t *tcxt);
+uint build_compact_record(void *drcontext, instr_t *first, per_thread_t *tcxt,
+                          uint *record_len);
+
+/* Region-Of-Interest and sampling */
+void init_sampling(void);
+void init_thread_sampling(per_thread_t *tcxt);
+void exit_thread_sampling(per_thread_t *tcxt);
+void roi_enter(per_thread_t *tcxt);
+void roi_exit(per_thread_t *tcxt);
+void instrument_sample_budget(void *drcontext, instrlist_t *ilist, instr_t *where);
 
 void parse(int argc, char *argv[], command_line_options *clo);
 
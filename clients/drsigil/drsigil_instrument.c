@@ -4,135 +4,45 @@
 #include "drreg.h"
 #include <stddef.h> /* for offsetof */
 #include <limits.h> /* for INT_MAX */
+#include <string.h> /* for memset */
 
 #define SIZEOF_EVENT_SLOT sizeof(SglEvVariant)
 
-void
-instrument_reset(void *drcontext, instrlist_t *ilist, instr_t *where,
-                 per_thread_t *tcxt)
-{
-    /* Reset event block data */
-    tcxt->iblock_count = 0;
-    tcxt->event_block_events = 0;
-    tcxt->current_iblock_comp = tcxt->comps;
-
-    /* reset mem ref buffer to point to the beginning */
-    reg_id_t reg;
-    RESERVE_REGISTER(reg);
-    dr_insert_read_raw_tls(drcontext, ilist, where,
-                           raw_tls_seg, MEMREFBASE_OFFS, reg);
-    dr_insert_write_raw_tls(drcontext, ilist, where,
-                            raw_tls_seg, MEMREFCURR_OFFS, reg);
-    UNRESERVE_REGISTER(reg);
-}
-
-
-static void
-instrument_mem_cache_helper(void *drcontext, instrlist_t *ilist, instr_t *where,
-                            reg_id_t buf_ptr, reg_id_t addr_reg, reg_id_t scratch_reg,
-                            ushort size, MemType type, opnd_t ref)
-{
-    /* set the attributes */
-
-    /* READ/WRITE */
-    MINSERT(ilist, where,
-            XINST_CREATE_store_1byte(drcontext,
-                                     OPND_CREATE_MEM8(buf_ptr, offsetof(mem_ref_t, type)),
-                                     OPND_CREATE_INT8(type)));
-
-    /* size of the mem ref operand */
-    MINSERT(ilist, where,
-            XINST_CREATE_store_2bytes(drcontext,
-                                      OPND_CREATE_MEM16(buf_ptr, offsetof(mem_ref_t, size)),
-                                      OPND_CREATE_INT16(size)));
+#define MAX_ANCHOR_GROUPS 16
+/* memory references that can currently share an anchor */
 
-    /* memory address */
-    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, addr_reg, scratch_reg);
-    MINSERT(ilist, where,
-            XINST_CREATE_store(drcontext,
-                               OPND_CREATE_MEMPTR(buf_ptr, offsetof(mem_ref_t, addr)),
-                               opnd_create_reg(addr_reg)));
-}
-void
-instrument_mem_cache(void *drcontext, instrlist_t *ilist, instr_t *where,
-                     uint *mem_ref_count)
+static uint
+count_mem_refs(instr_t *instr)
 {
-    reg_id_t buf_ptr, scratch1, scratch2;
-    drreg_reserve_aflags(drcontext, ilist, where);
-    RESERVE_REGISTER(buf_ptr);
-    RESERVE_REGISTER(scratch1);
-    RESERVE_REGISTER(scratch2);
+    uint mem_ref_count = 0;
 
-    /* current mem ref buffer pointer */
-    dr_insert_read_raw_tls(drcontext, ilist, where,
-                           raw_tls_seg, MEMREFCURR_OFFS, buf_ptr);
-
-    if (instr_reads_memory(where))
+    if (instr_reads_memory(instr))
     {
-        for (int i=0; i<instr_num_srcs(where); ++i)
-        {
-            opnd_t ref = instr_get_src(where, i);
-            if (opnd_is_memory_reference(ref))
-            {
-                instrument_mem_cache_helper(drcontext, ilist, where,
-                                            buf_ptr, scratch1, scratch2,
-                                            drutil_opnd_mem_size_in_bytes(ref, where),
-                                            SGLPRIM_MEM_LOAD, ref);
-
-                /* update count and buffer */
-                ++*mem_ref_count;
-                MINSERT(ilist, where,
-                        XINST_CREATE_add(drcontext,
-                                         opnd_create_reg(buf_ptr),
-                                         OPND_CREATE_INT32(sizeof(mem_ref_t))));
-            }
-        }
+        for (int i=0; i<instr_num_srcs(instr); ++i)
+            if (opnd_is_memory_reference(instr_get_src(instr, i)))
+                ++mem_ref_count;
     }
 
-    if (instr_writes_memory(where))
+    if (instr_writes_memory(instr))
     {
-        for (int i=0; i<instr_num_dsts(where); ++i)
-        {
-            opnd_t ref = instr_get_dst(where, i);
-            if (opnd_is_memory_reference(ref))
-            {
-
-                instrument_mem_cache_helper(drcontext, ilist, where,
-                                            buf_ptr, scratch1, scratch2,
-                                            drutil_opnd_mem_size_in_bytes(ref, where),
-                                            SGLPRIM_MEM_STORE, ref);
-
-                /* update count and buffer */
-                ++*mem_ref_count;
-                MINSERT(ilist, where,
-                        XINST_CREATE_add(drcontext,
-                                         opnd_create_reg(buf_ptr),
-                                         OPND_CREATE_INT32(sizeof(mem_ref_t))));
-            }
-        }
+        for (int i=0; i<instr_num_dsts(instr); ++i)
+            if (opnd_is_memory_reference(instr_get_dst(instr, i)))
+                ++mem_ref_count;
     }
 
-    /* update the TLS mem ref pointer
-     * so new mem refs will be in the right place */
-    dr_insert_write_raw_tls(drcontext, ilist, where,
-                            raw_tls_seg, MEMREFCURR_OFFS, buf_ptr);
-
-    UNRESERVE_REGISTER(scratch2);
-    UNRESERVE_REGISTER(scratch1);
-    UNRESERVE_REGISTER(buf_ptr);
-    drreg_unreserve_aflags(drcontext, ilist, where);
+    return mem_ref_count;
 }
 
 
-void
-instrument_comp_cache(instr_t *instr, uint *comp_count, SglCompEv *cache)
+static uint
+get_comp_event(instr_t *instr, CompCostType *type)
 {
     /* TODO(soon) review these conditions */
     dr_fp_type_t fp_t;
     if(instr_is_floating_ex(instr, &fp_t) && (fp_t == DR_FP_MATH))
     {
-        cache->type = SGLPRIM_COMP_FLOP;
-        ++*comp_count;
+        *type = SGLPRIM_COMP_FLOP;
+        return 1;
     }
     else
     {
@@ -159,14 +69,79 @@ instrument_comp_cache(instr_t *instr, uint *comp_count, SglCompEv *cache)
         case OP_bts:
         case OP_btr:
         case OP_aas:
-            cache->type = SGLPRIM_COMP_IOP;
-            ++*comp_count;
+            *type = SGLPRIM_COMP_IOP;
+            return 1;
         default:
-            break;
+            return 0;
+        }
+    }
+}
+
+
+bool
+is_event_block_end(void *drcontext, instr_t *instr)
+{
+    /* An event block runs up to and including the next cti, or the last
+     * app instruction of the basic block. It also ends wherever the next
+     * instruction does not directly follow this one in memory, e.g. after
+     * a direct jmp or call that DR elided from the basic block, because
+     * compact records rebuild each pc from the previous instruction's length.
+     * Instructions without an app pc are not instrumented */
+    if (instr_is_cti(instr))
+        return true;
+
+    app_pc pc = instr_get_app_pc(instr);
+    if (pc == NULL)
+        return false;
+
+    for (instr_t *next = instr_get_next_app(instr); next != NULL;
+         next = instr_get_next_app(next))
+    {
+        app_pc next_pc = instr_get_app_pc(next);
+        if (next_pc != NULL)
+            return next_pc != pc + instr_length(drcontext, instr);
+        if (instr_is_cti(next))
+            return true;
+    }
+    return true;
+}
+
+
+bool
+is_event_block_start(void *drcontext, instr_t *instr)
+{
+    for (instr_t *prev = instr_get_prev_app(instr); prev != NULL;
+         prev = instr_get_prev_app(prev))
+    {
+        if (instr_get_app_pc(prev) != NULL || instr_is_cti(prev))
+            return is_event_block_end(drcontext, prev);
+    }
+    return true;
+}
+
+
+static uint
+count_event_block_events(void *drcontext, instr_t *first)
+{
+    /* see is_event_block_end() */
+    uint events = 0;
+    for (instr_t *instr = first; instr != NULL; instr = instr_get_next_app(instr))
+    {
+        /* must match what instrument_instr_events() writes */
+        if (instr_get_app_pc(instr) != NULL)
+        {
+            CompCostType type;
+            events += 1; //instr
+            events += count_mem_refs(instr);
+            events += get_comp_event(instr, &type);
         }
+        if (is_event_block_end(drcontext, instr))
+            break;
     }
+    return events;
 }
 
+
 static void
 setup_sgl_ev_buf_clean_call(void)
 {
@@ -211,97 +186,71 @@ instrument_setup_buffer(void *drcontext, instrlist_t *ilist, instr_t *where,
                            raw_tls_seg, SGLEV_OFFS, evptr_reg);
 
     MINSERT(ilist, where, end);
-    /* update the events_used (events_ptr is updated as events are filled in)
-     * *(per_thread_t->buffer.events_used) += size */
-    dr_insert_read_raw_tls(drcontext, ilist, where,
-                           raw_tls_seg, SGLUSED_OFFS, scratch1);
-    MINSERT(ilist, where,
-            XINST_CREATE_add_s(drcontext,
-                               OPND_CREATE_MEMPTR(scratch1, 0),
-                               OPND_CREATE_INT32(size)));
+    /* events_used is only updated once the events have been written,
+     * see instrument_event_block_commit() */
 }
 
 
 static void
 instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
-               reg_id_t evptr_reg, reg_id_t memref_xax,
-               reg_id_t scratch_reg, reg_id_t h_scratch_reg, reg_id_t l_scratch_reg,
-               uint mem_used)
+               reg_id_t block_reg, reg_id_t addr_reg,
+               uint slot, ushort size, MemType type, opnd_t ref)
 {
-    for (uint i=0; i<mem_used; ++i)
-    {
-        /* Fill in event slots */
-        /* Set the tag
-         * ev->tag = SGL_MEM_TAG */
-        MINSERT(ilist, where,
-                XINST_CREATE_store_1byte(drcontext,
-                                         OPND_CREATE_MEM8(evptr_reg,
-                                                          offsetof(SglEvVariant, tag)),
-                                         OPND_CREATE_INT8(SGL_MEM_TAG)));
+    /* Write a memory event straight into its reserved event slot */
+    const int slot_offs = slot * SIZEOF_EVENT_SLOT;
+
+    /* memory address
+     * drutil_insert_get_mem_addr may clobber block_reg, so (re)load it after */
+    reg_id_t swap = DR_REG_NULL;
+    if (drreg_restore_app_values(drcontext, ilist, where, ref, &swap) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, addr_reg, block_reg);
+    if (swap != DR_REG_NULL)
+        UNRESERVE_REGISTER(swap);
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, BLOCK_OFFS, block_reg);
 
-        /* Set read/write
-         * ev->mem.type = memref->type */
-        MINSERT(ilist, where,
-                XINST_CREATE_load_1byte_zext4(drcontext,
-                                              opnd_create_reg(scratch_reg),
-                                              OPND_CREATE_MEM8(memref_xax,
-                                                               offsetof(mem_ref_t, type))));
-        MINSERT(ilist, where,
-                XINST_CREATE_store_1byte(drcontext,
-                                         OPND_CREATE_MEM8(evptr_reg,
-                                                          offsetof(SglEvVariant, mem) +
-                                                          offsetof(SglMemEv, type)),
-                                         opnd_create_reg(l_scratch_reg)));
-
-        /* Set size
-         * ev->mem.size = memref->size */
-        MINSERT(ilist, where,
-                XINST_CREATE_load_2bytes(drcontext,
-                                         opnd_create_reg(h_scratch_reg),
-                                         OPND_CREATE_MEM16(memref_xax,
-                                                           offsetof(mem_ref_t, size))));
-        MINSERT(ilist, where,
-                XINST_CREATE_store_2bytes(drcontext,
-                                          OPND_CREATE_MEM16(evptr_reg,
-                                                            offsetof(SglEvVariant, mem) +
-                                                            offsetof(SglMemEv, size)),
-                                          opnd_create_reg(h_scratch_reg)));
-
-        /* Set address
-         * ev->mem.begin_addr = memref->addr */
-        MINSERT(ilist, where,
-                XINST_CREATE_load(drcontext,
-                                  opnd_create_reg(scratch_reg),
-                                  OPND_CREATE_MEMPTR(memref_xax,
-                                                     offsetof(mem_ref_t, addr))));
-        MINSERT(ilist, where,
-                XINST_CREATE_store(drcontext,
-                                   OPND_CREATE_MEMPTR(evptr_reg,
+    /* ev->tag = SGL_MEM_TAG */
+    MINSERT(ilist, where,
+            XINST_CREATE_store_1byte(drcontext,
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
+                                                      offsetof(SglEvVariant, tag)),
+                                     OPND_CREATE_INT8(SGL_MEM_TAG)));
+
+    /* READ/WRITE
+     * ev->mem.type = type */
+    MINSERT(ilist, where,
+            XINST_CREATE_store_1byte(drcontext,
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
                                                       offsetof(SglEvVariant, mem) +
-                                                      offsetof(SglMemEv, begin_addr)),
-                                   opnd_create_reg(scratch_reg)));
+                                                      offsetof(SglMemEv, type)),
+                                     OPND_CREATE_INT8(type)));
 
-        /* Increment to the next event slot
-         * ev += 1 */
-        MINSERT(ilist, where,
-                XINST_CREATE_add(drcontext,
-                                 opnd_create_reg(evptr_reg),
-                                 OPND_CREATE_INT32(SIZEOF_EVENT_SLOT)));
+    /* size of the mem ref operand
+     * ev->mem.size = size */
+    MINSERT(ilist, where,
+            XINST_CREATE_store_2bytes(drcontext,
+                                      OPND_CREATE_MEM16(block_reg, slot_offs +
+                                                        offsetof(SglEvVariant, mem) +
+                                                        offsetof(SglMemEv, size)),
+                                      OPND_CREATE_INT16(size)));
 
-        /* Increment to next mem ref
-         * memref += 1 */
-        MINSERT(ilist, where,
-                XINST_CREATE_add(drcontext,
-                                 opnd_create_reg(memref_xax),
-                                 OPND_CREATE_INT32(sizeof(mem_ref_t))));
-    }
+    /* ev->mem.begin_addr = addr */
+    MINSERT(ilist, where,
+            XINST_CREATE_store(drcontext,
+                               OPND_CREATE_MEMPTR(block_reg, slot_offs +
+                                                  offsetof(SglEvVariant, mem) +
+                                                  offsetof(SglMemEv, begin_addr)),
+                               opnd_create_reg(addr_reg)));
 }
 
 static void
 instrument_instr(void *drcontext, instrlist_t *ilist, instr_t *where,
-                 reg_id_t evptr_reg, reg_id_t scratch1,
-                 instr_t *instr)
+                 reg_id_t block_reg, reg_id_t scratch1,
+                 uint slot, instr_t *instr)
 {
+    const int slot_offs = slot * SIZEOF_EVENT_SLOT;
+
     /* Store pc */
     app_pc pc = instr_get_app_pc(instr);
 
@@ -319,72 +268,55 @@ instrument_instr(void *drcontext, instrlist_t *ilist, instr_t *where,
     /* ev->tag = SGL_CXT_TAG */
     MINSERT(ilist, where,
             XINST_CREATE_store_1byte(drcontext,
-                                     OPND_CREATE_MEM8(evptr_reg, offsetof(SglEvVariant, tag)),
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
+                                                      offsetof(SglEvVariant, tag)),
                                      OPND_CREATE_INT8(SGL_CXT_TAG)));
 
     /* CXT.TYPE
      * ev->cxt.type = SGLPRIM_CXT_INSTR */
     DR_ASSERT(sizeof(CxtType) == 1);
     MINSERT(ilist, where,
-            XINST_CREATE_store(drcontext,
-                               OPND_CREATE_MEM8(evptr_reg,
-                                                (offsetof(SglEvVariant, cxt) +
-                                                 offsetof(SglCxtEv, type))),
-                               OPND_CREATE_INT8(SGLPRIM_CXT_INSTR)));
+            XINST_CREATE_store_1byte(drcontext,
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
+                                                      offsetof(SglEvVariant, cxt) +
+                                                      offsetof(SglCxtEv, type)),
+                                     OPND_CREATE_INT8(SGLPRIM_CXT_INSTR)));
 
     /* CXT.ID (instruction addr)
      * ev->cxt.id = pc */
     DR_ASSERT(sizeof(PtrVal) == 8);
     MINSERT(ilist, where,
             XINST_CREATE_store(drcontext,
-                               OPND_CREATE_MEMPTR(evptr_reg,
-                                                  (offsetof(SglEvVariant, cxt) +
-                                                   offsetof(SglCxtEv, id))),
+                               OPND_CREATE_MEMPTR(block_reg, slot_offs +
+                                                  offsetof(SglEvVariant, cxt) +
+                                                  offsetof(SglCxtEv, id)),
                                pc_opnd));
-
-    /* increment the sigil event slot
-     * ev += 1 */
-    MINSERT(ilist, where,
-            XINST_CREATE_add(drcontext,
-                             opnd_create_reg(evptr_reg),
-                             OPND_CREATE_INT32(SIZEOF_EVENT_SLOT)));
 }
 
 
 static void
 instrument_comp(void *drcontext, instrlist_t *ilist, instr_t *where,
-                reg_id_t evptr_reg, uint comp_used, SglCompEv **ev)
+                reg_id_t block_reg, uint slot, CompCostType type)
 {
-    for (uint i=0; i<comp_used; ++i)
-    {
-        /* Set the tag */
-        /* TAG
-         * ev->tag = SGL_COMP_TAG */
-        MINSERT(ilist, where,
-                XINST_CREATE_store_1byte(drcontext,
-                                         OPND_CREATE_MEM8(evptr_reg, offsetof(SglEvVariant, tag)),
-                                         OPND_CREATE_INT8(SGL_COMP_TAG)));
+    const int slot_offs = slot * SIZEOF_EVENT_SLOT;
 
-        /* COMP.COMPCOSTTYPE
-         * ev->sync.type = compev->type */
-        DR_ASSERT(sizeof(CompCostType) == 1);
-        MINSERT(ilist, where,
-                XINST_CREATE_store_1byte(drcontext,
-                                         OPND_CREATE_MEM8(evptr_reg,
-                                                          (offsetof(SglEvVariant, comp) +
-                                                           offsetof(SglCompEv, type))),
-                                         OPND_CREATE_INT8((*ev)->type)));
-
-        /* Increment to the next sigil event slot
-         * ev += 1 */
-        MINSERT(ilist, where,
-                XINST_CREATE_add(drcontext,
-                                 opnd_create_reg(evptr_reg),
-                                 OPND_CREATE_INT32(SIZEOF_EVENT_SLOT)));
+    /* TAG
+     * ev->tag = SGL_COMP_TAG */
+    MINSERT(ilist, where,
+            XINST_CREATE_store_1byte(drcontext,
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
+                                                      offsetof(SglEvVariant, tag)),
+                                     OPND_CREATE_INT8(SGL_COMP_TAG)));
 
-        /* Increment to the next cached compute event */
-        ++*ev;
-    }
+    /* COMP.COMPCOSTTYPE
+     * ev->comp.type = type */
+    DR_ASSERT(sizeof(CompCostType) == 1);
+    MINSERT(ilist, where,
+            XINST_CREATE_store_1byte(drcontext,
+                                     OPND_CREATE_MEM8(block_reg, slot_offs +
+                                                      offsetof(SglEvVariant, comp) +
+                                                      offsetof(SglCompEv, type)),
+                                     OPND_CREATE_INT8(type)));
 }
 
 static void
@@ -462,10 +394,354 @@ instrument_sync(void *drcontext, instrlist_t *ilist, instr_t *where,
 }
 
 
+typedef struct _anchor_group_t
+{
+    /* Memory references through the same registers share an anchor,
+     * until one of those registers is written */
+    reg_id_t base;
+    reg_id_t index;
+    reg_id_t seg;
+    int scale;
+    int disp;
+    uint anchor;
+} anchor_group_t;
+
+
+static void
+compact_mem_ref(instr_t *instr, opnd_t ref, MemType type, per_thread_t *tcxt,
+                compact_mem_desc_t *desc, anchor_group_t *groups,
+                uint *num_groups, uint *num_anchors, int *max_delta)
+{
+    uint mem = tcxt->event_block_mem++;
+    desc->type = type;
+    desc->reserved = 0;
+    desc->size = drutil_opnd_mem_size_in_bytes(ref, instr);
+
+    if (opnd_is_base_disp(ref))
+    {
+        for (uint i=0; i<*num_groups; ++i)
+        {
+            anchor_group_t *group = groups + i;
+            int64 delta = (int64)opnd_get_disp(ref) - group->disp;
+            if (group->base == opnd_get_base(ref) &&
+                group->index == opnd_get_index(ref) &&
+                group->scale == opnd_get_scale(ref) &&
+                group->seg == opnd_get_segment(ref) &&
+                delta >= -INT_MAX && delta <= INT_MAX)
+            {
+                desc->anchor = group->anchor;
+                tcxt->anchor_offs[mem] = (int)delta;
+                if (delta > *max_delta)
+                    *max_delta = (int)delta;
+                else if (-delta > *max_delta)
+                    *max_delta = (int)-delta;
+                return;
+            }
+        }
+
+        /* start a new group, replacing the oldest one if full */
+        anchor_group_t *group;
+        if (*num_groups < MAX_ANCHOR_GROUPS)
+            group = groups + (*num_groups)++;
+        else
+            group = groups + (*num_anchors % MAX_ANCHOR_GROUPS);
+        group->base = opnd_get_base(ref);
+        group->index = opnd_get_index(ref);
+        group->scale = opnd_get_scale(ref);
+        group->seg = opnd_get_segment(ref);
+        group->disp = opnd_get_disp(ref);
+        group->anchor = *num_anchors;
+    }
+
+    /* this memory reference computes the anchor at runtime */
+    desc->anchor = (*num_anchors)++;
+    tcxt->anchor_offs[mem] = 0;
+}
+
+
+uint
+build_compact_record(void *drcontext, instr_t *first, per_thread_t *tcxt,
+                     uint *record_len)
+{
+    /* Lay out the event block's compact record in tcxt->compact_record.
+     * Everything up to the anchors is static, and its length is returned
+     * in record_len. tcxt->anchor_offs is filled in with the record offset
+     * of the anchor each memory reference must compute at runtime.
+     * Returns the number of event slots taken by the record. */
+    uint num_instrs = 0, num_mem = 0;
+    for (instr_t *instr = first; instr != NULL; instr = instr_get_next_app(instr))
+    {
+        if (instr_get_app_pc(instr) != NULL)
+        {
+            num_instrs += 1;
+            num_mem += count_mem_refs(instr);
+        }
+        if (is_event_block_end(drcontext, instr))
+            break;
+    }
+    DR_ASSERT(num_mem <= MAX_EVENT_BLOCK_MEM_REFS);
+
+    byte *record = tcxt->compact_record;
+    compact_block_header_t *header = (compact_block_header_t *)record;
+    compact_instr_desc_t *instr_desc = (compact_instr_desc_t *)(header + 1);
+    compact_mem_desc_t *mem_desc = (compact_mem_desc_t *)(instr_desc + num_instrs);
+
+    anchor_group_t groups[MAX_ANCHOR_GROUPS];
+    uint num_groups = 0, num_anchors = 0, num_iops = 0, num_flops = 0;
+    int max_delta = 0;
+    app_pc first_pc = NULL;
+
+    tcxt->event_block_mem = 0;
+    for (instr_t *instr = first; instr != NULL; instr = instr_get_next_app(instr))
+    {
+        if (instr_get_app_pc(instr) != NULL)
+        {
+            if (first_pc == NULL)
+                first_pc = instr_get_app_pc(instr);
+            instr_desc->length = instr_length(drcontext, instr);
+            instr_desc->num_mem = count_mem_refs(instr);
+            ++instr_desc;
+
+            /* same order as instrument_instr_events() */
+            if (instr_reads_memory(instr))
+            {
+                for (int i=0; i<instr_num_srcs(instr); ++i)
+                {
+                    opnd_t ref = instr_get_src(instr, i);
+                    if (opnd_is_memory_reference(ref))
+                        compact_mem_ref(instr, ref, SGLPRIM_MEM_LOAD, tcxt, mem_desc++,
+                                        groups, &num_groups, &num_anchors, &max_delta);
+                }
+            }
+            if (instr_writes_memory(instr))
+            {
+                for (int i=0; i<instr_num_dsts(instr); ++i)
+                {
+                    opnd_t ref = instr_get_dst(instr, i);
+                    if (opnd_is_memory_reference(ref))
+                        compact_mem_ref(instr, ref, SGLPRIM_MEM_STORE, tcxt, mem_desc++,
+                                        groups, &num_groups, &num_anchors, &max_delta);
+                }
+            }
+
+            CompCostType type;
+            if (get_comp_event(instr, &type) > 0)
+            {
+                if (type == SGLPRIM_COMP_FLOP)
+                    ++num_flops;
+                else
+                    ++num_iops;
+            }
+
+            /* the addresses computed by an instruction use its registers'
+             * values from before it executes */
+            for (uint i=0; i<num_groups; ++i)
+            {
+                anchor_group_t *group = groups + i;
+                if ((group->base != DR_REG_NULL &&
+                     instr_writes_to_reg(instr, group->base, DR_QUERY_INCLUDE_ALL)) ||
+                    (group->index != DR_REG_NULL &&
+                     instr_writes_to_reg(instr, group->index, DR_QUERY_INCLUDE_ALL)))
+                    groups[i--] = groups[--num_groups];
+            }
+        }
+        if (is_event_block_end(drcontext, instr))
+            break;
+    }
+
+    uint delta_width = max_delta <= SCHAR_MAX ? 1 : (max_delta <= SHRT_MAX ? 2 : 4);
+    byte *delta = (byte *)mem_desc;
+    for (uint mem=0; mem<num_mem; ++mem, delta += delta_width)
+    {
+        int value = tcxt->anchor_offs[mem];
+        if (delta_width == 1)
+            *(int8_t *)delta = (int8_t)value;
+        else if (delta_width == 2)
+            *(int16_t *)delta = (int16_t)value;
+        else
+            *(int32_t *)delta = value;
+    }
+
+    uint anchors = ALIGN_UP(delta - record, sizeof(PtrVal));
+    memset(delta, 0, record + anchors - delta);
+
+    /* the first reference in each anchor's group computes it */
+    mem_desc = (compact_mem_desc_t *)((compact_instr_desc_t *)(header + 1) + num_instrs);
+    uint next_anchor = 0;
+    for (uint mem=0; mem<num_mem; ++mem)
+    {
+        if (mem_desc[mem].anchor == next_anchor)
+            tcxt->anchor_offs[mem] = anchors + sizeof(PtrVal) * next_anchor++;
+        else
+            tcxt->anchor_offs[mem] = -1;
+    }
+
+    uint len = anchors + sizeof(PtrVal) * num_anchors;
+    uint num_slots = ALIGN_UP(len, SIZEOF_EVENT_SLOT) / SIZEOF_EVENT_SLOT;
+    DR_ASSERT(num_slots <= MAX_EVENT_BLOCK_EVENTS);
+
+    header->tag = DRSIGIL_COMPACT_TAG;
+    header->delta_width = delta_width;
+    header->num_instrs = num_instrs;
+    header->num_mem = num_mem;
+    header->num_anchors = num_anchors;
+    header->num_iops = num_iops;
+    header->num_flops = num_flops;
+    header->num_slots = num_slots;
+    header->first_pc = (PtrVal)first_pc;
+
+    *record_len = anchors;
+    return num_slots;
+}
+
+
+static void
+instrument_compact_record(void *drcontext, instrlist_t *ilist, instr_t *where,
+                          reg_id_t evptr_reg, const byte *record, uint record_len)
+{
+    /* Copy the static part of the record into the reserved slots */
+    DR_ASSERT(record_len % sizeof(int) == 0);
+    for (uint offs=0; offs<record_len; offs += sizeof(int))
+    {
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext,
+                                   OPND_CREATE_MEM32(evptr_reg, offs),
+                                   OPND_CREATE_INT32(*(const int *)(record + offs))));
+    }
+}
+
+
+static void
+instrument_anchor(void *drcontext, instrlist_t *ilist, instr_t *where,
+                  reg_id_t block_reg, reg_id_t addr_reg, int anchor_offs, opnd_t ref)
+{
+    /* anchor address
+     * drutil_insert_get_mem_addr may clobber block_reg, so (re)load it after */
+    reg_id_t swap = DR_REG_NULL;
+    if (drreg_restore_app_values(drcontext, ilist, where, ref, &swap) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+    drutil_insert_get_mem_addr(drcontext, ilist, where, ref, addr_reg, block_reg);
+    if (swap != DR_REG_NULL)
+        UNRESERVE_REGISTER(swap);
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, BLOCK_OFFS, block_reg);
+
+    MINSERT(ilist, where,
+            XINST_CREATE_store(drcontext,
+                               OPND_CREATE_MEMPTR(block_reg, anchor_offs),
+                               opnd_create_reg(addr_reg)));
+}
+
+
+static void
+instrument_event_block_commit(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              per_thread_t *tcxt, reg_id_t scratch1, reg_id_t scratch2)
+{
+    /* Publish the event block's slots, now that all of its events are written.
+     * Does not touch the arithmetic flags.
+     * *(TLS commit_used_ptr) += events
+     * TLS events_ptr = TLS commit_ev_ptr */
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, COMMIT_USED_OFFS, scratch1);
+    MINSERT(ilist, where,
+            XINST_CREATE_load(drcontext,
+                              opnd_create_reg(scratch2),
+                              OPND_CREATE_MEMPTR(scratch1, 0)));
+    MINSERT(ilist, where,
+            INSTR_CREATE_lea(drcontext,
+                             opnd_create_reg(scratch2),
+                             OPND_CREATE_MEM_lea(scratch2, DR_REG_NULL, 0,
+                                                 tcxt->event_block_events)));
+    MINSERT(ilist, where,
+            XINST_CREATE_store(drcontext,
+                               OPND_CREATE_MEMPTR(scratch1, 0),
+                               opnd_create_reg(scratch2)));
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, COMMIT_EV_OFFS, scratch2);
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, SGLEV_OFFS, scratch2);
+}
+
+
+static void
+instrument_compact_events(void *drcontext, instrlist_t *ilist, instr_t *where,
+                          per_thread_t *tcxt)
+{
+    /* Only the anchors are dynamic */
+    reg_id_t block_reg, scratch;
+    RESERVE_REGISTER(block_reg);
+    RESERVE_REGISTER(scratch);
+
+    if (instr_reads_memory(where))
+    {
+        for (int i=0; i<instr_num_srcs(where); ++i)
+        {
+            opnd_t ref = instr_get_src(where, i);
+            if (opnd_is_memory_reference(ref))
+            {
+                int anchor_offs = tcxt->event_block_anchor_offs[tcxt->event_block_mem++];
+                if (anchor_offs >= 0)
+                    instrument_anchor(drcontext, ilist, where,
+                                      block_reg, scratch, anchor_offs, ref);
+            }
+        }
+    }
+
+    if (instr_writes_memory(where))
+    {
+        for (int i=0; i<instr_num_dsts(where); ++i)
+        {
+            opnd_t ref = instr_get_dst(where, i);
+            if (opnd_is_memory_reference(ref))
+            {
+                int anchor_offs = tcxt->event_block_anchor_offs[tcxt->event_block_mem++];
+                if (anchor_offs >= 0)
+                    instrument_anchor(drcontext, ilist, where,
+                                      block_reg, scratch, anchor_offs, ref);
+            }
+        }
+    }
+
+    if (is_event_block_end(drcontext, where))
+        instrument_event_block_commit(drcontext, ilist, where, tcxt, block_reg, scratch);
+
+    UNRESERVE_REGISTER(scratch);
+    UNRESERVE_REGISTER(block_reg);
+}
+
+
 void
-instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
-                        per_thread_t *tcxt)
+instrument_event_block(void *drcontext, instrlist_t *ilist, instr_t *where,
+                       per_thread_t *tcxt)
 {
+    /* Reserve the event slots for the entire event block, once.
+     * Each instruction in the event block then writes its events directly
+     * into its own slots in shared memory, relative to TLS block_ptr. */
+    uint events, record_len = 0;
+    const byte *record = NULL;
+    if (clo.event_templates)
+    {
+        const event_template_t *tmpl = get_event_template(drcontext, where, tcxt);
+        events = tmpl->num_slots;
+        record = (const byte *)&tmpl->ref;
+        record_len = sizeof(tmpl->ref);
+        tcxt->event_block_anchor_offs = tmpl->anchor_offs;
+        tcxt->event_block_mem = 0;
+    }
+    else if (clo.compact_events)
+    {
+        events = build_compact_record(drcontext, where, tcxt, &record_len);
+        record = tcxt->compact_record;
+        tcxt->event_block_anchor_offs = tcxt->anchor_offs;
+        tcxt->event_block_mem = 0;
+    }
+    else
+    {
+        events = count_event_block_events(drcontext, where);
+        DR_ASSERT(events <= MAX_EVENT_BLOCK_EVENTS);
+    }
+    tcxt->event_block_slot = 0;
+    tcxt->event_block_events = events;
 
     /* need to specify so we can access 1/2 byte registers.
      * e.g. XAX so we can access AL / AX
@@ -493,8 +769,8 @@ instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
     dr_save_reg(drcontext, ilist, where, evptr_reg, spill_evptr);
 
     //-----------------------------------------------------------
-    /* skip over instrumented event generation, if not enabled,
-     * e.g. inside a pthread event, or outside a ROI */
+    /* point the event block at the discard buffer, if not enabled,
+     * e.g. inside a pthread event, or outside the ROI */
 
     /* load per_thread_t->active from TLS into reg1 */
     /* test if active, can't do a (jecxz) near jump */
@@ -505,15 +781,58 @@ instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
                              opnd_create_reg(xax),
                              OPND_CREATE_INT8(false)));
 
-    /* skip sigil events if inactive */
-    instr_t *skip_sigil = INSTR_CREATE_label(drcontext);
+    instr_t *inactive = INSTR_CREATE_label(drcontext);
     MINSERT(ilist, where,
             INSTR_CREATE_jcc(drcontext,
                              OP_je,
-                             opnd_create_instr(skip_sigil)));
+                             opnd_create_instr(inactive)));
+
+    /* and inside its ROI */
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, IN_ROI_OFFS, xax);
+    MINSERT(ilist, where,
+            XINST_CREATE_cmp(drcontext,
+                             opnd_create_reg(xax),
+                             OPND_CREATE_INT8(false)));
+
+    instr_t *active = INSTR_CREATE_label(drcontext);
+    MINSERT(ilist, where,
+            INSTR_CREATE_jcc(drcontext,
+                             OP_jne,
+                             opnd_create_instr(active)));
+
+    MINSERT(ilist, where, inactive);
+
+    /* TLS block_ptr = TLS discard_ptr */
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, DISCARD_OFFS, xax);
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, BLOCK_OFFS, xax);
+
+    /* nothing to commit:
+     * TLS commit_ev_ptr = TLS events_ptr
+     * TLS commit_used_ptr = &per_thread_t->discard_used */
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, SGLEV_OFFS, xax);
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, COMMIT_EV_OFFS, xax);
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, PERTHR_OFFS, xax);
+    MINSERT(ilist, where,
+            INSTR_CREATE_lea(drcontext,
+                             opnd_create_reg(xax),
+                             OPND_CREATE_MEM_lea(xax, DR_REG_NULL, 0,
+                                                 offsetof(per_thread_t, discard_used))));
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, COMMIT_USED_OFFS, xax);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    MINSERT(ilist, where,
+            XINST_CREATE_jump(drcontext,
+                              opnd_create_instr(done)));
+
+    MINSERT(ilist, where, active);
 
-    /* Load (TLS) per_thread_t->buffer.events_ptr into evptr_reg
-     * this is used and updated by all instrumentation to write event attr */
+    /* Load (TLS) per_thread_t->buffer.events_ptr into evptr_reg */
     dr_insert_read_raw_tls(drcontext, ilist, where,
                            raw_tls_seg, SGLEV_OFFS, evptr_reg);
     //-----------------------------------------------------------
@@ -539,12 +858,25 @@ instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
                              OP_je,
                              opnd_create_instr(skip_sync)));
 
-    /* if (TLS syncevptr != NULL) */
+    /* if (TLS syncevptr != NULL)
+     * the sync event goes ahead of the event block */
     instrument_setup_buffer(drcontext, ilist, where,
                             evptr_reg, xbx, xcx,
-                            tcxt->event_block_events + 1);
+                            events + 1);
     instrument_sync(drcontext, ilist, where, evptr_reg, xax, xbx, DR_REG_BL);
 
+    /* the sync event is complete, publish it right away:
+     * TLS events_ptr = events_ptr
+     * *(per_thread_t->buffer.events_used) += 1 */
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, SGLEV_OFFS, evptr_reg);
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, SGLUSED_OFFS, xbx);
+    MINSERT(ilist, where,
+            XINST_CREATE_add_s(drcontext,
+                               OPND_CREATE_MEMPTR(xbx, 0),
+                               OPND_CREATE_INT32(1)));
+
     /* already setup the sigil event buffer, so skip over this next setup */
     instr_t *skip_setup = INSTR_CREATE_label(drcontext);
     MINSERT(ilist, where,
@@ -554,45 +886,39 @@ instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
     /* SKIP SYNC LABEL */
     MINSERT(ilist, where, skip_sync);
 
-    /* add sigil event instrumentation */
     instrument_setup_buffer(drcontext, ilist, where,
                             evptr_reg, xbx, xcx,
-                            tcxt->event_block_events);
+                            events);
 
     /* SKIP SETUP BUFFER LABEL */
     MINSERT(ilist, where, skip_setup);
 
-    /* sigil mem/compute events are filled in from buffer[0] to buffer[N] */
-    SglCompEv *comp_ev = tcxt->comps;
-    /* xax <= TLS memrefbase */
-    dr_insert_read_raw_tls(drcontext, ilist, where,
-                           raw_tls_seg, MEMREFBASE_OFFS, xax);
-
-    for (uint i=0; i<tcxt->iblock_count; ++i)
-    {
-        /* Iterate over all potential events.
-         * There may be multiple memory and compute events per instruction.
-         * Upon each instrumentation, the memory/compute cache may be
-         * incremented multiple times as each event is written to sigil shared
-         * memory. This means both the cache pointers for both need to be
-         * persistent */
-        instr_block_t *iblock = tcxt->iblocks + i;
-        instrument_instr(drcontext, ilist, where,
-                         evptr_reg, xcx, iblock->instr);
-        instrument_mem(drcontext, ilist, where,
-                       evptr_reg, xax, xcx, DR_REG_CX, DR_REG_CL,
-                       iblock->mem_ref_count);
-        instrument_comp(drcontext, ilist, where,
-                        evptr_reg, iblock->comp_count, &comp_ev);
-    }
-
     //-----------------------------------------------------------
-    /* Finally, update (TLS) per_thread_t->buffer.events_ptr */
+    /* The event block owns the slots from here on, but only publishes
+     * them once all of its events are written, at its last instruction.
+     * If the event block is left early, e.g. by a fault, the next event
+     * block reuses the slots, so Sigil2 never sees a partial event block.
+     * TLS block_ptr = events_ptr
+     * TLS commit_ev_ptr = events_ptr + events
+     * TLS commit_used_ptr = TLS events_used */
     dr_insert_write_raw_tls(drcontext, ilist, where,
-                            raw_tls_seg, SGLEV_OFFS, evptr_reg);
+                            raw_tls_seg, BLOCK_OFFS, evptr_reg);
+    if (clo.compact_events)
+        instrument_compact_record(drcontext, ilist, where,
+                                  evptr_reg, record, record_len);
+    MINSERT(ilist, where,
+            XINST_CREATE_add(drcontext,
+                             opnd_create_reg(evptr_reg),
+                             OPND_CREATE_INT32(events * SIZEOF_EVENT_SLOT)));
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, COMMIT_EV_OFFS, evptr_reg);
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, SGLUSED_OFFS, xax);
+    dr_insert_write_raw_tls(drcontext, ilist, where,
+                            raw_tls_seg, COMMIT_USED_OFFS, xax);
     //-----------------------------------------------------------
 
-    MINSERT(ilist, where, skip_sigil);
+    MINSERT(ilist, where, done);
 
     dr_restore_reg(drcontext, ilist, where, evptr_reg, spill_evptr);
     dr_restore_reg(drcontext, ilist, where, xcx, spill_xcx);
@@ -600,3 +926,66 @@ instrument_sigil_events(void *drcontext, instrlist_t *ilist, instr_t *where,
     dr_restore_reg(drcontext, ilist, where, xax, spill_xax);
     dr_restore_arith_flags(drcontext, ilist, where, spill_aflags);
 }
+
+
+void
+instrument_instr_events(void *drcontext, instrlist_t *ilist, instr_t *where,
+                        per_thread_t *tcxt)
+{
+    if (clo.compact_events)
+    {
+        instrument_compact_events(drcontext, ilist, where, tcxt);
+        return;
+    }
+
+    /* Fill in this instruction's events:
+     * the instruction itself, then its memory and compute events */
+    reg_id_t block_reg, scratch;
+    RESERVE_REGISTER(block_reg);
+    RESERVE_REGISTER(scratch);
+
+    dr_insert_read_raw_tls(drcontext, ilist, where,
+                           raw_tls_seg, BLOCK_OFFS, block_reg);
+    instrument_instr(drcontext, ilist, where, block_reg, scratch,
+                     tcxt->event_block_slot++, where);
+
+    if (instr_reads_memory(where))
+    {
+        for (int i=0; i<instr_num_srcs(where); ++i)
+        {
+            opnd_t ref = instr_get_src(where, i);
+            if (opnd_is_memory_reference(ref))
+                instrument_mem(drcontext, ilist, where, block_reg, scratch,
+                               tcxt->event_block_slot++,
+                               drutil_opnd_mem_size_in_bytes(ref, where),
+                               SGLPRIM_MEM_LOAD, ref);
+        }
+    }
+
+    if (instr_writes_memory(where))
+    {
+        for (int i=0; i<instr_num_dsts(where); ++i)
+        {
+            opnd_t ref = instr_get_dst(where, i);
+            if (opnd_is_memory_reference(ref))
+                instrument_mem(drcontext, ilist, where, block_reg, scratch,
+                               tcxt->event_block_slot++,
+                               drutil_opnd_mem_size_in_bytes(ref, where),
+                               SGLPRIM_MEM_STORE, ref);
+        }
+    }
+
+    CompCostType type;
+    if (get_comp_event(where, &type) > 0)
+        instrument_comp(drcontext, ilist, where, block_reg,
+                        tcxt->event_block_slot++, type);
+
+    if (is_event_block_end(drcontext, where))
+    {
+        DR_ASSERT(tcxt->event_block_slot == tcxt->event_block_events);
+        instrument_event_block_commit(drcontext, ilist, where, tcxt, block_reg, scratch);
+    }
+
+    UNRESERVE_REGISTER(scratch);
+    UNRESERVE_REGISTER(block_reg);
+}
@@ -13,15 +13,106 @@
 ipc_channel_t IPC[MAX_IPC_CHANNELS];
 /* Initialize all possible IPC channels (some will not be used) */
 
+/////////////////////////////////////////////////////////////////////
+// Futex doorbell
+/////////////////////////////////////////////////////////////////////
+/* The buffer state words live in shared memory, so a hand-off is just a
+ * store. A futex syscall is only made when the other side is parked,
+ * i.e. only when the consumer (or producer) is actually behind. */
+
+static inline long
+futex(volatile int *uaddr, int op, int val)
+{
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+
+static inline void
+doorbell_signal_full(ipc_doorbell_t *doorbell, uint buf_idx)
+{
+    doorbell->buf_state[buf_idx] = DRSIGIL_BUF_FULL;
+    /* full barrier; must be visible before checking for a parked consumer */
+    __sync_add_and_fetch(&doorbell->full_count, 1);
+    if (doorbell->consumer_waiting)
+        futex(&doorbell->full_count, FUTEX_WAKE, 1);
+}
+
+
+static inline void
+doorbell_wait_empty(ipc_doorbell_t *doorbell, uint buf_idx)
+{
+    if (doorbell->buf_state[buf_idx] == DRSIGIL_BUF_EMPTY)
+        return;
+
+    __sync_add_and_fetch(&doorbell->producer_waiting, 1);
+    while (doorbell->buf_state[buf_idx] == DRSIGIL_BUF_FULL)
+        futex(&doorbell->buf_state[buf_idx], FUTEX_WAIT, DRSIGIL_BUF_FULL);
+    __sync_sub_and_fetch(&doorbell->producer_waiting, 1);
+}
+
+
+static inline void
+doorbell_wait_full(ipc_doorbell_t *doorbell, uint buf_idx)
+{
+    /* Consumer side, implemented by Sigil2.
+     * Only used here for benchmarking */
+    while (doorbell->buf_state[buf_idx] == DRSIGIL_BUF_EMPTY)
+    {
+        int full_count = doorbell->full_count;
+        doorbell->consumer_waiting = 1;
+        __sync_synchronize();
+        if (doorbell->buf_state[buf_idx] == DRSIGIL_BUF_EMPTY)
+            futex(&doorbell->full_count, FUTEX_WAIT, full_count);
+        doorbell->consumer_waiting = 0;
+    }
+}
+
+
+static inline void
+doorbell_release(ipc_doorbell_t *doorbell, uint buf_idx)
+{
+    /* Consumer side, implemented by Sigil2.
+     * Only used here for benchmarking */
+    doorbell->buf_state[buf_idx] = DRSIGIL_BUF_EMPTY;
+    __sync_synchronize();
+    if (doorbell->producer_waiting)
+        futex(&doorbell->buf_state[buf_idx], FUTEX_WAKE, INT_MAX);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Buffer hand-off
+/////////////////////////////////////////////////////////////////////
+static inline void
+signal_full_buffer(ipc_channel_t *channel, uint buf_idx)
+{
+    if (channel->doorbell != NULL)
+        doorbell_signal_full(channel->doorbell, buf_idx);
+    else if (channel->standalone == false)
+        dr_write_file(channel->full_fifo, &buf_idx, sizeof(buf_idx));
+}
+
+
+static inline uint
+wait_for_released_buffer(ipc_channel_t *channel, uint buf_idx)
+{
+    /* Returns the buffer that Sigil2 has released.
+     * Over the fifo, this is the next buffer Sigil2 consumed;
+     * with the doorbell, we wait on the requested buffer directly */
+    if (channel->doorbell != NULL)
+        doorbell_wait_empty(channel->doorbell, buf_idx);
+    else if (channel->standalone == false)
+        dr_read_file(channel->empty_fifo, &buf_idx, sizeof(buf_idx));
+    return buf_idx;
+}
+
+
 static inline void
 notify_full_buffer(ipc_channel_t *channel)
 {
     /* Tell Sigil2 that the active buffer, on the given IPC channel,
      * is full and ready to be consumed */
-
-    if (channel->standalone == false)
-        dr_write_file(channel->full_fifo,
-                      &channel->shmem_buf_idx, sizeof(channel->shmem_buf_idx));
+    signal_full_buffer(channel, channel->shmem_buf_idx);
 
     /* Flag the shared memory buffer as used (by Sigil2) */
     channel->empty_buf_idx[channel->shmem_buf_idx] = false;
@@ -39,9 +130,7 @@ get_next_buffer(ipc_channel_t *channel)
     /* Sigil2 tells us when it's finished with a shared memory buffer */
     if(channel->empty_buf_idx[channel->shmem_buf_idx] == false)
     {
-        if (channel->standalone == false)
-            dr_read_file(channel->empty_fifo,
-                         &channel->shmem_buf_idx, sizeof(channel->shmem_buf_idx));
+        channel->shmem_buf_idx = wait_for_released_buffer(channel, channel->shmem_buf_idx);
         channel->empty_buf_idx[channel->shmem_buf_idx] = true;
     }
 
@@ -179,11 +268,207 @@ set_shared_memory_buffer_helper(per_thread_t *tcxt, ipc_channel_t *channel)
 }
 
 
+/////////////////////////////////////////////////////////////////////
+// Lock-free mode
+/////////////////////////////////////////////////////////////////////
+/* Instead of funneling every thread on a channel through the ticket lock,
+ * each thread claims whole shared memory buffers for itself. Claiming
+ * a buffer is a single atomic increment of the channel's sequence number,
+ * after which the buffer's turn word tells the thread when the buffer is
+ * its own; writers never wait on each other while filling their buffers. A thread only waits when the
+ * buffer it claimed is still owned by its previous user, or has not yet
+ * been released by Sigil2, i.e. when Sigil2 is behind.
+ *
+ * Full buffers are handed to Sigil2 in sequence order, so Sigil2 sees
+ * the buffers in the same order over the full fifo as it would with the
+ * ticket lock. */
+
+static inline void
+pass_private_buffer(ipc_channel_t *channel, uint seq)
+{
+    /* Lets the buffer's next user, seq+N, claim it.
+     * Called with the notify_lock held, once the buffer of seq is handed off
+     * or given up on */
+    uint buf_idx = seq & (SIGIL2_IPC_BUFFERS-1);
+    if (channel->standalone)
+        channel->empty_buf_idx[buf_idx] = true;
+    channel->notify_seq = seq + 1;
+    channel->buf_owner[buf_idx] = DRSIGIL_BUF_UNCLAIMED;
+
+    /* Only now may the buffer's next user claim it */
+    __sync_synchronize();
+    channel->buf_turn[buf_idx] = seq + SIGIL2_IPC_BUFFERS;
+}
+
+
+static inline void
+publish_private_buffers(ipc_channel_t *channel)
+{
+    /* Hand off every finished buffer at the head of the sequence.
+     * Whoever holds the lock also hands off the buffers that other threads
+     * finished out of order, so no thread waits on a slower one here */
+    dr_mutex_lock(channel->notify_lock);
+    for (;;)
+    {
+        uint seq = channel->notify_seq;
+        uint buf_idx = seq & (SIGIL2_IPC_BUFFERS-1);
+        if (channel->buf_turn[buf_idx] != seq ||
+            channel->buf_owner[buf_idx] != DRSIGIL_BUF_DONE)
+            break;
+
+        /* Writes to a fifo smaller than PIPE_BUF are atomic */
+        signal_full_buffer(channel, buf_idx);
+        pass_private_buffer(channel, seq);
+    }
+    dr_mutex_unlock(channel->notify_lock);
+}
+
+
+static inline void
+notify_full_private_buffer(ipc_channel_t *channel, uint buf_idx)
+{
+    /* The events must be visible before the buffer can be handed off */
+    __sync_synchronize();
+    DR_ASSERT(channel->buf_owner[buf_idx] == DRSIGIL_BUF_CLAIMED);
+    channel->buf_owner[buf_idx] = DRSIGIL_BUF_DONE;
+    publish_private_buffers(channel);
+}
+
+
+static inline void
+wait_for_empty_buffer(ipc_channel_t *channel, uint buf_idx)
+{
+    if (channel->doorbell != NULL)
+    {
+        /* Each buffer has its own state word; no need to serialize */
+        doorbell_wait_empty(channel->doorbell, buf_idx);
+        channel->empty_buf_idx[buf_idx] = true;
+        return;
+    }
+
+    /* Whoever holds the lock reads released buffers on behalf of all threads
+     * waiting on this channel, until its own buffer has been released */
+    dr_mutex_lock(channel->empty_fifo_lock);
+    while (channel->empty_buf_idx[buf_idx] == false)
+    {
+        if (channel->standalone == false)
+        {
+            uint released;
+            if (dr_read_file(channel->empty_fifo,
+                             &released, sizeof(released)) != sizeof(released))
+                DR_ABORT_MSG("error reading empty sigil2 fifo");
+            DR_ASSERT(released < SIGIL2_IPC_BUFFERS);
+            channel->empty_buf_idx[released] = true;
+        }
+        else
+        {
+            /* the previous owner has not flushed this buffer yet */
+            dr_thread_yield();
+        }
+    }
+    dr_mutex_unlock(channel->empty_fifo_lock);
+}
+
+
+static inline uint
+take_private_buffer(ipc_channel_t *channel, uint seq)
+{
+    /* Circular buffer, must be power of 2 */
+    uint buf_idx = seq & (SIGIL2_IPC_BUFFERS-1);
+
+    /* The buffer is ours once the previous user of the buffer, seq-N,
+     * has handed it off. Sequence numbers are unique, so only one thread
+     * can be waiting for this turn */
+    while (channel->buf_turn[buf_idx] != seq)
+        dr_thread_yield();
+
+    /* Sigil2 must also be done reading it */
+    if (channel->empty_buf_idx[buf_idx] == false)
+        wait_for_empty_buffer(channel, buf_idx);
+    channel->empty_buf_idx[buf_idx] = false;
+
+    channel->shared_mem->eventBuffers[buf_idx].used = 0;
+    channel->shared_mem->nameBuffers[buf_idx].used = 0;
+
+    /* Only a claimed buffer holds events of this thread, see terminate_IPC */
+    __sync_synchronize();
+    channel->buf_owner[buf_idx] = DRSIGIL_BUF_CLAIMED;
+    return buf_idx;
+}
+
+
+static inline uint
+claim_private_buffer(ipc_channel_t *channel, uint *seq)
+{
+    *seq = __sync_fetch_and_add(&channel->next_seq, 1);
+    return take_private_buffer(channel, *seq);
+}
+
+
+static void
+set_private_buffer(per_thread_t *tcxt)
+{
+    uint channel_idx = tcxt->thread_id % clo.frontend_threads;
+    ipc_channel_t *channel = &IPC[channel_idx];
+
+    /* The instrumentation only asks for more space when this thread's buffer
+     * is exhausted; hand it to Sigil2 and start a new one */
+    if (tcxt->has_buffer)
+        notify_full_private_buffer(channel, tcxt->buf_idx);
+
+    uint seq;
+    tcxt->buf_idx = claim_private_buffer(channel, &seq);
+    tcxt->has_buffer = true;
+
+    EventBuffer *buffer = channel->shared_mem->eventBuffers + tcxt->buf_idx;
+    SGLEV_PTR(tcxt->seg_base) = buffer->events;
+    SGLEND_PTR(tcxt->seg_base) = buffer->events + SIGIL2_EVENTS_BUFFER_SIZE;
+    SGLUSED_PTR(tcxt->seg_base) = &(buffer->used);
+
+    /* Every buffer has a single owner, so it always begins with a
+     * thread swap event. The sequence number orders the buffers */
+    SglSyncEv ev = {
+        .type    = SGLPRIM_SYNC_SWAP,
+        .data[0] = tcxt->thread_id,
+        .data[1] = seq
+    };
+    SglEvVariant *slot = SGLEV_PTR(tcxt->seg_base);
+    slot->tag = SGL_SYNC_TAG;
+    slot->sync = ev;
+    ++(SGLEV_PTR(tcxt->seg_base));
+    ++*(SGLUSED_PTR(tcxt->seg_base));
+}
+
+
+static void
+flush_private_buffer(per_thread_t *tcxt)
+{
+    if (tcxt->has_buffer)
+    {
+        uint channel_idx = tcxt->thread_id % clo.frontend_threads;
+        notify_full_private_buffer(&IPC[channel_idx], tcxt->buf_idx);
+        tcxt->has_buffer = false;
+        SGLEV_PTR(tcxt->seg_base) = NULL;
+        SGLEND_PTR(tcxt->seg_base) = NULL;
+        SGLUSED_PTR(tcxt->seg_base) = NULL;
+        /* in case this is called from within an event block */
+        COMMIT_EV_PTR(tcxt->seg_base) = NULL;
+        COMMIT_USED_PTR(tcxt->seg_base) = &tcxt->discard_used;
+    }
+}
+
+
 /////////////////////////////////////////////////////////////////////
 // IPC interface
 /////////////////////////////////////////////////////////////////////
 void set_shared_memory_buffer(per_thread_t *tcxt)
 {
+    if (clo.lockfree)
+    {
+        set_private_buffer(tcxt);
+        return;
+    }
+
     ipc_channel_t *channel = get_locked_channel(tcxt);
     set_shared_memory_buffer_helper(tcxt, channel);
 
@@ -206,6 +491,12 @@ void set_shared_memory_buffer(per_thread_t *tcxt)
 
 void force_thread_flush(per_thread_t *tcxt)
 {
+    if (clo.lockfree)
+    {
+        flush_private_buffer(tcxt);
+        return;
+    }
+
     if(tcxt->has_channel_lock)
     {
         uint channel_idx = tcxt->thread_id % clo.frontend_threads;
@@ -217,6 +508,9 @@ void force_thread_flush(per_thread_t *tcxt)
         SGLEV_PTR(tcxt->seg_base) = NULL;
         SGLEND_PTR(tcxt->seg_base) = NULL;
         SGLUSED_PTR(tcxt->seg_base) = NULL;
+        /* in case this is called from within an event block */
+        COMMIT_EV_PTR(tcxt->seg_base) = NULL;
+        COMMIT_USED_PTR(tcxt->seg_base) = &tcxt->discard_used;
     }
 }
 
@@ -276,6 +570,7 @@ init_IPC(int idx, const char *path, bool standalone)
     channel->shared_mem = NULL;
     channel->full_fifo = -1;
     channel->empty_fifo = -1;
+    channel->doorbell = NULL;
     channel->shmem_buf_idx = 0;
 
     for(uint i=0; i<sizeof(channel->empty_buf_idx)/sizeof(channel->empty_buf_idx[0]); ++i)
@@ -284,6 +579,16 @@ init_IPC(int idx, const char *path, bool standalone)
     channel->last_active_tid = 0;
     channel->initialized     = false;
 
+    channel->next_seq = 0;
+    channel->notify_seq = 0;
+    for(uint i=0; i<SIGIL2_IPC_BUFFERS; ++i)
+    {
+        channel->buf_turn[i] = i;
+        channel->buf_owner[i] = DRSIGIL_BUF_UNCLAIMED;
+    }
+    channel->notify_lock = dr_mutex_create();
+    channel->empty_fifo_lock = dr_mutex_create();
+
     if (standalone)
     {
         /* mimic shared memory writes */
@@ -340,12 +645,58 @@ init_IPC(int idx, const char *path, bool standalone)
             DR_ABORT_MSG("error mapping shared memory");
 
         dr_close_file(map_file);
+
+        if (clo.futex_ipc)
+        {
+            /* Sigil2 creates the doorbell along with the shared memory */
+            char doorbell_name[path_len + pad_len +
+                               sizeof(DRSIGIL_IPC_DOORBELL_BASENAME) +
+                               sizeof(STRINGIFY(MAX_IPC_CHANNELS))];
+            sprintf(doorbell_name, "%s/%s-%d", path, DRSIGIL_IPC_DOORBELL_BASENAME, idx);
+
+            file_t doorbell_file = dr_open_file(doorbell_name,
+                                                DR_FILE_READ|DR_FILE_WRITE_APPEND);
+            if(doorbell_file == INVALID_FILE)
+                DR_ABORT_MSG("error opening doorbell file");
+
+            size_t doorbell_size = sizeof(ipc_doorbell_t);
+            channel->doorbell = dr_map_file(doorbell_file, &doorbell_size,
+                                            0, 0, DR_MEMPROT_READ|DR_MEMPROT_WRITE, 0);
+            if(doorbell_size < sizeof(ipc_doorbell_t) || channel->doorbell == NULL)
+                DR_ABORT_MSG("error mapping doorbell");
+
+            dr_close_file(doorbell_file);
+        }
     }
 
     channel->initialized = true;
 }
 
 
+static uint
+terminate_private_buffers(ipc_channel_t *channel)
+{
+    /* Threads that were still running when the application exited never
+     * flushed their buffers, and will not run again; waiting on them would
+     * hang the exit. Hand off whatever they wrote, give up on the buffers
+     * they had not claimed yet, and terminate with an empty buffer */
+    dr_mutex_lock(channel->notify_lock);
+    uint last_seq = __sync_fetch_and_add(&channel->next_seq, 1);
+    for (uint seq = channel->notify_seq; seq != last_seq; ++seq)
+    {
+        uint buf_idx = seq & (SIGIL2_IPC_BUFFERS-1);
+        /* Every earlier user of the buffer has been passed on in order */
+        DR_ASSERT(channel->buf_turn[buf_idx] == seq);
+        if (channel->buf_owner[buf_idx] != DRSIGIL_BUF_UNCLAIMED)
+            signal_full_buffer(channel, buf_idx);
+        pass_private_buffer(channel, seq);
+    }
+    dr_mutex_unlock(channel->notify_lock);
+
+    return take_private_buffer(channel, last_seq);
+}
+
+
 void
 terminate_IPC(int idx)
 {
@@ -357,9 +708,12 @@ terminate_IPC(int idx)
     }
     else
     {
-        /* send terminate sequence */
+        /* send terminate sequence
+         * (the fifos are used for this, even with the doorbell) */
         uint finished = SIGIL2_IPC_FINISHED;
         uint last_buffer = channel->shmem_buf_idx;
+        if (clo.lockfree)
+            last_buffer = terminate_private_buffers(channel);
         if(dr_write_file(channel->full_fifo, &last_buffer, sizeof(last_buffer)) != sizeof(last_buffer) ||
            dr_write_file(channel->full_fifo, &finished,    sizeof(finished))    != sizeof(finished))
             DR_ABORT_MSG("error writing finish sequence sigil2 fifos");
@@ -370,8 +724,116 @@ terminate_IPC(int idx)
         dr_close_file(channel->empty_fifo);
         dr_close_file(channel->full_fifo);
         dr_unmap_file(channel->shared_mem, sizeof(Sigil2DBISharedData));
+        if (channel->doorbell != NULL)
+            dr_unmap_file(channel->doorbell, sizeof(ipc_doorbell_t));
     }
 
     dr_global_free((void*)channel->ticket_queue.head, sizeof(ticket_queue_t));
     dr_mutex_destroy(channel->queue_lock);
+    dr_mutex_destroy(channel->notify_lock);
+    dr_mutex_destroy(channel->empty_fifo_lock);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Hand-off microbenchmark
+/////////////////////////////////////////////////////////////////////
+/* Only the hand-off itself is measured: a client thread stands in for
+ * Sigil2 and releases every buffer as soon as it is signalled full. */
+
+typedef struct _bench_consumer_t
+{
+    ipc_channel_t *channel;
+    int full_fifo_read;
+    int empty_fifo_write;
+    int handoffs;
+    void *done;
+} bench_consumer_t;
+
+
+static void
+bench_consumer(void *arg)
+{
+    bench_consumer_t *consumer = arg;
+    ipc_channel_t *channel = consumer->channel;
+
+    for (int i=0; i<consumer->handoffs; ++i)
+    {
+        uint buf_idx = i & (SIGIL2_IPC_BUFFERS-1);
+        if (channel->doorbell != NULL)
+        {
+            doorbell_wait_full(channel->doorbell, buf_idx);
+            doorbell_release(channel->doorbell, buf_idx);
+        }
+        else
+        {
+            dr_read_file(consumer->full_fifo_read, &buf_idx, sizeof(buf_idx));
+            dr_write_file(consumer->empty_fifo_write, &buf_idx, sizeof(buf_idx));
+        }
+    }
+
+    dr_event_signal(consumer->done);
+}
+
+
+static void
+bench_handoffs(const char *name, ipc_channel_t *channel, bench_consumer_t *consumer)
+{
+    consumer->done = dr_event_create();
+    if (!dr_create_client_thread(bench_consumer, consumer))
+        DR_ABORT_MSG("failed to create benchmark consumer thread");
+
+    uint64 start = dr_get_milliseconds();
+    for (int i=0; i<consumer->handoffs; ++i)
+    {
+        uint buf_idx = i & (SIGIL2_IPC_BUFFERS-1);
+        if (i >= SIGIL2_IPC_BUFFERS)
+            wait_for_released_buffer(channel, buf_idx);
+        signal_full_buffer(channel, buf_idx);
+    }
+    dr_event_wait(consumer->done);
+    uint64 elapsed = dr_get_milliseconds() - start;
+
+    dr_event_destroy(consumer->done);
+    dr_fprintf(STDERR, "DrSigil %s hand-offs: %d in "UINT64_FORMAT_STRING" ms "
+               "("UINT64_FORMAT_STRING" hand-offs/sec)\n",
+               name, consumer->handoffs, elapsed,
+               elapsed == 0 ? 0 : (uint64)consumer->handoffs * 1000 / elapsed);
+}
+
+
+void
+benchmark_IPC(int handoffs)
+{
+    ipc_channel_t channel;
+    memset(&channel, 0, sizeof(channel));
+    channel.standalone = false;
+
+    bench_consumer_t consumer;
+    memset(&consumer, 0, sizeof(consumer));
+    consumer.channel = &channel;
+    consumer.handoffs = handoffs;
+
+    /* fifo path */
+    int full_fifo[2], empty_fifo[2];
+    if (pipe(full_fifo) != 0 || pipe(empty_fifo) != 0)
+        DR_ABORT_MSG("failed to create benchmark pipes");
+    channel.full_fifo = full_fifo[1];
+    channel.empty_fifo = empty_fifo[0];
+    consumer.full_fifo_read = full_fifo[0];
+    consumer.empty_fifo_write = empty_fifo[1];
+    bench_handoffs("fifo", &channel, &consumer);
+    close(full_fifo[0]);
+    close(full_fifo[1]);
+    close(empty_fifo[0]);
+    close(empty_fifo[1]);
+
+    /* futex path */
+    channel.doorbell = dr_raw_mem_alloc(sizeof(ipc_doorbell_t),
+                                        DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    if (channel.doorbell == NULL)
+        DR_ABORT_MSG("Failed to allocate benchmark doorbell\n");
+    memset(channel.doorbell, 0, sizeof(ipc_doorbell_t));
+    bench_handoffs("futex", &channel, &consumer);
+    dr_raw_mem_free(channel.doorbell, sizeof(ipc_doorbell_t));
 }
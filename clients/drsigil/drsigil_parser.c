@@ -9,6 +9,15 @@ static struct option long_options[] =
     {"ipc-dir",              required_argument, 0, 'd'},
     {"start-func",           required_argument, 0, 'b'},
     {"stop-func",            required_argument, 0, 'e'},
+    {"lockfree",             no_argument,       0, 'l'},
+    {"futex-ipc",            no_argument,       0, 'f'},
+    {"ipc-bench",            required_argument, 0, 'B'},
+    {"compact-events",       no_argument,       0, 'c'},
+    {"event-templates",      no_argument,       0, 'T'},
+    {"sample-on",            required_argument, 0, 'o'},
+    {"sample-off",           required_argument, 0, 'O'},
+    {"sample-roi",           no_argument,       0, 'r'},
+    {"template-table-mb",    required_argument, 0, 'M'},
     {0, 0, 0, 0},
 };
 
@@ -18,9 +27,10 @@ parse(int argc, char *argv[], command_line_options *clo)
     /* init args */
     int c = 0;
     int option_index = 0;
-    *clo = (command_line_options){NULL, NULL, NULL, 0, false};
+    *clo = (command_line_options){NULL, NULL, NULL, 0, false, false, false, 0, false, false, 0, 0, false,
+                                  DRSIGIL_TEMPLATE_TABLE_MB};
 
-    while( (c = getopt_long(argc, argv, "sn:d:t:", long_options, &option_index)) > 0 )
+    while( (c = getopt_long(argc, argv, "slfcn:d:t:", long_options, &option_index)) > 0 )
     {
         switch(c)
         {
@@ -39,6 +49,34 @@ parse(int argc, char *argv[], command_line_options *clo)
         case 's':
             clo->standalone = true;
             break;
+        case 'l':
+            clo->lockfree = true;
+            break;
+        case 'f':
+            clo->futex_ipc = true;
+            break;
+        case 'B':
+            clo->ipc_bench = atoi(optarg);
+            break;
+        case 'c':
+            clo->compact_events = true;
+            break;
+        case 'T':
+            clo->event_templates = true;
+            clo->compact_events = true;
+            break;
+        case 'o':
+            clo->sample_on = strtoull(optarg, NULL, 10);
+            break;
+        case 'O':
+            clo->sample_off = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+            clo->sample_roi = true;
+            break;
+        case 'M':
+            clo->template_table_mb = strtoull(optarg, NULL, 10);
+            break;
         default:
             break;
         }
@@ -48,8 +86,15 @@ parse(int argc, char *argv[], command_line_options *clo)
 	   (clo->standalone == false && clo->ipc_dir == NULL))
         DR_ABORT_MSG("Parsing Error"); //TODO cleanup
 
-    if(clo->start_func != NULL)
-    {
-        roi = false;
-    }
+    if(clo->ipc_bench > 0 && clo->standalone == false)
+        DR_ABORT_MSG("--ipc-bench requires --standalone");
+
+    if((clo->sample_on > 0) != (clo->sample_off > 0))
+        DR_ABORT_MSG("--sample-on and --sample-off must be given together");
+
+    if(clo->event_templates && clo->template_table_mb == 0)
+        DR_ABORT_MSG("--template-table-mb must be greater than 0");
+
+    if(clo->sample_roi && clo->start_func == NULL)
+        DR_ABORT_MSG("--sample-roi requires --start-func");
 }
@@ -0,0 +1,183 @@
+#include "drsigil.h"
+#include "drmgr.h"
+#include "drreg.h"
+
+#define MINSERT instrlist_meta_preinsert
+
+volatile bool instrumenting = true;
+
+static volatile uint sample_phase;
+/* Periodic sampling only.
+ * Even phases are instrumented, odd phases are not.
+ * The first thread to run out of its budget in a phase starts the next one;
+ * other threads pick up the new phase when their own budget runs out */
+
+static volatile int roi_threads;
+/* ROI sampling only.
+ * The number of threads inside their ROI; instrumented fragments are only
+ * built while this is non-zero. Collection itself is gated per-thread */
+
+
+static bool
+sampling_periodic(void)
+{
+    return clo.sample_on > 0 && clo.sample_off > 0;
+}
+
+
+static ptr_int_t
+phase_budget(uint phase)
+{
+    return (ptr_int_t)((phase % 2 == 0 ? clo.sample_on : clo.sample_off) * 1000000);
+}
+
+
+static void
+update_instrumenting(void)
+{
+    /* Only callable from a clean call, or a drwrap callback.
+     * Concurrent updates may both flush, which is wasteful but harmless */
+    bool want = (!sampling_periodic() || sample_phase % 2 == 0) &&
+                (!clo.sample_roi || roi_threads > 0);
+
+    if (instrumenting != want)
+    {
+        instrumenting = want;
+        /* Every thread finishes its current fragment, and then only enters
+         * fragments built for the new mode. Unlike dr_flush_region,
+         * this does not need a redirect out of the clean call */
+        if (!dr_unlink_flush_region(NULL, ~(size_t)0))
+            DR_ABORT_MSG("failed to flush fragments for sampling");
+    }
+}
+
+
+static void
+sample_budget_exhausted(void)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *tcxt = drmgr_get_tls_field(drcontext, tls_idx);
+
+    uint phase = sample_phase;
+    if (tcxt->sample_phase == phase)
+        __sync_bool_compare_and_swap(&sample_phase, phase, phase+1);
+
+    tcxt->sample_phase = sample_phase;
+    SAMPLE_BUDGET(tcxt->seg_base) = phase_budget(tcxt->sample_phase);
+
+    update_instrumenting();
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Sampling interface
+/////////////////////////////////////////////////////////////////////
+void
+init_sampling(void)
+{
+    sample_phase = 0;
+    roi_threads = 0;
+    instrumenting = !clo.sample_roi;
+
+    if (sampling_periodic() || clo.sample_roi)
+    {
+        /* dr_unlink_flush_region is only available with these */
+        uint64 thread_private = 0, full_api = 0;
+        if (!dr_get_integer_option("thread_private", &thread_private) ||
+            !dr_get_integer_option("enable_full_api", &full_api) ||
+            (!thread_private && !full_api))
+            DR_ABORT_MSG("DrSigil sampling requires -thread_private or -enable_full_api");
+    }
+}
+
+
+void
+init_thread_sampling(per_thread_t *tcxt)
+{
+    /* Without a start_func the whole application is the ROI.
+     * Otherwise a thread only enters it by calling start_func itself,
+     * whatever the thread that spawned it was doing */
+    IN_ROI(tcxt->seg_base) = false;
+    if (clo.start_func == NULL)
+        roi_enter(tcxt);
+
+    tcxt->sample_phase = sample_phase;
+    SAMPLE_BUDGET(tcxt->seg_base) = phase_budget(tcxt->sample_phase);
+}
+
+
+void
+roi_enter(per_thread_t *tcxt)
+{
+    if (IN_ROI(tcxt->seg_base))
+        return;
+
+    /* Only this thread collects events from its next event block on.
+     * Other threads, including those that were already running,
+     * stay outside of the ROI until they call start_func themselves */
+    IN_ROI(tcxt->seg_base) = true;
+    __sync_add_and_fetch(&roi_threads, 1);
+
+    if (clo.sample_roi)
+        update_instrumenting();
+}
+
+
+void
+roi_exit(per_thread_t *tcxt)
+{
+    if (!IN_ROI(tcxt->seg_base))
+        return;
+
+    /* Other threads inside their own ROI keep collecting */
+    IN_ROI(tcxt->seg_base) = false;
+    __sync_sub_and_fetch(&roi_threads, 1);
+
+    if (clo.sample_roi)
+        update_instrumenting();
+}
+
+
+void
+exit_thread_sampling(per_thread_t *tcxt)
+{
+    /* Flushing is not allowed from the thread exit event, so an exiting
+     * thread leaves any instrumented fragments behind until the next switch */
+    if (IN_ROI(tcxt->seg_base))
+    {
+        IN_ROI(tcxt->seg_base) = false;
+        __sync_sub_and_fetch(&roi_threads, 1);
+    }
+}
+
+
+void
+instrument_sample_budget(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    /* Counts the application instructions of the basic block against the
+     * thread's budget, and switches phases once the budget runs out.
+     * This is all that is left in fragments built outside of a sample */
+    if (!sampling_periodic())
+        return;
+
+    int num_instrs = 0;
+    for (instr_t *instr = where; instr != NULL; instr = instr_get_next_app(instr))
+        ++num_instrs;
+
+    if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+
+    instr_t *skip = INSTR_CREATE_label(drcontext);
+    MINSERT(ilist, where,
+            INSTR_CREATE_sub(drcontext,
+                             dr_raw_tls_opnd(drcontext, raw_tls_seg, SAMPLE_BUDGET_OFFS),
+                             OPND_CREATE_INT32(num_instrs)));
+    MINSERT(ilist, where,
+            INSTR_CREATE_jcc(drcontext, OP_jns, opnd_create_instr(skip)));
+    dr_insert_clean_call(drcontext, ilist, where,
+                         (void *)sample_budget_exhausted, false, 0);
+    MINSERT(ilist, where, skip);
+
+    if (drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+}
@@ -0,0 +1,219 @@
+#include "drsigil.h"
+#include "hashtable.h"
+#include <string.h>
+
+#define TEMPLATE_TABLE_HASH_BITS 12
+
+static hashtable_t templates;
+/* event block start pc -> event_template_t
+ * Also serializes building templates and appending to the template table */
+
+static event_template_t *all_templates;
+/* Every template ever built. A template that is replaced in the hashtable
+ * (because the code changed) may still be in use by another thread's
+ * translation, so templates are only freed at exit */
+
+static uint next_template_id;
+
+static template_table_t *template_table;
+static size_t template_table_size;
+static bool template_table_standalone;
+
+
+static uint64
+hash_event_block_code(void *drcontext, instr_t *first, uint *num_instrs, uint *code_len)
+{
+    /* FNV-1a over the application bytes of the event block */
+    uint64 hash = 14695981039346656037ULL;
+    *num_instrs = 0;
+    *code_len = 0;
+
+    for (instr_t *instr = first; instr != NULL; instr = instr_get_next_app(instr))
+    {
+        app_pc pc = instr_get_app_pc(instr);
+        if (pc != NULL)
+        {
+            byte bytes[16]; /* x86 instructions are at most 15 bytes */
+            size_t len = instr_length(drcontext, instr);
+            if (len > sizeof(bytes) || !dr_safe_read(pc, len, bytes, NULL))
+                len = 0;
+            for (size_t i=0; i<len; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+            *num_instrs += 1;
+            *code_len += len;
+        }
+        if (is_event_block_end(drcontext, instr))
+            break;
+    }
+
+    return hash;
+}
+
+
+static void
+publish_template(uint id, const byte *record, uint record_len)
+{
+    /* Caller holds the templates lock */
+    size_t entry_len = ALIGN_UP(2*sizeof(uint32_t) + record_len, sizeof(uint64_t));
+    if (template_table->used + entry_len > template_table_size)
+        DR_ABORT_MSG("DrSigil event template table is full, "
+                     "try a larger --template-table-mb");
+
+    byte *entry = (byte *)template_table + template_table->used;
+    ((uint32_t *)entry)[0] = id;
+    ((uint32_t *)entry)[1] = record_len;
+    memcpy(entry + 2*sizeof(uint32_t), record, record_len);
+
+    /* the entry must be complete before Sigil2 can see it */
+    __sync_synchronize();
+    template_table->num_templates += 1;
+    template_table->used += entry_len;
+}
+
+
+static event_template_t *
+build_event_template(void *drcontext, instr_t *first, per_thread_t *tcxt,
+                     uint num_instrs, uint code_len, uint64 code_hash)
+{
+    /* Caller holds the templates lock */
+    uint record_len;
+    build_compact_record(drcontext, first, tcxt, &record_len);
+    const compact_block_header_t *header =
+        (const compact_block_header_t *)tcxt->compact_record;
+
+    event_template_t *tmpl = dr_global_alloc(sizeof(event_template_t));
+    if (tmpl == NULL)
+        DR_ABORT_MSG("Failed to allocate event template\n");
+    tmpl->id = next_template_id++;
+    tmpl->start = instr_get_app_pc(first);
+    tmpl->num_instrs = num_instrs;
+    tmpl->code_len = code_len;
+    tmpl->code_hash = code_hash;
+    tmpl->num_mem = header->num_mem;
+
+    /* Anchors follow the template ref header, instead of the static record */
+    tmpl->anchor_offs = dr_global_alloc(sizeof(int) * (tmpl->num_mem + 1));
+    if (tmpl->anchor_offs == NULL)
+        DR_ABORT_MSG("Failed to allocate event template\n");
+    for (uint mem=0; mem<tmpl->num_mem; ++mem)
+    {
+        int offs = tcxt->anchor_offs[mem];
+        tmpl->anchor_offs[mem] =
+            offs < 0 ? -1 : (int)(offs - record_len + sizeof(compact_template_ref_t));
+    }
+
+    size_t len = sizeof(compact_template_ref_t) + sizeof(PtrVal) * header->num_anchors;
+    tmpl->num_slots = ALIGN_UP(len, sizeof(SglEvVariant)) / sizeof(SglEvVariant);
+
+    tmpl->ref.tag = DRSIGIL_TEMPLATE_TAG;
+    tmpl->ref.reserved = 0;
+    tmpl->ref.num_anchors = header->num_anchors;
+    tmpl->ref.template_id = tmpl->id;
+
+    publish_template(tmpl->id, tcxt->compact_record, record_len);
+
+    tmpl->next = all_templates;
+    all_templates = tmpl;
+    return tmpl;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Template interface
+/////////////////////////////////////////////////////////////////////
+const event_template_t *
+get_event_template(void *drcontext, instr_t *first, per_thread_t *tcxt)
+{
+    /* Hashing the code is much cheaper than rebuilding the layout,
+     * and guards against the code at this pc having changed */
+    uint num_instrs, code_len;
+    uint64 code_hash = hash_event_block_code(drcontext, first, &num_instrs, &code_len);
+
+    hashtable_lock(&templates);
+    event_template_t *tmpl = hashtable_lookup(&templates, instr_get_app_pc(first));
+    if (tmpl == NULL ||
+        tmpl->num_instrs != num_instrs ||
+        tmpl->code_len != code_len ||
+        tmpl->code_hash != code_hash)
+    {
+        tmpl = build_event_template(drcontext, first, tcxt,
+                                    num_instrs, code_len, code_hash);
+        hashtable_add_replace(&templates, tmpl->start, tmpl);
+    }
+    hashtable_unlock(&templates);
+
+    return tmpl;
+}
+
+
+void
+init_event_templates(const char *path, bool standalone)
+{
+    hashtable_init_ex(&templates, TEMPLATE_TABLE_HASH_BITS, HASH_INTPTR,
+                      false/*!str_dup*/, true/*synch*/, NULL, NULL, NULL);
+    all_templates = NULL;
+    next_template_id = 0;
+    template_table_standalone = standalone;
+    template_table_size = (size_t)clo.template_table_mb << 20;
+
+    if (standalone)
+    {
+        template_table = dr_raw_mem_alloc(template_table_size,
+                                          DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                                          NULL);
+        if (template_table == NULL)
+            DR_ABORT_MSG("Failed to allocate template table\n");
+    }
+    else
+    {
+        /* Unlike the rest of the IPC files, DrSigil creates this one */
+        char table_name[strlen(path) + sizeof(DRSIGIL_IPC_TEMPLATES_BASENAME) + 2];
+        sprintf(table_name, "%s/%s", path, DRSIGIL_IPC_TEMPLATES_BASENAME);
+
+        file_t table_file = dr_open_file(table_name,
+                                         DR_FILE_READ | DR_FILE_WRITE_OVERWRITE);
+        if (table_file == INVALID_FILE)
+            DR_ABORT_MSG("error creating template table file");
+
+        /* size the file before mapping it */
+        byte zero = 0;
+        if (!dr_file_seek(table_file, template_table_size - 1, DR_SEEK_SET) ||
+            dr_write_file(table_file, &zero, sizeof(zero)) != sizeof(zero))
+            DR_ABORT_MSG("error sizing template table file");
+
+        size_t mapped_size = template_table_size;
+        template_table = dr_map_file(table_file, &mapped_size, 0, 0,
+                                     DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+        if (mapped_size != template_table_size || template_table == NULL)
+            DR_ABORT_MSG("error mapping template table");
+
+        dr_close_file(table_file);
+    }
+
+    template_table->num_templates = 0;
+    template_table->reserved = 0;
+    template_table->used = sizeof(template_table_t);
+}
+
+
+void
+terminate_event_templates(void)
+{
+    hashtable_delete(&templates);
+
+    while (all_templates != NULL)
+    {
+        event_template_t *tmpl = all_templates;
+        all_templates = tmpl->next;
+        dr_global_free(tmpl->anchor_offs, sizeof(int) * (tmpl->num_mem + 1));
+        dr_global_free(tmpl, sizeof(event_template_t));
+    }
+
+    if (template_table_standalone)
+        dr_raw_mem_free(template_table, template_table_size);
+    else
+        dr_unmap_file(template_table, template_table_size);
+}
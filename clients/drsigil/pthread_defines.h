@@ -40,7 +40,10 @@ send_sync_event(per_thread_t *tcxt)
     /* sets the raw TLS sync event pointer,
      * letting instrumentation know to send the
      * event to sigil */
-    SGLSYNCEV_PTR(tcxt->seg_base) = tcxt->sync_ev;
+    /* Uninstrumented fragments would leave it pending
+     * until the next sample, so drop it */
+    if (instrumenting)
+        SGLSYNCEV_PTR(tcxt->seg_base) = tcxt->sync_ev;
 }
 
 static inline void
@@ -26,7 +26,8 @@ wrap_post_start_at_main()
 static void
 wrap_pre_start_func(void *wrapcxt, OUT void **user_data)
 {
-    roi = true;
+    per_thread_t *tcxt = drmgr_get_tls_field(dr_get_current_drcontext(), tls_idx);
+    roi_enter(tcxt);
 }
 static void
 wrap_post_start_func(void *wrapcxt, void *user_data)
@@ -44,7 +45,8 @@ wrap_pre_stop_func(void *wrapcxt, OUT void **user_data)
 static void
 wrap_post_stop_func(void *wrapcxt, void *user_data)
 {
-    roi = false;
+    per_thread_t *tcxt = drmgr_get_tls_field(dr_get_current_drcontext(), tls_idx);
+    roi_exit(tcxt);
 }
 
 #endif
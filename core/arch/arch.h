@@ -1254,6 +1254,9 @@ typedef struct _slot_t {
     reg_id_t value;
 } slot_t;
 
+/* Max number of distinct direct callees we follow from one clean call callee. */
+#define CLEANCALL_MAX_CALLEES 4
+
 /* data structure of clean call callee information. */
 typedef struct _callee_info_t {
     bool bailout;             /* if we bail out on function analysis */
@@ -1277,6 +1280,9 @@ typedef struct _callee_info_t {
     uint slots_used;          /* scratch slots needed after analysis */
     slot_t scratch_slots[CLEANCALL_NUM_INLINE_SLOTS];  /* scratch slot allocation */
     instrlist_t *ilist;       /* instruction list of function for inline. */
+    uint num_callees;         /* number of direct callees followed */
+    /* summaries of direct callees, owned by the callee info table */
+    struct _callee_info_t *callees[CLEANCALL_MAX_CALLEES];
 } callee_info_t;
 extern callee_info_t     default_callee_info;
 extern clean_call_info_t default_clean_call_info;
@@ -212,6 +212,11 @@ callee_info_table_add(callee_info_t *ci)
 
 /* The max number of instructions the callee can have for inline. */
 #define MAX_NUM_INLINE_INSTRS 20
+/* The max depth of direct calls we follow from a clean call callee. */
+#define MAX_CALLEE_ANALYSIS_DEPTH 3
+
+static callee_info_t *
+callee_info_analyze(dcontext_t *dcontext, app_pc callee, uint num_args, uint depth);
 
 /* Decode instruction from callee and return the next_pc to be decoded. */
 static app_pc
@@ -247,9 +252,51 @@ decode_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc instr_pc)
     return next_pc;
 }
 
+/* Follows a direct call from the callee being analyzed to tgt_pc by looking up
+ * or computing a summary of the target.  The call itself is not kept in
+ * ci->ilist: a callee with callouts is never inlined, and it absorbs its
+ * callees' register and aflags usage in analyze_callee_callees().
+ */
+static app_pc
+check_callee_callout(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc,
+                     app_pc tgt_pc, uint depth)
+{
+    callee_info_t *sub;
+    uint i;
+    for (i = 0; i < ci->num_callees; i++) {
+        if (ci->callees[i]->start == tgt_pc) {
+            ci->bailout = false;
+            return next_pc;
+        }
+    }
+    if (depth + 1 >= MAX_CALLEE_ANALYSIS_DEPTH ||
+        ci->num_callees >= CLEANCALL_MAX_CALLEES ||
+        tgt_pc == ci->start) {
+        LOG(THREAD, LOG_CLEANCALL, 2,
+            "CLEANCALL: bail out on callout to "PFX": over budget or recursive\n",
+            tgt_pc);
+        return NULL;
+    }
+    sub = callee_info_table_lookup(tgt_pc);
+    if (sub == NULL)
+        sub = callee_info_analyze(dcontext, tgt_pc, 0, depth + 1);
+    if (sub == NULL || sub->bailout) {
+        LOG(THREAD, LOG_CLEANCALL, 2,
+            "CLEANCALL: bail out on callout to complex callee "PFX"\n", tgt_pc);
+        return NULL;
+    }
+    LOG(THREAD, LOG_CLEANCALL, 2,
+        "CLEANCALL: callee "PFX" calls analyzed callee "PFX"\n", ci->start, tgt_pc);
+    STATS_INC(cleancall_callees_followed);
+    ci->callees[ci->num_callees++] = sub;
+    ci->bailout = false;
+    return next_pc;
+}
+
 /* check newly decoded instruction from callee */
 static app_pc
-check_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc)
+check_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc,
+                   uint depth)
 {
     instrlist_t *ilist = ci->ilist;
     instr_t *instr;
@@ -296,9 +343,17 @@ check_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc)
              * or
              * 2. call pic_func;
              *    and in pic_func: mov [%xsp] %r1; ret;
+             * Otherwise, follow the call to a summary of its target.
              */
-            if (INTERNAL_OPTION(opt_cleancall) >= 1)
-                return check_callee_instr_level2(dcontext, ci, next_pc, cur_pc, tgt_pc);
+            if (INTERNAL_OPTION(opt_cleancall) >= 1) {
+                instr_t *last = instrlist_last(ilist);
+                app_pc pic_next_pc =
+                    check_callee_instr_level2(dcontext, ci, next_pc, cur_pc, tgt_pc);
+                /* bail if it was PIC code or it appended to ilist and then failed */
+                if (!ci->bailout || instrlist_last(ilist) != last)
+                    return pic_next_pc;
+                return check_callee_callout(dcontext, ci, next_pc, tgt_pc, depth);
+            }
         } else { /* ubr or cbr */
             tgt_pc = opnd_get_pc(instr_get_target(instr));
             if (tgt_pc < cur_pc) { /* backward branch */
@@ -367,7 +422,7 @@ check_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
 }
 
 static void
-decode_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
+decode_callee_ilist(dcontext_t *dcontext, callee_info_t *ci, uint depth)
 {
     app_pc cur_pc;
 
@@ -379,7 +434,7 @@ decode_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
     ci->bailout = false;
     while (cur_pc != NULL) {
         cur_pc = decode_callee_instr(dcontext, ci, cur_pc);
-        cur_pc = check_callee_instr(dcontext, ci, cur_pc);
+        cur_pc = check_callee_instr(dcontext, ci, cur_pc, depth);
     }
     check_callee_ilist(dcontext, ci);
 }
@@ -456,6 +511,12 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
             ci->start);
         opt_inline = false;
     }
+    if (ci->num_callees > 0) {
+        LOG(THREAD, LOG_CLEANCALL, 1,
+            "CLEANCALL: callee "PFX" cannot be inlined: calls out.\n",
+            ci->start);
+        opt_inline = false;
+    }
     if (ci->spill_reg == DR_REG_INVALID) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined:"
@@ -491,6 +552,41 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
     }
 }
 
+/* Adds the registers and aflags clobbered by ci's direct callees to ci's own
+ * usage.  Registers a callee saves and restores itself are not clobbered.
+ */
+static void
+analyze_callee_callees(dcontext_t *dcontext, callee_info_t *ci)
+{
+    uint i, j;
+    for (i = 0; i < ci->num_callees; i++) {
+        callee_info_t *sub = ci->callees[i];
+        ASSERT(!sub->bailout);
+        for (j = 0; j < NUM_SIMD_REGS; j++) {
+            if (sub->simd_used[j] && !ci->simd_used[j]) {
+                ci->simd_used[j] = true;
+                ci->num_simd_used++;
+            }
+        }
+        for (j = 0; j < NUM_GP_REGS; j++) {
+            if (sub->reg_used[j] && !sub->callee_save_regs[j])
+                ci->reg_used[j] = true;
+        }
+        /* we do not track where the call is wrt our own aflags writes */
+        if (sub->read_flags)
+            ci->read_flags = true;
+        if (sub->write_flags)
+            ci->write_flags = true;
+    }
+#ifdef AARCH64
+    /* the bl instructions we followed write the link register */
+    ci->reg_used[DR_REG_LR - DR_REG_START_GPR] = true;
+#endif
+    LOG(THREAD, LOG_CLEANCALL, 2,
+        "CLEANCALL: callee "PFX" uses %d SIMD regs including those of its %d callees\n",
+        ci->start, ci->num_simd_used, ci->num_callees);
+}
+
 static void
 analyze_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -500,6 +596,8 @@ analyze_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
         analyze_callee_save_reg(dcontext, ci);
     }
     analyze_callee_regs_usage(dcontext, ci);
+    if (ci->num_callees > 0)
+        analyze_callee_callees(dcontext, ci);
     if (INTERNAL_OPTION(opt_cleancall) < 1) {
         instrlist_clear_and_destroy(GLOBAL_DCONTEXT, ci->ilist);
         ci->ilist = NULL;
@@ -685,6 +783,37 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
     return opt_inline;
 }
 
+/* Decodes and analyzes the function at callee and adds the result to the
+ * callee info table.  depth is the number of calls followed from a clean call
+ * target to reach callee.  Returns NULL for a nested callee we fail to analyze,
+ * as that may be due to our depth budget, which should not affect a later
+ * clean call directly to it.
+ */
+static callee_info_t *
+callee_info_analyze(dcontext_t *dcontext, app_pc callee, uint num_args, uint depth)
+{
+    callee_info_t *ci;
+    STATS_INC(cleancall_analyzed);
+    LOG(THREAD, LOG_CLEANCALL, 2, "CLEANCALL: analyze callee "PFX" at depth %d\n",
+        callee, depth);
+    /* 1. create func_info */
+    ci = callee_info_create(callee, num_args);
+    /* 2. decode the callee */
+    decode_callee_ilist(dcontext, ci, depth);
+    /* 3. analyze the instrlist */
+    if (ci->bailout) {
+        if (depth > 0) {
+            callee_info_free(dcontext, ci);
+            return NULL;
+        }
+        callee_info_init(ci);
+        ci->start = callee;
+    } else
+        analyze_callee_ilist(dcontext, ci);
+    /* 4. add info into callee list */
+    return callee_info_table_add(ci);
+}
+
 bool
 analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
                    void *callee, bool save_fpstate, bool always_out_of_line,
@@ -701,23 +830,9 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
     if (INTERNAL_OPTION(opt_cleancall) > 0) {
         /* 3. search if callee was analyzed before */
         ci = callee_info_table_lookup(callee);
-        /* 4. this callee is not seen before */
-        if (ci == NULL) {
-            STATS_INC(cleancall_analyzed);
-            LOG(THREAD, LOG_CLEANCALL, 2, "CLEANCALL: analyze callee "PFX"\n", callee);
-            /* 4.1. create func_info */
-            ci = callee_info_create((app_pc)callee, num_args);
-            /* 4.2. decode the callee */
-            decode_callee_ilist(dcontext, ci);
-            /* 4.3. analyze the instrlist */
-            if (ci->bailout) {
-                callee_info_init(ci);
-                ci->start = (app_pc)callee;
-            } else
-                analyze_callee_ilist(dcontext, ci);
-            /* 4.4. add info into callee list */
-            ci = callee_info_table_add(ci);
-        }
+        /* 4. this callee is not seen before: analyze it and its callees */
+        if (ci == NULL)
+            ci = callee_info_analyze(dcontext, (app_pc)callee, num_args, 0);
         cci->callee_info = ci;
         if (!ci->bailout) {
             /* 5. aflags optimization analysis */
@@ -188,6 +188,7 @@ typedef struct {
     bool record_translation; /* store translation info for each instr_t? */
     bool has_bb_building_lock; /* usually ==for_cache; used for aborting bb building */
     bool checked_start_vmarea; /* caller called check_new_page_start() on start_pc */
+    bool ir_arena_was_active;  /* for_cache only: heap_ir_arena_enter() result */
     file_t outf;               /* send disassembly and notes to a file?
                                 * we use this mainly for dumping trace origins */
     app_pc stop_pc;          /* Optional: NULL for normal termination rules.
@@ -4412,6 +4413,12 @@ bb_build_abort(dcontext_t *dcontext, bool clean_vmarea, bool unlock)
                 ASSERT_DO_NOT_OWN_MUTEX(USE_BB_BUILDING_LOCK(), &bb_building_lock);
         }
         dcontext->bb_build_info = NULL;
+        /* An aborted build may never return to build_basic_block_fragment(),
+         * so we restore the arena state it entered with, which may be an
+         * enclosing scope's.  Other builds do not enter the arena.
+         */
+        if (bb->for_cache)
+            heap_ir_arena_exit(dcontext, bb->ir_arena_was_active);
     }
 }
 
@@ -4987,7 +4994,7 @@ at_native_exec_gateway(dcontext_t *dcontext, app_pc start, bool *is_call
  */
 static inline void
 init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
-                     uint initial_flags
+                     uint initial_flags, bool ir_arena_was_active
                      _IF_CLIENT(bool for_trace)
                      _IF_CLIENT(instrlist_t **unmangled_ilist))
 {
@@ -5007,6 +5014,7 @@ init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
                    FRAG_HAS_TRANSLATION_INFO : 0), NULL/*no overlap*/);
     if (!TEST(FRAG_TEMP_PRIVATE, initial_flags))
         bb->has_bb_building_lock = true;
+    bb->ir_arena_was_active = ir_arena_was_active;
 #ifdef CLIENT_INTERFACE
     /* We avoid races where there is no hook when we start building a
      * bb (and hence we don't record translation or do full decode) yet
@@ -5081,8 +5089,11 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
     build_bb_t bb;
     where_am_i_t wherewasi = dcontext->whereami;
     bool image_entry;
+    bool ir_arena_was_active;
     KSTART(bb_building);
     dcontext->whereami = WHERE_INTERP;
+    /* all IR for this bb is freed at exit_interp_build_bb(): use the arena */
+    ir_arena_was_active = heap_ir_arena_enter(dcontext);
 
     /* Neither thin_client nor hotp_only should be building any bbs. */
     ASSERT(!RUNNING_WITHOUT_CODE_CACHE());
@@ -5092,7 +5103,7 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
      */
     image_entry = check_for_image_entry(start);
 
-    init_interp_build_bb(dcontext, &bb, start, initial_flags
+    init_interp_build_bb(dcontext, &bb, start, initial_flags, ir_arena_was_active
                          _IF_CLIENT(for_trace) _IF_CLIENT(unmangled_ilist));
     if (at_native_exec_gateway(dcontext, start, &bb.native_call
                                _IF_DEBUG(false/*not xfer tgt*/))) {
@@ -5117,7 +5128,7 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
             instrlist_clear_and_destroy(dcontext, bb.ilist);
             vm_area_destroy_list(dcontext, bb.vmlist);
             dcontext->bb_build_info = NULL;
-            init_interp_build_bb(dcontext, &bb, start, initial_flags
+            init_interp_build_bb(dcontext, &bb, start, initial_flags, ir_arena_was_active
                                  _IF_CLIENT(for_trace) _IF_CLIENT(unmangled_ilist));
 #ifdef CLIENT_INTERFACE
             /* PR 232617 - build_native_exec_bb doesn't support setting
@@ -5184,6 +5195,7 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
 
     exit_interp_build_bb(dcontext, &bb);
  build_basic_block_fragment_done:
+    heap_ir_arena_exit(dcontext, ir_arena_was_active);
     dcontext->whereami = wherewasi;
     KSTOP(bb_building);
     return f;
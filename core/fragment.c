@@ -6311,6 +6311,12 @@ flush_fragments_thread_unlink(dcontext_t *dcontext, int thread_index,
  * region [base, base+size) by synchronizing with each thread and
  * invoking thread_synch_callback().
  *
+ * Shared flushes still go through this per-thread synch: only the freeing
+ * of the unlinked shared fragments is deferred by flushtime epoch (see
+ * vm_area_check_shared_pending()).  The synch is what keeps every thread
+ * from building, linking, or adding exec areas for the region while it is
+ * being unlinked, which the epochs alone do not cover.
+ *
  * If shared syscalls and/or special IBL transfer are thread-private, they will
  * be unlinked for each thread prior to invocation of the callback. The return
  * value of the callback indicates whether to relink these routines (true), or
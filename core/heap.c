@@ -47,6 +47,7 @@
 #include "link.h"      /* for struct sizes */
 #include "instr.h"     /* for struct sizes */
 #include "fcache.h"    /* fcache_low_on_memory */
+#include "monitor.h"   /* is_building_trace */
 #ifdef DEBUG
 # include "hotpatch.h" /* To handle leak for case 9593. */
 #endif
@@ -276,10 +277,62 @@ typedef struct _thread_units_t {
 #define SEPARATE_NONPERSISTENT_HEAP() \
     (DYNAMO_OPTION(enable_reset) IF_CLIENT_INTERFACE(|| true))
 
+/* Per-thread cache of fixed-size global heap blocks, so that the common
+ * global_heap_alloc() and global_heap_free() cases need not take
+ * global_alloc_lock.  Blocks are refilled from and drained back to
+ * heapmgt->global_units in batches.  Each list is linked through the first
+ * pointer of its blocks, just like thread_units_t.free_list.
+ */
+typedef struct _heap_magazine_t {
+    heap_pc list[BLOCK_TYPES-1]; /* no variable-length bucket */
+    uint count[BLOCK_TYPES-1];
+    bool enabled;
+#ifdef HEAP_ACCOUNTING
+    /* Cached blocks are charged to ACCT_MEM_MGT in global_units; handing one
+     * out moves the charge to the caller's category here, without a lock.
+     * Added to the global totals at thread exit.
+     */
+    heap_acct_t acct;
+#endif
+} heap_magazine_t;
+
+/* A chunk of a thread's IR arena: allocations are bumped from just past
+ * this header.  num_live counts allocations not yet freed: when it drops
+ * to 0 the whole chunk is released at once.
+ */
+typedef struct _ir_arena_chunk_t {
+    heap_pc cur_pc;
+    heap_pc end_pc;
+    uint num_live;
+    /* links in ir_arena_t.retired */
+    struct _ir_arena_chunk_t *prev;
+    struct _ir_arena_chunk_t *next;
+} ir_arena_chunk_t;
+
+#define IR_ARENA_CHUNK_SIZE (16*1024)
+#define IR_ARENA_CHUNK_START(c) \
+    ((heap_pc)(c) + ALIGN_FORWARD(sizeof(ir_arena_chunk_t), HEAP_ALIGNMENT))
+/* larger IR requests go straight to the heap */
+#define IR_ARENA_MAX_ALLOC (IR_ARENA_CHUNK_SIZE / 8)
+/* Thread-private bump arena for the short-lived IR of a bb or trace build.
+ * A full chunk still holding IR (e.g., client-retained instrlists or a trace
+ * under construction) is retired: each retired chunk lives on until its own
+ * last allocation is freed, without affecting the rest of the arena.
+ */
+typedef struct _ir_arena_t {
+    ir_arena_chunk_t *cur;
+    ir_arena_chunk_t *retired; /* list of full chunks with live IR */
+    uint num_retired;
+    ir_arena_chunk_t *spare; /* an emptied chunk kept for the next retirement */
+    bool active; /* inside heap_ir_arena_enter() */
+} ir_arena_t;
+
 /* per-thread structure: */
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
     thread_units_t *nonpersistent_heap;
+    heap_magazine_t global_magazine;
+    ir_arena_t ir_arena;
 } thread_heap_t;
 
 /* global, unique thread-shared structure:
@@ -420,9 +473,34 @@ DECLARE_NEVERPROT_VAR(static thread_units_t global_racy_units, {0});
     global_racy_units.acct.cur_usage[which] -= size;    \
 } while (0)
 
+/* Magazine blocks are already claimed (as ACCT_MEM_MGT), so these just move
+ * the charge.  A thread's magazine totals can go negative for a category when
+ * it frees what another thread allocated, so we do not track max_usage.
+ */
+# define ACCOUNT_FOR_MAGAZINE_ALLOC(mag, which, alloc_sz, ask_sz) do {      \
+    (mag)->acct.alloc_reuse[which] += alloc_sz;                          \
+    (mag)->acct.num_alloc[which]++;                                      \
+    (mag)->acct.cur_usage[which] += alloc_sz;                            \
+    (mag)->acct.cur_usage[ACCT_MEM_MGT] -= alloc_sz;                     \
+    if (ask_sz > (mag)->acct.max_single[which])                          \
+        (mag)->acct.max_single[which] = ask_sz;                          \
+    ACCOUNT_FOR_ALLOC_HELPER(alloc_reuse, &global_racy_units, which,     \
+                             alloc_sz, ask_sz);                          \
+    global_racy_units.acct.cur_usage[ACCT_MEM_MGT] -= alloc_sz;          \
+} while (0)
+
+# define ACCOUNT_FOR_MAGAZINE_FREE(mag, which, size) do {              \
+    (mag)->acct.cur_usage[which] -= size;                           \
+    (mag)->acct.cur_usage[ACCT_MEM_MGT] += size;                    \
+    global_racy_units.acct.cur_usage[which] -= size;                \
+    global_racy_units.acct.cur_usage[ACCT_MEM_MGT] += size;         \
+} while (0)
+
 #else
 # define ACCOUNT_FOR_ALLOC(type, tu, which, alloc_sz, ask_sz)
 # define ACCOUNT_FOR_FREE(tu, which, size)
+# define ACCOUNT_FOR_MAGAZINE_ALLOC(mag, which, alloc_sz, ask_sz)
+# define ACCOUNT_FOR_MAGAZINE_FREE(mag, which, size)
 #endif
 
 typedef byte *vm_addr_t;
@@ -2688,11 +2766,181 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size HEAPACCT(which_
     ASSERT(ok);
 }
 
+/* Returns the calling thread's global heap magazine, or NULL if it has none
+ * (yet or any more).
+ */
+static heap_magazine_t *
+get_thread_magazine(void)
+{
+    dcontext_t *dcontext;
+    thread_heap_t *th;
+    if (INTERNAL_OPTION(heap_magazine_size) == 0)
+        return NULL;
+    dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    th = (thread_heap_t *) dcontext->heap_field;
+    if (th == NULL || !th->global_magazine.enabled)
+        return NULL;
+    return &th->global_magazine;
+}
+
+/* Moves up to half a magazine's worth of bucket blocks from the central
+ * global units into mag under a single acquisition of global_alloc_lock.
+ * Returns false if none could be obtained.
+ */
+static bool
+magazine_refill(heap_magazine_t *mag, uint bucket)
+{
+    uint i, batch = (INTERNAL_OPTION(heap_magazine_size) + 1) / 2;
+    acquire_recursive_lock(&global_alloc_lock);
+    for (i = 0; i < batch; i++) {
+        heap_pc p = (heap_pc)
+            common_heap_alloc(&heapmgt->global_units, BLOCK_SIZES[bucket]
+                              HEAPACCT(ACCT_MEM_MGT));
+        if (p == NULL) {
+            /* we need dynamo_vm_areas_lock for a new unit: leave that to
+             * common_global_heap_alloc()
+             */
+            break;
+        }
+#ifdef DEBUG_MEMORY
+        /* cached blocks look just like central free list blocks */
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+        *((heap_pc *)p) = mag->list[bucket];
+        mag->list[bucket] = p;
+        mag->count[bucket]++;
+    }
+    release_recursive_lock(&global_alloc_lock);
+    STATS_INC(heap_magazine_refills);
+    return mag->list[bucket] != NULL;
+}
+
+/* Returns all but keep of mag's bucket blocks to the central global units */
+static void
+magazine_drain(heap_magazine_t *mag, uint bucket, uint keep)
+{
+    acquire_recursive_lock(&global_alloc_lock);
+    while (mag->count[bucket] > keep) {
+        heap_pc p = mag->list[bucket];
+        DEBUG_DECLARE(bool ok;)
+        ASSERT(p != NULL);
+        mag->list[bucket] = *((heap_pc *)p);
+        mag->count[bucket]--;
+#ifdef DEBUG_MEMORY
+        /* avoid common_heap_free()'s double free check */
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_ALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+        DEBUG_DECLARE(ok = )
+            common_heap_free(&heapmgt->global_units, p, BLOCK_SIZES[bucket]
+                             HEAPACCT(ACCT_MEM_MGT));
+        /* only oversized allocations ever need to free units */
+        ASSERT(ok);
+    }
+    release_recursive_lock(&global_alloc_lock);
+    STATS_INC(heap_magazine_drains);
+}
+
+/* Returns every cached block to the central global units */
+static void
+magazine_flush(heap_magazine_t *mag)
+{
+    uint bucket;
+    for (bucket = 0; bucket < BLOCK_TYPES-1; bucket++) {
+        if (mag->count[bucket] > 0)
+            magazine_drain(mag, bucket, 0);
+    }
+}
+
+/* Satisfies a fixed-size global allocation from the calling thread's
+ * magazine.  Returns NULL if the caller must use the central units instead.
+ */
+static void *
+magazine_alloc(size_t size HEAPACCT(which_heap_t which))
+{
+    heap_magazine_t *mag;
+    heap_pc p;
+    uint bucket = 0;
+    size_t aligned_size;
+#if defined(DEBUG_MEMORY) && defined(DEBUG)
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+#endif
+    if (size == 0 || size > BLOCK_SIZES[BLOCK_TYPES-2])
+        return NULL;
+    mag = get_thread_magazine();
+    if (mag == NULL)
+        return NULL;
+    aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    if (mag->list[bucket] == NULL && !magazine_refill(mag, bucket))
+        return NULL;
+    p = mag->list[bucket];
+    mag->list[bucket] = *((heap_pc *)p);
+    ASSERT(ALIGNED(mag->list[bucket], HEAP_ALIGNMENT));
+    mag->count[bucket]--;
+    ACCOUNT_FOR_MAGAZINE_ALLOC(mag, which, BLOCK_SIZES[bucket], aligned_size);
+    STATS_INC(heap_magazine_hits);
+#ifdef DEBUG_MEMORY
+    /* verify is unallocated memory, skip free list next pointer */
+    DOCHECK(chklvl, {
+        CLIENT_ASSERT(is_region_memset_to_char
+                      (p+sizeof(heap_pc *), BLOCK_SIZES[bucket]-sizeof(heap_pc *),
+                       HEAP_UNALLOCATED_BYTE), "memory corruption detected");
+    });
+    DOCHECK(chklvl, memset(p+size, HEAP_PAD_BYTE, BLOCK_SIZES[bucket]-size););
+    DOCHECK(chklvl, memset(p, HEAP_ALLOCATED_BYTE, size););
+#endif
+    return (void *) p;
+}
+
+/* Returns a fixed-size global block to the calling thread's magazine,
+ * draining half of it if it is full.  Returns false if the caller must free
+ * to the central units instead.
+ */
+static bool
+magazine_free(void *p_void, size_t size HEAPACCT(which_heap_t which))
+{
+    heap_magazine_t *mag;
+    heap_pc p = (heap_pc) p_void;
+    uint bucket = 0;
+    size_t aligned_size;
+#if defined(DEBUG_MEMORY) && defined(DEBUG)
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+#endif
+    if (p == NULL || size == 0 || size > BLOCK_SIZES[BLOCK_TYPES-2])
+        return false;
+    mag = get_thread_magazine();
+    if (mag == NULL)
+        return false;
+    aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+#ifdef DEBUG_MEMORY
+    ASSERT_MESSAGE(chklvl, "heap overflow",
+                   is_region_memset_to_char(p+size, BLOCK_SIZES[bucket]-size,
+                                            HEAP_PAD_BYTE));
+    /* set used and padding memory back to unallocated */
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+    ACCOUNT_FOR_MAGAZINE_FREE(mag, which, BLOCK_SIZES[bucket]);
+    ASSERT(ALIGNED(p, HEAP_ALIGNMENT));
+    *((heap_pc *)p) = mag->list[bucket];
+    mag->list[bucket] = p;
+    mag->count[bucket]++;
+    if (mag->count[bucket] > INTERNAL_OPTION(heap_magazine_size))
+        magazine_drain(mag, bucket, INTERNAL_OPTION(heap_magazine_size) / 2);
+    return true;
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 {
-    void *p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
+    void *p = magazine_alloc(size HEAPACCT(which));
+    if (p == NULL)
+        p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes)\n", p, size);
     return p;
@@ -2701,7 +2949,8 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
-    common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
+    if (!magazine_free(p, size HEAPACCT(which)))
+        common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes)\n", p, size);
 }
 
@@ -3159,6 +3408,8 @@ heap_thread_init(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *)
         global_heap_alloc(sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    memset(&th->global_magazine, 0, sizeof(th->global_magazine));
+    memset(&th->ir_arena, 0, sizeof(th->ir_arena));
     dcontext->heap_field = (void *) th;
     th->local_heap = (thread_units_t *) global_heap_alloc(sizeof(thread_units_t)
                                                        HEAPACCT(ACCT_MEM_MGT));
@@ -3169,6 +3420,7 @@ heap_thread_init(dcontext_t *dcontext)
     } else
         th->nonpersistent_heap = NULL;
     heap_thread_reset_init(dcontext);
+    th->global_magazine.enabled = (INTERNAL_OPTION(heap_magazine_size) > 0);
 }
 
 void
@@ -3184,14 +3436,34 @@ heap_thread_reset_free(dcontext_t *dcontext)
          */
         threadunits_exit(th->nonpersistent_heap, dcontext);
     }
+    /* Cached global blocks are persistent, but hand them back so other
+     * threads can use them once we resume.
+     */
+    magazine_flush(&th->global_magazine);
 }
 
 void
 heap_thread_exit(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
+    /* send any further global frees for this thread to the central units */
+    th->global_magazine.enabled = false;
+    /* Chunks still holding IR are left for threadunits_exit() to report as
+     * ACCT_IR leaks, just like individually allocated IR.
+     */
+    if (th->ir_arena.cur != NULL && th->ir_arena.cur->num_live == 0) {
+        heap_free(dcontext, th->ir_arena.cur, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+        th->ir_arena.cur = NULL;
+    }
+    if (th->ir_arena.spare != NULL) {
+        heap_free(dcontext, th->ir_arena.spare, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+        th->ir_arena.spare = NULL;
+    }
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
+#ifdef HEAP_ACCOUNTING
+    add_heapacct_to_global_stats(&th->global_magazine.acct);
+#endif
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
     if (SEPARATE_NONPERSISTENT_HEAP()) {
         ASSERT(th->nonpersistent_heap != NULL);
@@ -3773,6 +4045,178 @@ heap_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which
     ASSERT(ok);
 }
 
+/* Starts routing this thread's IR allocations through its IR arena.
+ * Returns the previous state, to be passed to heap_ir_arena_exit().
+ */
+bool
+heap_ir_arena_enter(dcontext_t *dcontext)
+{
+    thread_heap_t *th;
+    bool was_active;
+    if (dcontext == GLOBAL_DCONTEXT || !INTERNAL_OPTION(ir_arena))
+        return false;
+    th = (thread_heap_t *) dcontext->heap_field;
+    was_active = th->ir_arena.active;
+    th->ir_arena.active = true;
+    return was_active;
+}
+
+void
+heap_ir_arena_exit(dcontext_t *dcontext, bool was_active)
+{
+    if (dcontext == GLOBAL_DCONTEXT || !INTERNAL_OPTION(ir_arena))
+        return;
+    ((thread_heap_t *) dcontext->heap_field)->ir_arena.active = was_active;
+}
+
+/* Returns an empty chunk: the arena's spare if it has one */
+static ir_arena_chunk_t *
+ir_arena_chunk_create(dcontext_t *dcontext, ir_arena_t *arena)
+{
+    ir_arena_chunk_t *chunk = arena->spare;
+    if (chunk != NULL)
+        arena->spare = NULL;
+    else {
+        chunk = (ir_arena_chunk_t *)
+            heap_alloc(dcontext, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+        chunk->end_pc = (heap_pc)chunk + IR_ARENA_CHUNK_SIZE;
+    }
+    chunk->cur_pc = IR_ARENA_CHUNK_START(chunk);
+    chunk->num_live = 0;
+    chunk->prev = NULL;
+    chunk->next = NULL;
+    return chunk;
+}
+
+static void
+ir_arena_retire(ir_arena_t *arena, ir_arena_chunk_t *chunk)
+{
+    chunk->prev = NULL;
+    chunk->next = arena->retired;
+    if (arena->retired != NULL)
+        arena->retired->prev = chunk;
+    arena->retired = chunk;
+    arena->num_retired++;
+    STATS_INC(ir_arena_retired);
+    STATS_TRACK_MAX(ir_arena_max_retired, arena->num_retired);
+}
+
+/* Unlinks an emptied retired chunk, keeping it as the spare if there is none */
+static void
+ir_arena_release(dcontext_t *dcontext, ir_arena_t *arena, ir_arena_chunk_t *chunk)
+{
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk->next;
+    else
+        arena->retired = chunk->next;
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+    arena->num_retired--;
+    if (arena->spare == NULL)
+        arena->spare = chunk;
+    else
+        heap_free(dcontext, chunk, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+}
+
+static inline bool
+ir_arena_chunk_contains(ir_arena_chunk_t *chunk, heap_pc p)
+{
+    return (p >= IR_ARENA_CHUNK_START(chunk) && p < chunk->end_pc);
+}
+
+#ifdef DEBUG
+/* While a trace is being built, the unmangled clone of each of its bbs stays
+ * alive until end_and_emit_trace(), pinning arena chunks, so we count the
+ * arena's allocations and retirements there separately.
+ */
+static bool
+ir_arena_building_trace(dcontext_t *dcontext)
+{
+    return (dcontext->monitor_field != NULL && is_building_trace(dcontext));
+}
+#endif
+
+/* Allocates IR memory: from the thread's IR arena while inside
+ * heap_ir_arena_enter(), else from the thread's heap.
+ * Must be freed with heap_ir_free().
+ */
+void *
+heap_ir_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which))
+{
+    ir_arena_t *arena;
+    heap_pc p;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    if (dcontext == GLOBAL_DCONTEXT || aligned_size > IR_ARENA_MAX_ALLOC)
+        return heap_alloc(dcontext, size HEAPACCT(which));
+    arena = &((thread_heap_t *) dcontext->heap_field)->ir_arena;
+    if (!arena->active)
+        return heap_alloc(dcontext, size HEAPACCT(which));
+    if (arena->cur == NULL)
+        arena->cur = ir_arena_chunk_create(dcontext, arena);
+    else if (arena->cur->cur_pc + aligned_size > arena->cur->end_pc) {
+        /* an empty chunk would have been rewound by heap_ir_free() */
+        ASSERT(arena->cur->num_live > 0);
+        DOSTATS({
+            if (ir_arena_building_trace(dcontext))
+                STATS_INC(ir_arena_trace_retired);
+        });
+        ir_arena_retire(arena, arena->cur);
+        arena->cur = ir_arena_chunk_create(dcontext, arena);
+    }
+    p = arena->cur->cur_pc;
+    arena->cur->cur_pc += aligned_size;
+    arena->cur->num_live++;
+    STATS_INC(ir_arena_allocs);
+    DOSTATS({
+        if (ir_arena_building_trace(dcontext))
+            STATS_INC(ir_arena_trace_allocs);
+    });
+#ifdef DEBUG_MEMORY
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_ALLOCATED_BYTE, size););
+#endif
+    return (void *) p;
+}
+
+/* Frees memory from heap_ir_alloc(), which may have been allocated outside
+ * of any arena scope or in an earlier one.
+ */
+void
+heap_ir_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which))
+{
+    ir_arena_t *arena;
+    ir_arena_chunk_t *chunk;
+    if (dcontext == GLOBAL_DCONTEXT) {
+        heap_free(dcontext, p, size HEAPACCT(which));
+        return;
+    }
+    arena = &((thread_heap_t *) dcontext->heap_field)->ir_arena;
+    chunk = arena->cur;
+    if (chunk == NULL || !ir_arena_chunk_contains(chunk, (heap_pc) p)) {
+        /* Chunks are only retired while pinned, so this list stays short */
+        for (chunk = arena->retired; chunk != NULL; chunk = chunk->next) {
+            if (ir_arena_chunk_contains(chunk, (heap_pc) p))
+                break;
+        }
+        if (chunk == NULL) {
+            heap_free(dcontext, p, size HEAPACCT(which));
+            return;
+        }
+    }
+#ifdef DEBUG_MEMORY
+    /* there is no reuse short of the whole chunk, so this catches stale uses */
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, size););
+#endif
+    ASSERT(chunk->num_live > 0);
+    chunk->num_live--;
+    if (chunk->num_live > 0)
+        return;
+    if (chunk == arena->cur) {
+        /* all IR from this build is gone: release it all at once */
+        chunk->cur_pc = IR_ARENA_CHUNK_START(chunk);
+    } else
+        ir_arena_release(dcontext, arena, chunk);
+}
+
 bool local_heap_protected(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
@@ -192,6 +192,17 @@ bool is_stack_overflow(dcontext_t *dcontext, byte *sp);
 void *heap_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which));
 void heap_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which));
 
+/* IR (instr_t, instrlist_t, operand arrays, raw bits) is allocated with
+ * these.  Between heap_ir_arena_enter() and heap_ir_arena_exit() (a bb or
+ * trace build) thread-private IR is bump-allocated and released all at once
+ * when the last piece is freed; IR that outlives the build keeps its chunk
+ * alive until it too is freed.
+ */
+bool heap_ir_arena_enter(dcontext_t *dcontext);
+void heap_ir_arena_exit(dcontext_t *dcontext, bool was_active);
+void *heap_ir_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which));
+void heap_ir_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which));
+
 #ifdef HEAP_ACCOUNTING
 void print_heap_statistics(void);
 #endif
@@ -265,6 +265,8 @@ static client_lib_t client_libs[MAX_CLIENT_LIBS] = {{0,}};
 static size_t num_client_libs = 0;
 
 static void *persist_user_data[MAX_CLIENT_LIBS];
+/* combined dr_set_persist_version() values of all clients */
+static uint64 persist_client_version;
 
 #ifdef WINDOWS
 /* private kernel32 lib, used to print to console */
@@ -7718,6 +7720,30 @@ dr_unregister_persist_patch(bool (*func_patch)(void *drcontext, void *perscxt,
     return remove_callback(&persist_patch_callbacks, (void (*)(void))func_patch, true);
 }
 
+DR_API
+bool
+dr_set_persist_version(uint64 version)
+{
+    /* Units may be loaded or persisted as soon as we're initialized, and we
+     * read this w/o synch, so we only take it during client init.
+     */
+    if (dynamo_initialized) {
+        CLIENT_ASSERT(false, "dr_set_persist_version must be called at init time");
+        return false;
+    }
+    /* Clients are initialized in a fixed order, so an order-dependent mix
+     * gives the same value for the same set of clients.
+     */
+    persist_client_version = persist_client_version * 31 + version;
+    return true;
+}
+
+uint64
+instrument_persist_version(void)
+{
+    return persist_client_version;
+}
+
 DR_API
 /* Create instructions for storing pointer-size integer val to dst,
  * and then insert them into ilist prior to where.
@@ -148,6 +148,7 @@ bool instrument_persist_rw(dcontext_t *dcontext, void *perscxt, file_t fd);
 bool instrument_resurrect_rw(dcontext_t *dcontext, void *perscxt, byte *map);
 bool instrument_persist_patch(dcontext_t *dcontext, void *perscxt,
                               byte *bb_start, size_t bb_size);
+uint64 instrument_persist_version(void);
 
 #endif /* CLIENT_INTERFACE */
 
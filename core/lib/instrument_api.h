@@ -6392,4 +6392,19 @@ dr_unregister_persist_patch(bool (*func_patch)(void *drcontext, void *perscxt,
                                                byte *bb_start, size_t bb_size,
                                                void *user_data));
 
+DR_API
+/**
+ * Supplies a version identifier for this client's instrumentation, to be
+ * recorded in each persisted cache file and included in its file name.
+ * A persisted cache file is only loaded if the identifiers supplied by all
+ * clients in the current run match those in effect when the file was
+ * written, so a client that changes its instrumentation (or the layout of
+ * its persisted data) should change \p version, typically to a hash of its
+ * build or configuration.  Files for different versions co-exist on disk.
+ * Must be called from dr_client_main(), before any module is executed.
+ * \return whether successful.
+ */
+bool
+dr_set_persist_version(uint64 version);
+
 #endif /* _INSTRUMENT_API_H_ */
@@ -263,6 +263,7 @@
     STATS_DEF("Shared deletion flushtime diff > #threads", num_shared_flush_diffthreads)
     STATS_DEF("Shared deletion max flushtime diff", num_shared_flush_maxdiff)
     STATS_DEF("Shared deletion max pending", num_shared_flush_maxpending)
+    STATS_DEF("Shared deletion max frags freed per walk", num_shared_flush_maxfreed)
     STATS_DEF("Shared deletion region removals: ref 0", num_shared_flush_refzero)
     STATS_DEF("Shared deletion region removals: at exit", num_shared_flush_atexit)
     STATS_DEF("Shared deletion region removals: at reset", num_shared_flush_atreset)
@@ -666,6 +667,7 @@
     STATS_DEF("Persisted cache load error: no trace support", perscache_trace_mismatch)
     STATS_DEF("Persisted cache load error: no RAC/RCT support", perscache_rct_mismatch)
     STATS_DEF("Persisted cache load error: option mismatch", perscache_options_mismatch)
+    STATS_DEF("Persisted cache load error: client mismatch", perscache_client_mismatch)
     STATS_DEF("Persisted cache load error: maps not adjacent",
               perscache_maps_not_adjacent)
 #ifdef HOT_PATCHING_INTERFACE
@@ -901,6 +903,14 @@
     STATS_DEF("Peak heap bucket pad space (bytes)", peak_heap_bucket_pad)
     STATS_DEF("Heap allocs in buckets", heap_allocs_buckets)
     STATS_DEF("Heap allocs variable-sized", heap_allocs_variable)
+    STATS_DEF("Global heap allocs from thread magazines", heap_magazine_hits)
+    STATS_DEF("Global heap magazine refills", heap_magazine_refills)
+    STATS_DEF("Global heap magazine drains", heap_magazine_drains)
+    STATS_DEF("IR arena allocs", ir_arena_allocs)
+    STATS_DEF("IR arena chunks retired while pinned", ir_arena_retired)
+    STATS_DEF("Max IR arena chunks pinned at once", ir_arena_max_retired)
+    STATS_DEF("IR arena allocs while building a trace", ir_arena_trace_allocs)
+    STATS_DEF("IR arena chunks retired while building a trace", ir_arena_trace_retired)
     STATS_DEF("Total reserved memory", reserved_memory_capacity)
     STATS_DEF("Peak total reserved memory", peak_reserved_memory_capacity)
     STATS_DEF("Guard pages, reserved virtual pages", guard_pages)
@@ -1193,6 +1203,7 @@
     STATS_DEF("Doubled-up nudges", num_pending_nudges)
     /*  Clean Calls */
     STATS_DEF("Clean Call analyzed", cleancall_analyzed)
+    STATS_DEF("Clean Call nested callees followed", cleancall_callees_followed)
     STATS_DEF("Clean Call inserted", cleancall_inserted)
     STATS_DEF("Clean Call inlined", cleancall_inlined)
     STATS_DEF("Clean Call xmm skipped", cleancall_simd_skipped)
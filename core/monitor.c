@@ -1196,6 +1196,7 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
     bool replace_trace_head = false;
     fragment_t wrapper;
     uint i;
+    bool ir_arena_was_active;
 #if defined(DEBUG) || defined(INTERNAL) || defined(CLIENT_INTERFACE)
     /* was the trace passed through optimizations or the client interface? */
     bool externally_mangled = false;
@@ -1204,6 +1205,11 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
      * to a trace b/c traces have prefixes that basic blocks don't!
      */
 
+    /* IR created while mangling, instrumenting and emitting the trace is gone
+     * by the time we return
+     */
+    ir_arena_was_active = heap_ir_arena_enter(dcontext);
+
     DOSTATS({
         /* static count last_exit statistics case 4817 */
         if (LINKSTUB_INDIRECT(dcontext->last_exit->flags)) {
@@ -1617,6 +1623,7 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
 #endif
 
  end_and_emit_trace_return:
+    heap_ir_arena_exit(dcontext, ir_arena_was_active);
     if (cur_f == NULL && cur_f_tag == tag)
         return trace_f;
     else {
@@ -1150,6 +1150,13 @@
      * DR areas and subsequent problems with DR areas and allmem synch (i#369)
      */
     OPTION_DEFAULT_INTERNAL(uint_size, max_heap_unit_size, 256*1024, "maximum heap unit size")
+    /* Per-thread caches of fixed-size global heap blocks that avoid
+     * global_alloc_lock for common global allocs and frees.  0 disables.
+     */
+    OPTION_DEFAULT_INTERNAL(uint, heap_magazine_size, 16,
+                            "max global heap blocks cached per thread per size bucket")
+    OPTION_DEFAULT_INTERNAL(bool, ir_arena, true,
+                            "bump-allocate IR while building a bb or trace")
     /* heap_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
     OPTION_DEFAULT(uint_size, heap_commit_increment, 4*1024, "heap commit increment")
     /* cache_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
@@ -2355,6 +2355,11 @@ get_persist_filename(char *filename /*OUT*/, uint filename_max /* max #chars */,
         for (i = 0; i < strlen(option_string); i++)
             hash ^= option_string[i] << ((i % 4)*8);
     }
+#ifdef CLIENT_INTERFACE
+    /* Keep files for different client instrumentation versions apart */
+    hash ^= (uint)instrument_persist_version() ^
+        (uint)(instrument_persist_version() >> 32);
+#endif
     LOG(GLOBAL, LOG_CACHE, 2, "\thash = 0x%08x^0x%08x^"PFX" ^ %s = "PFX"\n",
         checksum, timestamp, size, option_string == NULL ? "" : option_string, hash);
     ASSERT_CURIOSITY(hash != 0);
@@ -2977,6 +2982,7 @@ coarse_unit_set_persist_data(dcontext_t *dcontext, coarse_info_t *info,
 #else
     pers->build_number = 0;
 #endif
+    pers->client_version = IF_CLIENT_INTERFACE_ELSE(instrument_persist_version(), 0);
 
     if (TEST(PERSCACHE_MODULE_MD5_AT_LOAD, DYNAMO_OPTION(persist_gen_validation))) {
         ASSERT(!is_region_memset_to_char((byte *)&info->module_md5,
@@ -4030,6 +4036,17 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end,
         goto coarse_unit_load_exit;
     }
 
+    /* The client version is part of the file name, but the hash can collide */
+    if (pers->client_version !=
+        IF_CLIENT_INTERFACE_ELSE(instrument_persist_version(), 0)) {
+        LOG(THREAD, LOG_CACHE, 1, "  client version mismatch "UINT64_FORMAT_STRING
+            " vs persisted "UINT64_FORMAT_STRING"\n",
+            IF_CLIENT_INTERFACE_ELSE(instrument_persist_version(), 0),
+            pers->client_version);
+        STATS_INC(perscache_client_mismatch);
+        goto coarse_unit_load_exit;
+    }
+
     stubs_and_prefixes_len =
         (pers->stubs_len + pers->ibl_jmp_prefix_len + pers->ibl_call_prefix_len
          + pers->ibl_ret_prefix_len + pers->trace_head_return_prefix_len
@@ -317,7 +317,7 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
 
 enum {
     PERSISTENT_CACHE_MAGIC = 0x244f4952, /* RIO$ */
-    PERSISTENT_CACHE_VERSION = 10,
+    PERSISTENT_CACHE_VERSION = 11,
 };
 
 /* Global flags we need to process if present in a persisted cache */
@@ -503,6 +503,11 @@ typedef struct _coarse_persisted_info_t {
     /* Case 9799: pcache-affecting options that differ from default values */
     size_t option_string_len;
 
+    /* Combined dr_set_persist_version() values of the clients whose
+     * instrumentation is in the cache (0 if none set)
+     */
+    uint64 client_version;
+
     /* Add length of new +r data section here (header grows downward)
      * header_len indicates the start of the data section
      */
@@ -372,6 +372,8 @@ enum {
     LOCK_RANK(shared_cache_flush_lock), /* < shared_cache_count_lock,
                                            < shared_delete_lock,
                                            < change_linking_lock */
+    LOCK_RANK(shared_delete_free_lock), /* > shared_cache_flush_lock,
+                                         * < shared_delete_lock */
     LOCK_RANK(shared_delete_lock), /* < change_linking_lock < shared_vm_areas */
     LOCK_RANK(lazy_delete_lock), /* > shared_delete_lock, < shared_cache_lock */
 
@@ -416,6 +416,12 @@ DECLARE_CXTSWPROT_VAR(static mutex_t last_deallocated_lock,
 
 /* synchronization for shared_delete, not a rw lock since readers usually write */
 DECLARE_CXTSWPROT_VAR(mutex_t shared_delete_lock, INIT_LOCK_FREE(shared_delete_lock));
+/* Serializes pending-deletion walks, which free their entries without holding
+ * shared_delete_lock, so that entries and cache units are still freed in
+ * increasing flushtime order.
+ */
+DECLARE_CXTSWPROT_VAR(static mutex_t shared_delete_free_lock,
+                      INIT_LOCK_FREE(shared_delete_free_lock));
 /* synchronization for the lazy deletion list */
 DECLARE_CXTSWPROT_VAR(static mutex_t lazy_delete_lock, INIT_LOCK_FREE(lazy_delete_lock));
 
@@ -1713,6 +1719,7 @@ vm_areas_exit()
 
     vm_areas_reset_free();
     DELETE_LOCK(shared_delete_lock);
+    DELETE_LOCK(shared_delete_free_lock);
     DELETE_LOCK(lazy_delete_lock);
     ASSERT(todelete->lazy_delete_count == 0);
     ASSERT(!todelete->move_pending);
@@ -9491,6 +9498,13 @@ vm_area_unlink_incoming(dcontext_t *dcontext, app_pc pc)
  * Returns false iff was_I_flushed has been flushed (not necessarily
  * fully freed yet though, but may be at any time after this call
  * returns, so caller should drop its ref to it).
+ * The caller's flushtime acts as an epoch: we only hold
+ * shared_cache_flush_lock long enough to read flushtime_global, and we only
+ * sign off on entries up to that value.  We hold shared_delete_lock only to
+ * walk the list and detach the entries that are ready, and free them after
+ * dropping it, so flushers and lazy deletion adders, which take
+ * shared_delete_lock while holding shared_cache_flush_lock, are not held up
+ * while we free fragments.
  */
 bool
 vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
@@ -9504,6 +9518,7 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
     int num = 0;
     DEBUG_DECLARE(int i = 0;)
     bool not_flushed = true;
+    uint flushtime; /* the epoch we are signing off on */
     ASSERT(DYNAMO_OPTION(shared_deletion) || dynamo_exited);
     /* must pass in real dcontext, unless exiting or resetting */
     ASSERT(dcontext != GLOBAL_DCONTEXT || dynamo_exited || dynamo_resetting);
@@ -9540,6 +9555,16 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
         last_exit_deleted(dcontext);
     }
 
+    /* Every entry with a flushtime at or below this value is already on the
+     * pending list, as adders hold shared_cache_flush_lock from the increment
+     * to the add.  Entries added after we drop the lock have a higher
+     * flushtime and we leave them for our next walk, so we need not hold the
+     * lock across the walk and the frees below.
+     */
+    flushtime = flushtime_global;
+    mutex_unlock(&shared_cache_flush_lock);
+
+    mutex_lock(&shared_delete_free_lock);
     mutex_lock(&shared_delete_lock);
     for (pend = todelete->shared_delete; pend != NULL; pend = pend_nxt) {
         bool delete_area = false;
@@ -9547,6 +9572,15 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
         LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 2,
             "  Considering #%d: "PFX".."PFX" flushtime %d\n",
             i, pend->start, pend->end, pend->flushtime_deleted);
+        if (dcontext != GLOBAL_DCONTEXT && pend->flushtime_deleted > flushtime) {
+            /* added after our snapshot: since we always pre-pend, these are
+             * all at the front
+             */
+            ASSERT(pend->ref_count > 0);
+            pend_prev = pend;
+            DODEBUG({ i++; });
+            continue;
+        }
         if (dcontext == GLOBAL_DCONTEXT) {
             /* indication that it's safe to free everything */
             delete_area = true;
@@ -9613,12 +9647,19 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
                 ASSERT(pend->next == NULL);
                 todelete->shared_delete_tail = pend_prev;
             }
+            ASSERT(todelete->shared_delete_count > 0);
+            todelete->shared_delete_count--;
             pend->next = tofree;
             tofree = pend;
         } else
             pend_prev = pend;
         DODEBUG({ i++; });
     }
+    /* The detached entries are ours alone now.  Only a walker, which holds
+     * shared_delete_free_lock, removes entries, so the tail cannot move below
+     * what we free.
+     */
+    mutex_unlock(&shared_delete_lock);
 
     for (pend = tofree; pend != NULL; pend = pend_nxt) {
         pend_nxt = pend->next;
@@ -9663,44 +9704,47 @@ vm_area_check_shared_pending(dcontext_t *dcontext, fragment_t *was_I_flushed)
             num++;
         }
 
-        ASSERT(todelete->shared_delete_count > 0);
-        todelete->shared_delete_count--;
         HEAP_TYPE_FREE(GLOBAL_DCONTEXT, pend, pending_delete_t,
                        ACCT_VMAREAS, PROTECTED);
     }
+    STATS_TRACK_MAX(num_shared_flush_maxfreed, num);
 
     if (tofree != NULL) { /* if we freed something (careful: tofree is dangling) */
         /* case 8242: due to -syscalls_synch_flush, a later entry can
          * reach refcount 0 before an earlier entry, so we cannot free
          * units until all earlier entries have been freed.
          */
+        uint units_flushtime;
+        mutex_lock(&shared_delete_lock);
         if (todelete->shared_delete_tail == NULL)
-            fcache_free_pending_units(dcontext, flushtime_global);
-        else {
-            fcache_free_pending_units(dcontext,
-                                      todelete->shared_delete_tail->flushtime_deleted
-                                      - 1);
-        }
+            units_flushtime = flushtime;
+        else
+            units_flushtime = todelete->shared_delete_tail->flushtime_deleted - 1;
+        mutex_unlock(&shared_delete_lock);
+        fcache_free_pending_units(dcontext, units_flushtime);
     }
 
     if (dcontext == GLOBAL_DCONTEXT) { /* need to free everything */
-        check_lazy_deletion_list(dcontext, flushtime_global+1);
-        fcache_free_pending_units(dcontext, flushtime_global+1);
+        check_lazy_deletion_list(dcontext, flushtime+1);
+        fcache_free_pending_units(dcontext, flushtime+1);
         /* reset_every_nth_pending relies on this */
         ASSERT(todelete->shared_delete_count == 0);
     }
-    mutex_unlock(&shared_delete_lock);
+    mutex_unlock(&shared_delete_free_lock);
     STATS_TRACK_MAX(num_shared_flush_maxpending, i);
 
     /* last_area cleared in vm_area_unlink_fragments */
     LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 2,
         "thread "TIDFMT" done walking pending list @flushtime %d\n",
-        get_thread_id(), flushtime_global);
+        get_thread_id(), flushtime);
     if (dcontext != GLOBAL_DCONTEXT) {
-        /* update thread timestamp */
-        set_flushtime_last_update(dcontext, flushtime_global);
+        /* update thread timestamp: only to our snapshot, as we have not
+         * ok-ed any later entries.  Our linking_lock (held by us or by a
+         * flusher acting on our behalf) serializes this with other walks
+         * for this thread.
+         */
+        set_flushtime_last_update(dcontext, flushtime);
     }
-    mutex_unlock(&shared_cache_flush_lock);
 
     LOG(THREAD, LOG_FRAGMENT|LOG_VMAREAS, 2, "  Flushed %d frags\n", num);
     return not_flushed;
@@ -46,6 +46,8 @@
         FUNCTION(callpic_pop) \
         FUNCTION(callpic_mov) \
         FUNCTION(nonleaf) \
+        FUNCTION(nonleaf_clobber) \
+        FUNCTION(nonleaf_deep) \
         FUNCTION(cond_br) \
         FUNCTION(tls_clobber) \
         FUNCTION(aflags_clobber) \
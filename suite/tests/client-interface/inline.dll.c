@@ -52,6 +52,8 @@
         FUNCTION(callpic_pop) \
         FUNCTION(callpic_mov) \
         FUNCTION(nonleaf) \
+        FUNCTION(nonleaf_clobber) \
+        FUNCTION(nonleaf_deep) \
         FUNCTION(cond_br) \
         FUNCTION(tls_clobber) \
         FUNCTION(aflags_clobber) \
@@ -231,6 +233,7 @@ static int after_errno;
 
 /* Reset global_count and patch the out-of-line version of the instrumentation function
  * so we can find out if it got called, which would mean it wasn't inlined.
+ * A NULL func is not patched: such a callee must clear callee_inlined itself.
  *
  * XXX: We modify the callee code!  If DR tries to disassemble the callee's
  * ilist after the modification, it will trigger assertion failures in the
@@ -251,6 +254,12 @@ before_callee(app_pc func, const char *func_name)
     dc = dr_get_current_drcontext();
     dr_get_mcontext(dc, &before_mcontext);
 
+    if (func == NULL) {
+        global_count = 0;
+        callee_inlined = 1;
+        return;
+    }
+
     /* If this is compiler_inscount, we need to unprotect our own text section
      * so we can make this code modification.
      */
@@ -517,7 +526,7 @@ check_aflags(int actual, int expected)
 }
 
 static instr_t *
-test_aflags(void *dc, instrlist_t *bb, instr_t *where, int aflags,
+test_aflags(void *dc, instrlist_t *bb, instr_t *where, int aflags, int fn_idx,
             instr_t *before_label, instr_t *after_label)
 {
     opnd_t xax = opnd_create_reg(DR_REG_XAX);
@@ -544,7 +553,7 @@ test_aflags(void *dc, instrlist_t *bb, instr_t *where, int aflags,
 
     if (before_label != NULL)
         PRE(bb, where, before_label);
-    dr_insert_clean_call(dc, bb, where, func_ptrs[FN_aflags_clobber], false, 0);
+    dr_insert_clean_call(dc, bb, where, func_ptrs[fn_idx], false, 0);
     if (after_label != NULL)
         PRE(bb, where, after_label);
 
@@ -590,10 +599,15 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
     if (i == N_FUNCS)
         return DR_EMIT_DEFAULT;
 
-    /* We're inserting a call to a function in this bb. */
+    /* We're inserting a call to a function in this bb.  The nonleaf_clobber
+     * and nonleaf_deep callees must really run so that we can see whether the
+     * registers their nested callees write are preserved.
+     */
     func_called[i] = 1;
     dr_insert_clean_call(dc, bb, entry, (void*)before_callee, false, 2,
-                         OPND_CREATE_INTPTR(func_ptrs[i]),
+                         OPND_CREATE_INTPTR((i == FN_nonleaf_clobber ||
+                                             i == FN_nonleaf_deep) ?
+                                            NULL : func_ptrs[i]),
                          OPND_CREATE_INTPTR(func_names[i]));
 
     before_label = INSTR_CREATE_label(dc);
@@ -618,6 +632,7 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
         PRE(bb, entry, after_label);
         break;
     case FN_nonleaf:
+    case FN_nonleaf_deep:
     case FN_cond_br:
         /* These functions cannot be inlined (yet). */
         PRE(bb, entry, before_label);
@@ -638,8 +653,14 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
          * Overflow is in the low byte (al usually) so use use a mask of
          * 0xD701 first.  If we turn everything off we get 0x0200.
          */
-        entry = test_aflags(dc, bb, entry, 0xD701, before_label, after_label);
-        (void)test_aflags(dc, bb, entry, 0x00200, NULL, NULL);
+        entry = test_aflags(dc, bb, entry, 0xD701, i, before_label, after_label);
+        (void)test_aflags(dc, bb, entry, 0x00200, i, NULL, NULL);
+        break;
+    case FN_nonleaf_clobber:
+        /* Not inlined, but its nested callee zeroes the aflags too. */
+        entry = test_aflags(dc, bb, entry, 0xD701, i, before_label, after_label);
+        (void)test_aflags(dc, bb, entry, 0x00200, i, NULL, NULL);
+        inline_expected = false;
         break;
     }
     dr_insert_clean_call(dc, bb, entry, (void*)after_callee, false, 5,
@@ -923,6 +944,103 @@ codegen_nonleaf(void *dc)
     return ilist;
 }
 
+/* A non-leaf function whose nested callee writes a caller-saved GPR, an xmm
+ * register and the aflags.  The clean call must preserve all of them even
+ * though the callee itself does not touch them.  We run it for real, so it
+ * reports that it was not inlined itself.
+nonleaf_clobber:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov dword [callee_inlined], 0
+    call clobber_gpr
+    leave
+    ret
+clobber_gpr:
+    mov REG_XCX, HEX(DEAD)
+    call clobber_xmm_aflags
+    ret
+clobber_xmm_aflags:
+    pcmpeqd xmm1, xmm1
+    mov REG_XAX, 0
+    add al, HEX(7F)
+    sahf
+    ret
+*/
+static instrlist_t *
+codegen_nonleaf_clobber(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *clobber_gpr = INSTR_CREATE_label(dc);
+    instr_t *clobber_xmm_aflags = INSTR_CREATE_label(dc);
+    opnd_t xmm1 = opnd_create_reg(DR_REG_XMM1);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_st
+        (dc, OPND_CREATE_ABSMEM(&callee_inlined, OPSZ_4), OPND_CREATE_INT32(0)));
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(clobber_gpr)));
+    codegen_epilogue(dc, ilist);
+    APP(ilist, clobber_gpr);
+    APP(ilist, INSTR_CREATE_mov_imm
+        (dc, opnd_create_reg(DR_REG_XCX), OPND_CREATE_INTPTR(0xDEAD)));
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(clobber_xmm_aflags)));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    APP(ilist, clobber_xmm_aflags);
+    APP(ilist, INSTR_CREATE_pcmpeqd(dc, xmm1, xmm1));
+    APP(ilist, INSTR_CREATE_mov_imm
+        (dc, opnd_create_reg(DR_REG_XAX), OPND_CREATE_INTPTR(0)));
+    APP(ilist, INSTR_CREATE_add
+        (dc, opnd_create_reg(DR_REG_AL), OPND_CREATE_INT8(0x7F)));
+    APP(ilist, INSTR_CREATE_sahf(dc));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    return ilist;
+}
+
+/* Nested calls deeper than the callee analysis follows: the analysis must give
+ * up and the clean call must save everything that deep3 writes.
+nonleaf_deep:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov dword [callee_inlined], 0
+    call deep1
+    leave
+    ret
+deep1:
+    call deep2
+    ret
+deep2:
+    call deep3
+    ret
+deep3:
+    mov REG_XDX, HEX(BEEF)
+    pcmpeqd xmm2, xmm2
+    ret
+*/
+static instrlist_t *
+codegen_nonleaf_deep(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *deep1 = INSTR_CREATE_label(dc);
+    instr_t *deep2 = INSTR_CREATE_label(dc);
+    instr_t *deep3 = INSTR_CREATE_label(dc);
+    opnd_t xmm2 = opnd_create_reg(DR_REG_XMM2);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_st
+        (dc, OPND_CREATE_ABSMEM(&callee_inlined, OPSZ_4), OPND_CREATE_INT32(0)));
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(deep1)));
+    codegen_epilogue(dc, ilist);
+    APP(ilist, deep1);
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(deep2)));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    APP(ilist, deep2);
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(deep3)));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    APP(ilist, deep3);
+    APP(ilist, INSTR_CREATE_mov_imm
+        (dc, opnd_create_reg(DR_REG_XDX), OPND_CREATE_INTPTR(0xBEEF)));
+    APP(ilist, INSTR_CREATE_pcmpeqd(dc, xmm2, xmm2));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    return ilist;
+}
+
 /* Conditional branches cannot be inlined.  Avoid flags usage to make test case
  * more specific.
 cond_br:
@@ -34,12 +34,21 @@
 #include "hashtable.h"
 
 #include "client_tools.h"  /* For ASSERT; DR_ASSERT raises a message box. */
+#include <string.h>
 
 static byte *mybase;
 static uint bb_execs;
 static uint resurrect_success;
 static bool verbose;
 
+/* The version both the generating and the -use runs supply */
+#define PERSIST_VERSION 0x0070636163686531ULL
+/* The same halves swapped, which folds to the same file name hash: the
+ * -mismatch run thus finds the generated pcaches and DR must reject them on
+ * the version check rather than by not finding them.
+ */
+#define PERSIST_VERSION_MISMATCH 0x6368653100706361ULL
+
 /* test hashtable persistence via a table that contains one entry per
  * pcache written or loaded.  key is start, payload is size.
  */
@@ -220,6 +229,10 @@ DR_EXPORT
 void
 dr_init(client_id_t id)
 {
+    const char *options = dr_get_options(id);
+    uint64 version = PERSIST_VERSION;
+    if (options != NULL && strstr(options, "-mismatch") != NULL)
+        version = PERSIST_VERSION_MISMATCH;
     mybase = dr_get_client_base(id);
     dr_fprintf(STDERR, "thank you for testing the client interface\n");
     dr_register_exit_event(event_exit);
@@ -230,6 +243,9 @@ dr_init(client_id_t id)
         dr_fprintf(STDERR, "failed to register ro");
     if (!dr_register_persist_patch(event_persist_patch))
         dr_fprintf(STDERR, "failed to register patch");
+    /* the -use run must supply the same version to load the generated pcaches */
+    if (!dr_set_persist_version(version))
+        dr_fprintf(STDERR, "failed to set persist version");
 
     hashtable_init(&sample_inlined_table, 4, HASH_INTPTR, false/*!strdup*/);
     hashtable_init_ex(&sample_pointer_table, 4, HASH_INTPTR, false/*!strdup*/,